@@ -0,0 +1,97 @@
+#include "AllocationCounter.h"
+
+#ifdef FRACTALS_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace {
+    std::atomic<long long> allocations{ 0 };
+
+    void* countedAllocate(std::size_t size) {
+        ++allocations;
+        if (size == 0) size = 1;
+        for (;;) {
+            if (void* p = std::malloc(size)) return p;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) return nullptr;
+            handler();
+        }
+    }
+
+    void* countedAllocateAligned(std::size_t size, std::align_val_t alignment) {
+        ++allocations;
+        std::size_t align = static_cast<std::size_t>(alignment);
+        // aligned_alloc wants a multiple of the alignment
+        size = (size + align - 1) / align * align;
+        if (size == 0) size = align;
+        for (;;) {
+#ifdef _MSC_VER
+            void* p = _aligned_malloc(size, align);
+#else
+            void* p = std::aligned_alloc(align, size);
+#endif
+            if (p) return p;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) return nullptr;
+            handler();
+        }
+    }
+
+    void alignedFree(void* p) {
+#ifdef _MSC_VER
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAllocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = countedAllocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocateAligned(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+
+bool allocationCountingEnabled() { return true; }
+long long allocationCount() { return allocations.load(std::memory_order_relaxed); }
+
+#else
+
+bool allocationCountingEnabled() { return false; }
+long long allocationCount() { return 0; }
+
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+
+// Heap allocation counter, for checking that steady-state terrain generation
+// doesn't allocate. Building with FRACTALS_COUNT_ALLOCATIONS defined replaces
+// the global operator new/delete with counting versions; otherwise nothing is
+// replaced and the count stays 0.
+
+bool allocationCountingEnabled();
+// operator new calls so far, from every thread
+long long allocationCount();
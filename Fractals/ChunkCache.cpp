@@ -0,0 +1,317 @@
+#include "ChunkCache.h"
+
+#include "Hash.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char TILE_MAGIC[4] = { 'F', 'C', 'H', 'K' };
+    // Bump when the layout below changes
+    const uint32_t TILE_FORMAT_VERSION = 1;
+    const uint32_t TILE_COMPRESSED = 1;
+    const char* const TILE_EXTENSION = ".chunk";
+
+    // Little-endian, as written by the machines this runs on
+    struct TileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t worldSeed;
+        uint64_t parameters;
+        int32_t chunkX;
+        int32_t chunkY;
+        int32_t rows;
+        int32_t cols;
+        uint64_t payloadBytes;
+    };
+    static_assert(sizeof(TileHeader) == 48, "TileHeader must have no padding");
+
+    void encodeRow(const float* row, int count, std::vector<uint8_t>& out) {
+        uint32_t previous = 0;
+        for (int i = 0; i < count; ++i) {
+            uint32_t bits;
+            std::memcpy(&bits, row + i, sizeof(bits));
+            uint32_t delta = bits - previous;
+            previous = bits;
+            uint32_t zigzag = (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+            while (zigzag >= 0x80) {
+                out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+                zigzag >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(zigzag));
+        }
+    }
+
+    // Null if the input runs out or a varint is malformed
+    const uint8_t* decodeRow(const uint8_t* in, const uint8_t* end, float* row, int count) {
+        uint32_t previous = 0;
+        for (int i = 0; i < count; ++i) {
+            uint32_t zigzag = 0;
+            for (int shift = 0;; shift += 7) {
+                if (in == end || shift > 28) return nullptr;
+                uint8_t byte = *in++;
+                zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+            previous += delta;
+            std::memcpy(row + i, &previous, sizeof(previous));
+        }
+        return in;
+    }
+
+    // Plain file calls on C paths; std::filesystem would build a path
+    // object, and stdio a buffer, on every load and store
+
+    // Set the modification time to now
+    void touchFile(const char* path) {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, FILE_WRITE_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        SetFileTime(file, nullptr, nullptr, &now);
+        CloseHandle(file);
+#else
+        utimensat(AT_FDCWD, path, nullptr, 0);
+#endif
+    }
+
+    // Create or truncate path and write header then payload
+    bool writeFile(const char* path, const void* header, size_t headerBytes, const void* payload,
+        size_t payloadBytes) {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        DWORD written = 0;
+        bool ok = WriteFile(file, header, static_cast<DWORD>(headerBytes), &written, nullptr) &&
+            written == headerBytes &&
+            WriteFile(file, payload, static_cast<DWORD>(payloadBytes), &written, nullptr) &&
+            written == payloadBytes;
+        return CloseHandle(file) && ok;
+#else
+        int file = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0) return false;
+        auto writeAll = [file](const void* data, size_t bytes) {
+            const char* next = static_cast<const char*>(data);
+            while (bytes > 0) {
+                ssize_t written = ::write(file, next, bytes);
+                if (written <= 0) return false;
+                next += written;
+                bytes -= static_cast<size_t>(written);
+            }
+            return true;
+        };
+        bool ok = writeAll(header, headerBytes) && writeAll(payload, payloadBytes);
+        return ::close(file) == 0 && ok;
+#endif
+    }
+
+    // Move from over to, replacing it
+    bool replaceFile(const char* from, const char* to) {
+#if defined(_WIN32)
+        return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(from, to) == 0;
+#endif
+    }
+}
+
+ChunkCache::ChunkCache(const ChunkCacheSettings& cacheSettings)
+    : settings(cacheSettings), totalBytes(0), temporaryCounter(0), hitCount(0), missCount(0) {
+    scanDirectory();
+}
+
+uint64_t ChunkCache::tileId(const ChunkCacheKey& key) {
+    uint64_t h = hashCombine64(key.parameters, key.worldSeed);
+    h = hashCombine64(h, static_cast<uint32_t>(key.chunkX));
+    return hashCombine64(h, static_cast<uint32_t>(key.chunkY));
+}
+
+bool ChunkCache::tilePath(uint64_t id, char (&path)[PATH_CAPACITY]) const {
+    const char* separator = settings.directory.empty() ? "" : "/";
+    int length = std::snprintf(path, PATH_CAPACITY, "%s%s%016llx%s", settings.directory.c_str(), separator,
+        static_cast<unsigned long long>(id), TILE_EXTENSION);
+    return length > 0 && static_cast<size_t>(length) < PATH_CAPACITY;
+}
+
+// Index the tiles left by earlier runs, least recently used first
+void ChunkCache::scanDirectory() {
+    std::error_code error;
+    fs::create_directories(settings.directory, error);
+
+    struct Found {
+        uint64_t id;
+        long long bytes;
+        fs::file_time_type used;
+    };
+    std::vector<Found> found;
+    for (fs::directory_iterator it(settings.directory, error), end; !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file(error)) continue;
+        const fs::path& path = it->path();
+        if (path.extension() != TILE_EXTENSION) {
+            // Temporaries of a run that died mid-write
+            if (path.extension() == ".tmp") fs::remove(path, error);
+            continue;
+        }
+        // Names are the id in 16 hex digits
+        std::string stem = path.stem().string();
+        char* parsedEnd = nullptr;
+        uint64_t id = std::strtoull(stem.c_str(), &parsedEnd, 16);
+        if (stem.size() != 16 || *parsedEnd != '\0') continue;
+        found.push_back({ id, static_cast<long long>(it->file_size(error)), it->last_write_time(error) });
+    }
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.used < b.used; });
+
+    std::lock_guard<std::mutex> lock(indexMutex);
+    entries.reserve(found.size());
+    for (const Found& tile : found) {
+        entries.push_back({ tile.id, tile.bytes });
+        totalBytes += tile.bytes;
+    }
+    evict(0);
+}
+
+void ChunkCache::touch(uint64_t id, long long bytes) {
+    auto found = std::find_if(entries.begin(), entries.end(), [id](const Entry& entry) { return entry.id == id; });
+    if (found != entries.end()) {
+        totalBytes -= found->bytes;
+        // Move to the most recently used end
+        std::rotate(found, found + 1, entries.end());
+        entries.back().bytes = bytes;
+    }
+    else {
+        entries.push_back({ id, bytes });
+    }
+    totalBytes += bytes;
+}
+
+void ChunkCache::evict(uint64_t keep) {
+    size_t evicted = 0;
+    while (totalBytes > settings.maxBytes && evicted < entries.size()) {
+        const Entry& oldest = entries[evicted];
+        if (oldest.id == keep) break;
+        char path[PATH_CAPACITY];
+        if (tilePath(oldest.id, path)) std::remove(path);
+        totalBytes -= oldest.bytes;
+        ++evicted;
+    }
+    // Capacity is kept for the tiles that replace them
+    entries.erase(entries.begin(), entries.begin() + evicted);
+}
+
+bool ChunkCache::load(const ChunkCacheKey& key, Heightfield& heights) {
+    uint64_t id = tileId(key);
+    char path[PATH_CAPACITY];
+    MappedFile file;
+    TileHeader header;
+    bool valid = tilePath(id, path) && file.open(path) && file.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, file.data(), sizeof(header));
+        valid = std::memcmp(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC)) == 0 &&
+            header.version == TILE_FORMAT_VERSION &&
+            header.parameters == key.parameters && header.worldSeed == key.worldSeed &&
+            header.chunkX == key.chunkX && header.chunkY == key.chunkY &&
+            header.rows == heights.rows() && header.cols == heights.cols() &&
+            header.payloadBytes == file.size() - sizeof(header);
+    }
+
+    if (valid) {
+        const uint8_t* in = file.data() + sizeof(header);
+        const uint8_t* end = file.data() + file.size();
+        int rows = header.rows;
+        int cols = header.cols;
+        if (header.flags & TILE_COMPRESSED) {
+            for (int x = 0; x < rows && in; ++x) in = decodeRow(in, end, heights.row(x), cols);
+            valid = in == end;
+        }
+        else {
+            size_t rowBytes = static_cast<size_t>(cols) * sizeof(float);
+            valid = header.payloadBytes == rowBytes * rows;
+            for (int x = 0; x < rows && valid; ++x) std::memcpy(heights.row(x), in + rowBytes * x, rowBytes);
+        }
+    }
+
+    if (!valid) {
+        ++missCount;
+        return false;
+    }
+    ++hitCount;
+
+    long long bytes = static_cast<long long>(file.size());
+    file.close();
+    touchFile(path);
+    std::lock_guard<std::mutex> lock(indexMutex);
+    touch(id, bytes);
+    return true;
+}
+
+void ChunkCache::store(const ChunkCacheKey& key, const Heightfield& heights, std::vector<uint8_t>& payload) {
+    int rows = heights.rows();
+    int cols = heights.cols();
+    payload.clear();
+    if (settings.compress) {
+        payload.reserve(static_cast<size_t>(rows) * cols * 3);
+        for (int x = 0; x < rows; ++x) encodeRow(heights.row(x), cols, payload);
+    }
+    else {
+        size_t rowBytes = static_cast<size_t>(cols) * sizeof(float);
+        payload.resize(rowBytes * rows);
+        for (int x = 0; x < rows; ++x) std::memcpy(payload.data() + rowBytes * x, heights.row(x), rowBytes);
+    }
+
+    TileHeader header;
+    std::memcpy(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC));
+    header.version = TILE_FORMAT_VERSION;
+    header.flags = settings.compress ? TILE_COMPRESSED : 0;
+    header.worldSeed = key.worldSeed;
+    header.parameters = key.parameters;
+    header.chunkX = key.chunkX;
+    header.chunkY = key.chunkY;
+    header.rows = rows;
+    header.cols = cols;
+    header.payloadBytes = payload.size();
+
+    uint64_t id = tileId(key);
+    char path[PATH_CAPACITY];
+    char temporary[PATH_CAPACITY];
+    if (!tilePath(id, path)) return;
+    int length = std::snprintf(temporary, sizeof(temporary), "%s.%u.tmp", path, temporaryCounter++);
+    if (length <= 0 || static_cast<size_t>(length) >= sizeof(temporary)) return;
+
+    bool written = writeFile(temporary, &header, sizeof(header), payload.data(), payload.size()) &&
+        replaceFile(temporary, path);
+    if (!written) {
+        std::remove(temporary);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(indexMutex);
+    touch(id, static_cast<long long>(sizeof(header) + payload.size()));
+    evict(id);
+}
+
+long long ChunkCache::sizeBytes() {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    return totalBytes;
+}
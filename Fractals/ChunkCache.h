@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Heightfield.h"
+
+/*
+On-disk cache of finished chunk heights, one file per chunk.
+
+A tile is keyed by the world seed, the chunk coordinates and a hash of
+every generation parameter (including a generator version), so changing
+any of them just misses. The header repeats the whole key, so a file name
+collision or a foreign or truncated file is a miss, never wrong terrain.
+Tiles are written to a temporary file and renamed into place, so readers
+never see a partial one.
+
+Files are read through a memory mapping, straight into the caller's grid.
+The payload is either raw floats or, with compression on, each row's float
+bits delta-coded against the previous cell, zigzagged and written as
+varints. That is lossless, about 75% of raw on default terrain, and decodes
+in well under a millisecond.
+
+Total size is capped by deleting the least recently used tiles. Loads
+refresh a tile's modification time, so the order carries over to the next
+run.
+
+Once the cache has reached its cap, loads and stores don't allocate:
+paths are built in fixed buffers, stores encode into a buffer the caller
+keeps, and evicted index entries make room for new ones.
+*/
+
+struct ChunkCacheSettings {
+    std::string directory = "chunk_cache";
+    long long maxBytes = 256LL << 20;
+    bool compress = true;
+};
+
+struct ChunkCacheKey {
+    uint64_t parameters;  // Hash of everything but seed and position
+    uint32_t worldSeed;
+    int32_t chunkX;
+    int32_t chunkY;
+};
+
+class ChunkCache {
+private:
+    struct Entry {
+        uint64_t id;  // From the key; also the file name
+        long long bytes;
+    };
+
+    // Longest tile path, including the temporary suffix
+    static constexpr size_t PATH_CAPACITY = 1024;
+
+    ChunkCacheSettings settings;
+    // Least recently used first; guarded by indexMutex. A full cache holds
+    // about a thousand tiles, so lookups are a linear scan.
+    std::vector<Entry> entries;
+    long long totalBytes;
+    std::mutex indexMutex;
+    std::atomic<unsigned int> temporaryCounter;
+
+    std::atomic<long long> hitCount;
+    std::atomic<long long> missCount;
+
+    static uint64_t tileId(const ChunkCacheKey& key);
+    // False if the path doesn't fit
+    bool tilePath(uint64_t id, char (&path)[PATH_CAPACITY]) const;
+
+    void scanDirectory();
+    // Called with indexMutex held
+    void touch(uint64_t id, long long bytes);
+    void evict(uint64_t keep);
+
+public:
+    explicit ChunkCache(const ChunkCacheSettings& cacheSettings = ChunkCacheSettings());
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    // Fill heights from the tile for key. heights must already have the
+    // stored shape; anything that doesn't match or decode is a miss.
+    bool load(const ChunkCacheKey& key, Heightfield& heights);
+    // Write heights as the tile for key, evicting old tiles over the cap.
+    // payload is scratch, reused from one call to the next; stores on
+    // different threads need their own. Failures (e.g. a read-only
+    // directory) are silent; the cache is optional.
+    void store(const ChunkCacheKey& key, const Heightfield& heights, std::vector<uint8_t>& payload);
+
+    long long hits() const { return hitCount.load(); }
+    long long misses() const { return missCount.load(); }
+    long long sizeBytes();
+};
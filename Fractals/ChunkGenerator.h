@@ -0,0 +1,763 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "ChunkCache.h"
+#include "Erosion.h"
+#include "Hash.h"
+#include "Heightfield.h"
+#include "HeightPyramid.h"
+#include "Noise.h"
+#include "Profiler.h"
+#include "SimdKernels.h"
+#include "StagePipeline.h"
+#include "TerrainLod.h"
+#include "ThreadPool.h"
+
+// Surface classes, one per height band. Stored per cell as a uint8 layer.
+enum TerrainMaterial : uint8_t {
+    MATERIAL_DEEP_WATER,
+    MATERIAL_SHALLOW_WATER,
+    MATERIAL_SAND,
+    MATERIAL_GRASS,
+    MATERIAL_MEADOW,
+    MATERIAL_ROCK,
+    MATERIAL_HIGH_ROCK,
+    MATERIAL_SNOW,
+    MATERIAL_COUNT
+};
+
+using MaterialLayer = Grid<uint8_t>;
+
+struct MaterialPalette {
+    float colors[MATERIAL_COUNT][3];
+    uint8_t packed[MATERIAL_COUNT][4];  // Clamped RGBA8 copy for vertex colors
+};
+
+// Lower height bound of each material above deep water
+const float MATERIAL_THRESHOLDS[MATERIAL_COUNT - 1] = { 0.1f, 0.2f, 0.3f, 0.45f, 0.6f, 0.75f, 0.9f };
+
+const char* const MATERIAL_NAMES[MATERIAL_COUNT] = {
+    "deep water", "shallow water", "sand", "grass", "meadow", "rock", "high rock", "snow"
+};
+
+inline TerrainMaterial classifyMaterial(float height) {
+    int material = 0;
+    while (material < MATERIAL_COUNT - 1 && height >= MATERIAL_THRESHOLDS[material]) ++material;
+    return static_cast<TerrainMaterial>(material);
+}
+
+/*
+Post-erosion stages, run by runStaged/runFused (StagePipeline.h): biome noise
+is added per row, the stencil smooths peaks, and the surface stage emits
+materials and display heights from the final row.
+*/
+
+// Octaves and weights of the two biome variation layers
+struct BiomeSettings {
+    int terrainOctaves = 6;
+    int biomeOctaves = 4;
+    float terrainWeight = 0.2f;
+    float biomeWeight = 0.1f;
+};
+
+// Two fBm layers in world coordinates, so neighbors agree along shared
+// borders: broad terrain swells and finer, rougher biome detail
+struct BiomeVariationStage {
+    static constexpr int scratchRows = 2;
+
+    const GradientNoise* noise;
+    int originX;  // World coordinates of grid point (0, 0)
+    int originY;
+    NoiseSettings terrainSettings;
+    NoiseSettings biomeSettings;
+    float terrainWeight;
+    float biomeWeight;
+
+    BiomeVariationStage(const GradientNoise& variationNoise, int x, int y, const BiomeSettings& biome)
+        : noise(&variationNoise), originX(x), originY(y), terrainWeight(biome.terrainWeight),
+        biomeWeight(biome.biomeWeight) {
+        terrainSettings.octaves = biome.terrainOctaves;
+        terrainSettings.frequency = 1.0f / 256.0f;
+        biomeSettings.octaves = biome.biomeOctaves;
+        biomeSettings.frequency = 1.0f / 128.0f;
+        biomeSettings.gain = 0.6f;
+    }
+
+    void operator()(int x, float* row, int count, float* scratch) const {
+        float* terrainNoise = scratch;
+        float* biomeNoise = scratch + count;
+        float worldX = static_cast<float>(originX + x);
+        float worldY = static_cast<float>(originY);
+        noise->sampleRow(worldX, worldY, count, terrainSettings, terrainNoise);
+        noise->sampleRow(worldX, worldY, count, biomeSettings, biomeNoise);
+        for (int y = 0; y < count; ++y) {
+            terrainNoise[y] = terrainNoise[y] * terrainWeight + biomeNoise[y] * biomeWeight;
+        }
+        addClampRow(row, 0.0f, terrainNoise, count);
+    }
+};
+
+// 3x3 smoothing with a power curve that flattens lowlands and sharpens peaks
+struct SmoothPeaksStage {
+    float exponent = 0.78f;
+
+    void operator()(int, const float* above, const float* center, const float* below, float* out,
+        int count) const {
+        // The border gets the same point-wise curve without the stencil, which
+        // keeps it a function of the shared edge values alone. Rows and
+        // columns give identical results, so neighbors still agree.
+        if (!above || !below) {
+            powRow(center, out, count, exponent);
+            return;
+        }
+        smoothStencilPowRow(above + 1, center + 1, below + 1, out + 1, count - 2, exponent);
+        out[0] = fastPow(center[0], exponent);
+        out[count - 1] = fastPow(center[count - 1], exponent);
+    }
+};
+
+// Reads the finished heights: material classes, display heights (world
+// units, as drawn) and the highest height per row
+struct SurfaceStage {
+    static constexpr int scratchRows = 0;
+
+    MaterialLayer* materials;
+    Heightfield* display;
+    float* rowHighest;
+    float scale;
+
+    void operator()(int x, float* row, int count, float*) const {
+        uint8_t* materialRow = materials->row(x);
+        float* displayRow = display->row(x);
+        float highest = 0.0f;
+        for (int y = 0; y < count; ++y) {
+            materialRow[y] = classifyMaterial(row[y]);
+            highest = std::max(highest, row[y]);
+            displayRow[y] = std::pow(row[y], 1.5f) * scale;
+        }
+        rowHighest[x] = highest;
+    }
+};
+
+/*
+Working memory for generating one chunk at a time. Buffers keep their
+capacity from one chunk to the next, so once an arena has been through a
+chunk of a given size, generating another allocates nothing. TerrainManager
+keeps one arena per pool thread instead of one per loaded chunk.
+*/
+struct ScratchArena {
+    Heightfield heights;  // Second buffer for the stencil and erosion passes
+    std::vector<float> edge;
+    // Row windows and stage scratch for the post-erosion pass
+    std::vector<float> stageRows;
+    std::vector<float> rowHighest;
+    ThermalErosion thermalErosion;
+    HydraulicErosion hydraulicErosion;
+    std::vector<uint8_t> cachePayload;  // Encoded tile for ChunkCache::store
+};
+
+// Seconds spent in each step of the last generateChunk. With stage fusion
+// on, biome variation and the second smoothing pass are part of surface and
+// their own entries stay 0.
+struct ChunkTimings {
+    double diamondSquare = 0.0;
+    double smoothPeaks = 0.0;     // After diamond-square, and after erosion when unfused
+    double erosion = 0.0;
+    double biomeVariation = 0.0;
+    double surface = 0.0;         // Materials and display heights
+    double mesh = 0.0;            // LOD grids and ray-cast pyramid
+    // Restored from the generator's stage snapshots instead of rerun; the
+    // base is diamond-square plus the first smoothing pass
+    bool baseReused = false;
+    bool erosionReused = false;
+};
+
+class ChunkGenerator {
+private:
+    // Bump whenever a change alters generated heights, so chunk cache
+    // tiles written by older code stop matching
+    static const uint32_t GENERATOR_VERSION = 2;
+    static constexpr float DISPLAY_SCALE = 90.0f;  // Display height of normalized height 1
+    static constexpr int MIN_BAND_CELLS = 16384;  // Smallest slice of a diamond-square pass sent to the pool
+
+    int chunkSize;
+    float roughness;
+    unsigned int baseSeed;  // World seed shared by all chunks
+    int chunkX;
+    int chunkY;
+
+    Heightfield heightMap;
+    MaterialLayer materialMap;
+    GradientNoise variationNoise;  // Seeded from baseSeed
+    ScratchArena* arena;  // Set for the duration of generateChunk
+    std::unique_ptr<ScratchArena> ownArena;  // For callers that don't pass one
+
+    ErosionMode erosionMode;
+    ErosionSettings erosionSettings;
+    BiomeSettings biomeSettings;
+    HydraulicErosionSettings hydraulicSettings;
+    HydraulicErosionStats hydraulicStats;  // From the last hydraulic run
+    ThreadPool* workerPool;  // For passes split into tiles; null runs them inline
+    bool fuseStages;
+    bool meshBuilding;
+    ChunkTimings timings;
+    Profiler* profiler;
+
+    struct StageSnapshot {
+        Heightfield heights;
+        uint64_t key = 0;  // Of everything the heights were computed from; 0 for none
+        bool stored = false;  // Already in the snapshot cache
+    };
+
+    // Heights after the base stages and after erosion for the last chunk. A
+    // parameter change only reruns the stages after the newest snapshot
+    // whose key still matches. snapshotCache, when set, keeps them on disk
+    // too, for chunks that were loaded from a chunk cache rather than
+    // generated and so have none in memory. It is only used while retuning,
+    // i.e. regenerating the chunk the generator already holds, so streaming
+    // in new chunks writes nothing extra.
+    bool stageSnapshots;
+    StageSnapshot baseSnapshot;
+    StageSnapshot erodedSnapshot;
+    ChunkCache* snapshotCache;
+    bool retuning;
+
+    Heightfield displayMap;  // Heights in world units, as drawn
+    ChunkLod lod;
+    HeightPyramid pyramid;  // Over displayMap, for ray casts
+    float maxHeight;  // Highest normalized height times 90, cached for cloud placement
+    unsigned int revision;
+
+    /*
+    Border values are shared with the neighboring chunks, so they must not
+    depend on anything but the world seed and world position. Corners are
+    hashed from their world lattice point; each edge runs a 1D midpoint
+    displacement between its two corners, hashed from the edge's world
+    position and the level. Both chunks touching an edge compute the same values,
+    whatever order or thread they are generated on.
+    */
+    static float cornerHeight(unsigned int worldSeed, int cornerX, int cornerY) {
+        uint32_t h = hashCoords(hashCombine(worldSeed, 0x636f726eu), cornerX, cornerY);
+        return 0.25f + (hashToUnitFloat(h) - 0.5f) * 0.3f;
+    }
+
+    // axis 0: edge runs along x at world row cornerY; axis 1: along y at column cornerX
+    void generateEdge(int cornerX, int cornerY, int axis, float* edge) {
+        int width = chunkSize + 1;
+        uint32_t edgeSeed = hashCombine(hashCoords(baseSeed, cornerX, cornerY), 0x65646730u + axis);
+
+        edge[0] = cornerHeight(baseSeed, cornerX, cornerY);
+        edge[width - 1] = axis == 0 ? cornerHeight(baseSeed, cornerX + 1, cornerY)
+                                    : cornerHeight(baseSeed, cornerX, cornerY + 1);
+
+        float h = roughness * 1.2f;
+        for (int size = width - 1; size > 1; size /= 2) {
+            uint32_t levelSeed = hashCombine(edgeSeed, size);
+            for (int i = 0; i < width - 1; i += size) {
+                float avg = (edge[i] + edge[i + size]) / 2.0f;
+                float unit = hashToSignedUnitFloat(hashCombine(levelSeed, i + size / 2));
+                float variation = unit * h * (1.3f + std::abs(avg - 0.5f) * 1.5f);
+                edge[i + size / 2] = std::min(1.0f, std::max(0.0f, avg + variation));
+            }
+            h *= 0.55f;
+        }
+    }
+
+    void seedBorders() {
+        int width = chunkSize + 1;
+        std::vector<float>& edge = arena->edge;
+        edge.resize(width);
+
+        generateEdge(chunkX, chunkY, 0, edge.data());
+        for (int x = 0; x < width; ++x) heightMap(x, 0) = edge[x];
+        generateEdge(chunkX, chunkY + 1, 0, edge.data());
+        for (int x = 0; x < width; ++x) heightMap(x, width - 1) = edge[x];
+        generateEdge(chunkX, chunkY, 1, edge.data());
+        for (int y = 0; y < width; ++y) heightMap(0, y) = edge[y];
+        generateEdge(chunkX + 1, chunkY, 1, edge.data());
+        for (int y = 0; y < width; ++y) heightMap(width - 1, y) = edge[y];
+    }
+
+    static uint32_t floatBits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Seed for one step of one level; displacements hash it with the cell
+    static uint32_t stepSeed(uint32_t chunkSeed, int size, int step) {
+        return hashCombine(chunkSeed, static_cast<uint32_t>(size * 4 + step));
+    }
+
+    // body(first, last) over [0, count) in bands of at least MIN_BAND_CELLS,
+    // on the pool when there is more than one. Bands depend only on count.
+    template <typename Body>
+    void forRowBands(int count, int cellsPerRow, const Body& body) {
+        int rowsPerBand = std::max(1, MIN_BAND_CELLS / std::max(1, cellsPerRow));
+        int bands = (count + rowsPerBand - 1) / rowsPerBand;
+        auto runBand = [&](int band) { body(band * rowsPerBand, std::min(count, (band + 1) * rowsPerBand)); };
+        if (workerPool && bands > 1) workerPool->parallelFor(bands, runBand);
+        else for (int band = 0; band < bands; ++band) runBand(band);
+    }
+
+    /*
+    Every displacement is hashed from (chunk seed, level, step, cell), so no
+    value depends on the order cells are visited in. Within a level each step
+    reads only points finished by earlier steps, which lets the steps run as
+    row bands on the pool with the same result for any thread count.
+
+    The last level (size 1) has no midpoints; it perturbs every interior
+    point three times. Those passes read the previous pass's values through
+    a second buffer rather than updating in place, and run as whole rows
+    through the SIMD kernel.
+    */
+    void diamondSquareAlgorithm(unsigned int chunkSeed) {
+        int width = chunkSize + 1;
+        int cells = width - 1;
+        heightMap.resize(width, width, 0.0f);
+
+        // Corners and edges are fixed up front; the steps below only ever
+        // write interior points.
+        seedBorders();
+
+        float h = roughness * 1.2f;
+        for (int size = cells; size > 1; size /= 2) {
+            int half = size / 2;
+            int perSide = cells / size;
+
+            // Diamond step: the center of each square
+            uint32_t diamondSeed = stepSeed(chunkSeed, size, 0);
+            forRowBands(perSide, perSide, [&](int first, int last) {
+                for (int i = first; i < last; ++i) {
+                    int x = i * size;
+                    const float* top = heightMap.row(x);
+                    const float* bottom = heightMap.row(x + size);
+                    float* center = heightMap.row(x + half);
+                    uint32_t rowSeed = hashCombine(diamondSeed, x + half);
+                    for (int y = 0; y < cells; y += size) {
+                        center[y + half] = displacedAverage(top[y], bottom[y], top[y + size], bottom[y + size],
+                            rowSeed, y + half, h);
+                    }
+                }
+            });
+
+            // Square step: edge midpoints between two corners and two centers.
+            // Rows at multiples of size take the midpoints running along y,
+            // the rows between them the ones along x.
+            uint32_t alongYSeed = stepSeed(chunkSeed, size, 1);
+            uint32_t alongXSeed = stepSeed(chunkSeed, size, 2);
+            forRowBands(2 * perSide, perSide, [&](int first, int last) {
+                for (int i = first; i < last; ++i) {
+                    int x = i * half;
+                    if (x == 0) continue;
+                    float* row = heightMap.row(x);
+                    if (i % 2 == 0) {
+                        const float* left = heightMap.row(x - half);
+                        const float* right = heightMap.row(x + half);
+                        uint32_t rowSeed = hashCombine(alongYSeed, x);
+                        for (int y = 0; y < cells; y += size) {
+                            row[y + half] = displacedAverage(row[y], row[y + size], right[y + half], left[y + half],
+                                rowSeed, y + half, h);
+                        }
+                    }
+                    else {
+                        const float* top = heightMap.row(x - half);
+                        const float* bottom = heightMap.row(x + half);
+                        uint32_t rowSeed = hashCombine(alongXSeed, x);
+                        for (int y = size; y < cells; y += size) {
+                            row[y] = displacedAverage(top[y], bottom[y], row[y + half], row[y - half],
+                                rowSeed, y, h);
+                        }
+                    }
+                }
+            });
+
+            h *= 0.55f;
+        }
+
+        // Last level. First every interior point averages the cell below and
+        // to the right into the second buffer, which also takes the borders.
+        Heightfield& previous = arena->heights;
+        previous.resize(width, width);
+        uint32_t diamondSeed = stepSeed(chunkSeed, 1, 0);
+        forRowBands(width, width, [&](int first, int last) {
+            for (int x = first; x < last; ++x) {
+                const float* row = heightMap.row(x);
+                float* out = previous.row(x);
+                if (x == 0 || x == cells) {
+                    std::memcpy(out, row, width * sizeof(float));
+                    continue;
+                }
+                const float* next = heightMap.row(x + 1);
+                out[0] = row[0];
+                out[cells] = row[cells];
+                displacedAverageRow(row + 1, next + 1, row + 2, next + 2, out + 1, cells - 1,
+                    hashCombine(diamondSeed, x), 1, h);
+            }
+        });
+
+        // Then two square passes per point, against its neighbours along y
+        // and then along x, written back over the interior
+        uint32_t alongYSeed = stepSeed(chunkSeed, 1, 1);
+        uint32_t alongXSeed = stepSeed(chunkSeed, 1, 2);
+        forRowBands(cells - 1, width, [&](int first, int last) {
+            for (int x = first + 1; x < last + 1; ++x) {
+                const float* row = previous.row(x);
+                float* out = heightMap.row(x) + 1;
+                displacedAverageRow(row + 1, row + 2, row + 1, previous.row(x - 1) + 1, out, cells - 1,
+                    hashCombine(alongYSeed, x), 1, h);
+                displacedAverageRow(out, previous.row(x + 1) + 1, out, row, out, cells - 1,
+                    hashCombine(alongXSeed, x), 1, h);
+            }
+        });
+    }
+
+    void smoothPeaks() {
+        runStaged(heightMap, arena->heights, arena->stageRows, RowChain<>(), SmoothPeaksStage(), RowChain<>());
+    }
+
+    void addErosionSimulation() {
+        arena->thermalErosion.run(heightMap, arena->heights, erosionSettings, workerPool);
+    }
+
+    void addHydraulicErosion() {
+        uint32_t seed = hashCombine(hashCoords(baseSeed, chunkX, chunkY), 0x64726f70u);
+        hydraulicStats = arena->hydraulicErosion.run(heightMap, seed, hydraulicSettings, workerPool);
+    }
+
+    // Final material colors. The old per-vertex "local variation" depended
+    // only on the base color, so it is folded into the table once.
+    static MaterialPalette buildPalette() {
+        static const float baseColors[MATERIAL_COUNT][3] = {
+            { 0.0f, 0.1f, 0.4f },    // Deep water
+            { 0.1f, 0.3f, 0.5f },    // Shallow water
+            { 0.85f, 0.8f, 0.6f },   // Sand
+            { 0.2f, 0.5f, 0.2f },    // Grass
+            { 0.4f, 0.6f, 0.3f },    // Meadow
+            { 0.5f, 0.5f, 0.5f },    // Rock
+            { 0.6f, 0.6f, 0.6f },    // High rock
+            { 0.9f, 0.9f, 1.0f },    // Snow
+        };
+
+        GradientNoise paletteNoise(0x70616c65u);
+        NoiseSettings variationSettings;
+        variationSettings.octaves = 3;
+        variationSettings.frequency = 4.0f;
+
+        MaterialPalette palette;
+        for (int i = 0; i < MATERIAL_COUNT; ++i) {
+            const float* base = baseColors[i];
+            float localVariation = paletteNoise.sample(base[0], base[1], variationSettings);
+            for (int c = 0; c < 3; ++c) {
+                palette.colors[i][c] = base[c] + localVariation * 0.1f;
+                float clamped = std::min(1.0f, std::max(0.0f, palette.colors[i][c]));
+                palette.packed[i][c] = static_cast<uint8_t>(std::lround(clamped * 255.0f));
+            }
+            palette.packed[i][3] = 255;
+        }
+        return palette;
+    }
+
+    // Surface stage writing this chunk's layers, sized for heightMap
+    SurfaceStage surfaceStage() {
+        int width = heightMap.rows();
+        if (materialMap.rows() != width || materialMap.cols() != width) materialMap.resize(width, width);
+        if (!displayMap.sameShape(heightMap)) displayMap.resize(width, width);
+        arena->rowHighest.resize(width);
+        return SurfaceStage{ &materialMap, &displayMap, arena->rowHighest.data(), DISPLAY_SCALE };
+    }
+
+    // Fill snapshot from the snapshot cache, while retuning. Its key is cleared first, since
+    // a failed load can leave it half overwritten.
+    bool loadSnapshot(uint64_t key, StageSnapshot& snapshot) {
+        snapshot.key = 0;
+        if (!retuning) return false;
+        int width = chunkSize + 1;
+        Heightfield& heights = snapshot.heights;
+        if (heights.rows() != width || heights.cols() != width) heights.resize(width, width);
+        if (!snapshotCache->load({ key, baseSeed, chunkX, chunkY }, heights)) return false;
+        snapshot.key = key;
+        snapshot.stored = true;
+        return true;
+    }
+
+    // Copy the current heights into snapshot
+    void keepSnapshot(uint64_t key, StageSnapshot& snapshot) {
+        snapshot.heights = heightMap;
+        snapshot.key = key;
+        snapshot.stored = false;
+    }
+
+    // Write snapshot to the snapshot cache while retuning, if it is the one
+    // for key and isn't there yet. A snapshot kept while streaming the chunk
+    // in is written on its first retune.
+    void storeSnapshot(uint64_t key, StageSnapshot& snapshot) {
+        if (!retuning || snapshot.key != key || snapshot.stored) return;
+        snapshotCache->store({ key, baseSeed, chunkX, chunkY }, snapshot.heights, arena->cachePayload);
+        snapshot.stored = true;
+    }
+
+    void updateMaxHeight() {
+        const std::vector<float>& rowHighest = arena->rowHighest;
+        maxHeight = *std::max_element(rowHighest.begin(), rowHighest.end()) * DISPLAY_SCALE;
+    }
+
+    // Everything after erosion, as one fused pass unless fuseStages is off.
+    // Unfused, the time of each of the three passes goes to passSeconds.
+    void finishSurface(double* passSeconds) {
+        auto pre = makeRowChain(BiomeVariationStage(variationNoise, chunkX * chunkSize, chunkY * chunkSize,
+            biomeSettings));
+        SmoothPeaksStage smooth;
+        auto post = makeRowChain(surfaceStage());
+        if (fuseStages) {
+            // One band when running inline, so no rows are computed twice
+            int bandRows = workerPool ? 64 : heightMap.rows();
+            runFused(heightMap, arena->heights, arena->stageRows, bandRows, workerPool, pre, smooth, post);
+        }
+        else {
+            runStaged(heightMap, arena->heights, arena->stageRows, pre, smooth, post, passSeconds);
+        }
+        updateMaxHeight();
+    }
+
+    // LOD vertex grids and the ray-cast pyramid, from displayMap
+    void buildMesh() {
+        lod.build(displayMap.view(), materialMap.view(), getPalette().packed);
+        pyramid.build(displayMap.view());
+    }
+
+public:
+    ChunkGenerator(int size = 128, float rough = 0.82f)
+        : chunkSize(size), roughness(rough), baseSeed(12345), chunkX(0), chunkY(0),
+        arena(nullptr), erosionMode(EROSION_THERMAL), workerPool(nullptr),
+        fuseStages(true), meshBuilding(true), profiler(nullptr), stageSnapshots(true),
+        snapshotCache(nullptr), retuning(false), maxHeight(0.0f), revision(0) {}
+
+    // Tiles of the erosion pass run on pool; the result is the same without one
+    void setThreadPool(ThreadPool* pool) { workerPool = pool; }
+    void setRoughness(float value) { roughness = value; }
+    void setErosionSettings(const ErosionSettings& settings) { erosionSettings = settings; }
+    void setHydraulicErosionSettings(const HydraulicErosionSettings& settings) { hydraulicSettings = settings; }
+    void setBiomeSettings(const BiomeSettings& settings) { biomeSettings = settings; }
+    // Takes effect on the next generateChunk
+    void setErosionMode(ErosionMode mode) { erosionMode = mode; }
+    const HydraulicErosionStats& getHydraulicStats() const { return hydraulicStats; }
+    // Off runs the post-erosion stages as separate full passes, the
+    // reference the fused pass has to match
+    void setStageFusion(bool enabled) { fuseStages = enabled; }
+    // Off skips the LOD grids and ray-cast pyramid, for callers that only
+    // want the height and material layers
+    void setMeshBuilding(bool enabled) { meshBuilding = enabled; }
+    // Each step of generateChunk and loadChunk is recorded on profiler
+    void setProfiler(Profiler* target) { profiler = target; }
+    // Off drops the stage snapshots, for callers that never regenerate a
+    // chunk with changed parameters
+    void setStageSnapshots(bool enabled) {
+        stageSnapshots = enabled;
+        if (!enabled) {
+            baseSnapshot = StageSnapshot();
+            erodedSnapshot = StageSnapshot();
+        }
+    }
+    // When a chunk is regenerated in place, as after a parameter change,
+    // its stage snapshots are looked up in cache if the ones in memory don't
+    // match, and the stages it reruns are stored there. A chunk loaded from
+    // the chunk cache on a later run then reruns only what a change affects.
+    // Use a cache of its own, not the one for finished chunks, so its hits
+    // and cap stay separate.
+    void setSnapshotCache(ChunkCache* cache) { snapshotCache = cache; }
+
+    // Generate the chunk at world chunk coordinates (x, y). The result depends
+    // only on (worldSeed, x, y), and borders match the neighboring chunks.
+    // Scratch memory comes from scratch, which nothing else may use meanwhile.
+    void generateChunk(unsigned int worldSeed, int x, int y, ScratchArena& scratch) {
+        retuning = snapshotCache && revision > 0 && worldSeed == baseSeed && x == chunkX && y == chunkY;
+        arena = &scratch;
+        baseSeed = worldSeed;
+        uint32_t noiseSeed = variationSeed(worldSeed);
+        if (variationNoise.seed() != noiseSeed) variationNoise.reseed(noiseSeed);
+        chunkX = x;
+        chunkY = y;
+
+        typedef Profiler::Clock Clock;
+        Clock::time_point start = Clock::now();
+        auto lap = [this, &start](const char* name, double& seconds) {
+            Clock::time_point now = Clock::now();
+            seconds = std::chrono::duration<double>(now - start).count();
+            if (profiler) profiler->record(name, "generation", start, now);
+            start = now;
+        };
+
+        timings = ChunkTimings();
+        uint64_t baseKey = hashCombine64(hashCombine64(hashCombine64(baseParametersHash(), worldSeed),
+            static_cast<uint32_t>(x)), static_cast<uint32_t>(y));
+        uint64_t erodedKey = hashCombine64(baseKey, erosionParametersHash());
+
+        // Stages are skipped back to the newest snapshot that still matches,
+        // from memory or else from the snapshot cache
+        timings.erosionReused = stageSnapshots && (erodedKey == erodedSnapshot.key ||
+            loadSnapshot(erodedKey, erodedSnapshot));
+        timings.baseReused = timings.erosionReused || (stageSnapshots && (baseKey == baseSnapshot.key ||
+            loadSnapshot(baseKey, baseSnapshot)));
+        if (timings.erosionReused) {
+            heightMap = erodedSnapshot.heights;
+            hydraulicStats = HydraulicErosionStats();
+        }
+        else {
+            if (timings.baseReused) {
+                heightMap = baseSnapshot.heights;
+            }
+            else {
+                diamondSquareAlgorithm(hashCoords(worldSeed, x, y));
+                lap("diamondSquare", timings.diamondSquare);
+                smoothPeaks();
+                lap("smoothPeaks", timings.smoothPeaks);
+                if (stageSnapshots) keepSnapshot(baseKey, baseSnapshot);
+            }
+            if (erosionMode == EROSION_HYDRAULIC) addHydraulicErosion();
+            else addErosionSimulation();
+            lap("erosion", timings.erosion);
+            if (stageSnapshots) keepSnapshot(erodedKey, erodedSnapshot);
+        }
+        storeSnapshot(baseKey, baseSnapshot);
+        storeSnapshot(erodedKey, erodedSnapshot);
+        double surfacePasses[3] = { 0.0, 0.0, 0.0 };
+        finishSurface(surfacePasses);
+        lap("surface", timings.surface);
+        timings.biomeVariation = surfacePasses[0];
+        timings.smoothPeaks += surfacePasses[1];
+        timings.surface -= surfacePasses[0] + surfacePasses[1];
+        if (meshBuilding) buildMesh();
+        lap("mesh", timings.mesh);
+        ++revision;
+        arena = nullptr;
+    }
+
+    // Same, with an arena owned by this generator
+    void generateChunk(unsigned int worldSeed, int x, int y) {
+        if (!ownArena) ownArena.reset(new ScratchArena());
+        generateChunk(worldSeed, x, y, *ownArena);
+    }
+
+    // Only the diamond-square step of generateChunk, into getHeights(), for
+    // callers that run the later stages themselves (MapBaker)
+    void generateBaseHeights(unsigned int worldSeed, int x, int y, ScratchArena& scratch) {
+        arena = &scratch;
+        baseSeed = worldSeed;
+        chunkX = x;
+        chunkY = y;
+        diamondSquareAlgorithm(hashCoords(worldSeed, x, y));
+        arena = nullptr;
+    }
+
+    // Seed of the biome variation noise for a world
+    static uint32_t variationSeed(unsigned int worldSeed) {
+        return hashCombine(worldSeed, 0x62696f6du);
+    }
+
+    // Hashes of the settings that shape each group of stages
+    uint64_t baseParametersHash() const {
+        uint64_t h = hashMix64(GENERATOR_VERSION);
+        h = hashCombine64(h, static_cast<uint32_t>(chunkSize));
+        return hashCombine64(h, floatBits(roughness));
+    }
+
+    uint64_t erosionParametersHash() const {
+        uint64_t h = hashMix64(erosionMode);
+        auto add = [&h](uint64_t value) { h = hashCombine64(h, value); };
+        auto addFloat = [&add](float value) { add(floatBits(value)); };
+        if (erosionMode == EROSION_HYDRAULIC) {
+            const HydraulicErosionSettings& s = hydraulicSettings;
+            add(static_cast<uint32_t>(s.droplets));
+            add(static_cast<uint32_t>(s.batchSize));
+            add(static_cast<uint32_t>(s.batchesPerRound));
+            add(static_cast<uint32_t>(s.maxLifetime));
+            add(static_cast<uint32_t>(s.brushRadius));
+            for (float value : { s.inertia, s.capacityFactor, s.minCapacity, s.erodeRate, s.depositRate,
+                    s.evaporateRate, s.gravity }) {
+                addFloat(value);
+            }
+        }
+        else {
+            // tileSize only splits the work, so it is left out
+            add(static_cast<uint32_t>(erosionSettings.iterations));
+            addFloat(erosionSettings.sedimentRate);
+            addFloat(erosionSettings.minMovement);
+        }
+        return h;
+    }
+
+    uint64_t surfaceParametersHash() const {
+        uint64_t h = hashMix64(static_cast<uint32_t>(biomeSettings.terrainOctaves));
+        h = hashCombine64(h, static_cast<uint32_t>(biomeSettings.biomeOctaves));
+        h = hashCombine64(h, floatBits(biomeSettings.terrainWeight));
+        return hashCombine64(h, floatBits(biomeSettings.biomeWeight));
+    }
+
+    // Hash of every setting that shapes the heights, for cache keys
+    uint64_t parametersHash() const {
+        return hashCombine64(hashCombine64(baseParametersHash(), erosionParametersHash()), surfaceParametersHash());
+    }
+
+    ChunkCacheKey cacheKey(unsigned int worldSeed, int x, int y) const {
+        return { parametersHash(), worldSeed, x, y };
+    }
+
+    // Restore the chunk at (x, y) from cache instead of generating it: only
+    // the surface layers and meshes are rebuilt. False on a miss.
+    bool loadChunk(ChunkCache& cache, unsigned int worldSeed, int x, int y, ScratchArena& scratch) {
+        ProfileScope scope(profiler, "loadChunk", nullptr, "generation");
+        int width = chunkSize + 1;
+        if (heightMap.rows() != width || heightMap.cols() != width) heightMap.resize(width, width);
+        if (!cache.load(cacheKey(worldSeed, x, y), heightMap)) return false;
+
+        arena = &scratch;
+        baseSeed = worldSeed;
+        chunkX = x;
+        chunkY = y;
+        SurfaceStage surface = surfaceStage();
+        for (int row = 0; row < width; ++row) surface(row, heightMap.row(row), width, nullptr);
+        updateMaxHeight();
+        if (meshBuilding) buildMesh();
+        ++revision;
+        arena = nullptr;
+        return true;
+    }
+
+    // Save the last generated chunk, encoding it in scratch
+    void storeChunk(ChunkCache& cache, ScratchArena& scratch) const {
+        cache.store(cacheKey(baseSeed, chunkX, chunkY), heightMap, scratch.cachePayload);
+    }
+
+    static const MaterialPalette& getPalette() {
+        static const MaterialPalette palette = buildPalette();
+        return palette;
+    }
+
+    // Material of grid point (x, y); both must be in [0, chunkSize]
+    TerrainMaterial getMaterial(int x, int y) const {
+        return static_cast<TerrainMaterial>(materialMap(x, y));
+    }
+
+    // Final normalized heights and material classes, (chunkSize + 1)^2
+    const Heightfield& getHeights() const { return heightMap; }
+    const MaterialLayer& getMaterials() const { return materialMap; }
+    const ChunkTimings& getTimings() const { return timings; }
+    // Heights in world units, as drawn
+    const Heightfield& getDisplayHeights() const { return displayMap; }
+
+    const ChunkLod& getLod() const { return lod; }
+    // Chunk-local ray casts against the drawn surface
+    const HeightPyramid& getPyramid() const { return pyramid; }
+    // Changes every time the chunk is regenerated
+    unsigned int getRevision() const { return revision; }
+
+    float getMaxHeight() const { return maxHeight; }
+};
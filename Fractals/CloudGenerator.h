@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Heightfield.h"
+#include "Noise.h"
+
+// Cloud density over a resolution x resolution grid, in [0, 1]. Rendering
+// lives with the viewer; generation may run on a worker thread, so each
+// regeneration bumps a revision the renderer can compare against.
+class CloudGenerator {
+private:
+    Heightfield cloudDensityMap;
+    int resolution;
+    GradientNoise cloudNoise;
+    NoiseSettings cloudSettings;
+    unsigned int revision;
+
+public:
+    CloudGenerator(int res = 256, unsigned int seed = 12345)
+        : resolution(res), cloudNoise(seed), revision(0) {
+        // Domain-warped fBm: the warp drags the blobs out into wisps
+        cloudSettings.octaves = 4;
+        cloudSettings.frequency = 1.0f / 128.0f;
+        cloudSettings.warp = 24.0f;
+        cloudDensityMap.resize(resolution, resolution, 0.0f);
+        generateClouds();
+    }
+
+    CloudGenerator(const CloudGenerator&) = delete;
+    CloudGenerator& operator=(const CloudGenerator&) = delete;
+
+    // Cheap enough to call at runtime: one batched noise fill, a few
+    // milliseconds with SIMD
+    void regenerateClouds(unsigned int newSeed) {
+        cloudNoise.reseed(newSeed);
+        generateClouds();
+    }
+
+    void generateClouds() {
+        cloudNoise.sampleTile(0.0f, 0.0f, resolution, resolution, cloudSettings,
+            cloudDensityMap.data(), cloudDensityMap.stride());
+        // Offset and scale put about a quarter of the sky above a density of 0.5
+        for (int x = 0; x < resolution; ++x) {
+            float* row = cloudDensityMap.row(x);
+            for (int y = 0; y < resolution; ++y) {
+                row[y] = std::max(0.0f, std::min(1.0f, 0.3f + row[y] * 1.5f));
+            }
+        }
+        ++revision;
+    }
+
+    int getResolution() const { return resolution; }
+    const Heightfield& getDensity() const { return cloudDensityMap; }
+    // Changes every time the density is regenerated
+    unsigned int getRevision() const { return revision; }
+};
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Hash.h"
+#include "Heightfield.h"
+#include "ThreadPool.h"
+
+enum ErosionMode {
+    EROSION_THERMAL,
+    EROSION_HYDRAULIC
+};
+
+struct ErosionSettings {
+    int iterations = 10;
+    float sedimentRate = 0.1f;  // Fraction of the steepest drop moved per iteration
+    // Stop once an iteration moves less than this much sediment per interior
+    // cell on average. Default terrain moves about 2e-3, so this only ends
+    // long runs that have settled.
+    float minMovement = 1e-4f;
+    int tileSize = 64;
+};
+
+/*
+Thermal erosion: every interior cell sheds sedimentRate times its steepest
+drop to that lowest neighbor, all cells at once from the previous
+iteration's heights. Border cells are shared with the neighboring chunks,
+so they neither shed nor receive sediment.
+
+Each iteration reads one buffer and writes the other. Instead of scattering
+sediment into neighbors, a cell gathers what its neighbors send it, so
+tiles can be written by different threads without sharing cells. A tile
+first works out the flow of its cells plus a one-cell halo, then sums each
+cell's terms in the same order a sequential scatter would apply them. The
+result is the same bits for any thread count or tile size.
+*/
+class ThermalErosion {
+private:
+    // Flow of one cell: which of its 3x3 neighbors (dx * 3 + dy + 4) gets
+    // how much sediment, or NO_FLOW
+    static const int8_t NO_FLOW = -1;
+
+    struct TileScratch {
+        std::vector<int8_t> targets;
+        std::vector<float> amounts;
+    };
+
+    std::vector<TileScratch> tileScratch;
+    std::vector<double> tileMovement;
+
+    static bool interior(int x, int y, int rows, int cols) {
+        return x > 0 && y > 0 && x < rows - 1 && y < cols - 1;
+    }
+
+    // Neighbors are scanned in order and the first steepest one wins. Cells
+    // next to the border have to skip border neighbors; the rest don't.
+    template <bool nearBorder>
+    static void computeFlow(ConstHeightfieldView heights, int x, int y, float rate,
+        int8_t& target, float& amount) {
+        int rows = heights.rows();
+        int cols = heights.cols();
+        float currentHeight = heights(x, y);
+        float maxDrop = 0.0f;
+        int8_t best = NO_FLOW;
+        for (int dx = -1; dx <= 1; ++dx) {
+            const float* neighborRow = heights.row(x + dx) + y;
+            for (int dy = -1; dy <= 1; ++dy) {
+                if (nearBorder && !interior(x + dx, y + dy, rows, cols)) continue;
+                float drop = currentHeight - neighborRow[dy];
+                if (drop > maxDrop) {
+                    maxDrop = drop;
+                    best = static_cast<int8_t>((dx + 1) * 3 + (dy + 1));
+                }
+            }
+        }
+        target = best;
+        amount = maxDrop * rate;
+    }
+
+    // Returns the sediment moved out of the tile's own cells
+    double erodeTile(ConstHeightfieldView source, HeightfieldView destination, const ErosionSettings& settings,
+        int x0, int y0, int x1, int y1, TileScratch& scratch) {
+        int rows = source.rows();
+        int cols = source.cols();
+        // Flows for the tile plus a one-cell halo. Cells outside the interior
+        // are stored with no flow, so the gather below needs no bounds checks.
+        int haloRows = x1 - x0 + 2;
+        int haloSide = y1 - y0 + 2;
+        size_t haloCells = static_cast<size_t>(haloRows) * haloSide;
+        scratch.targets.resize(haloCells);
+        scratch.amounts.resize(haloCells);
+
+        for (int i = 0; i < haloRows; ++i) {
+            int x = x0 - 1 + i;
+            int8_t* targets = scratch.targets.data() + static_cast<size_t>(i) * haloSide;
+            float* amounts = scratch.amounts.data() + static_cast<size_t>(i) * haloSide;
+            for (int j = 0; j < haloSide; ++j) {
+                int y = y0 - 1 + j;
+                if (x > 1 && y > 1 && x < rows - 2 && y < cols - 2) {
+                    computeFlow<false>(source, x, y, settings.sedimentRate, targets[j], amounts[j]);
+                }
+                else if (interior(x, y, rows, cols)) {
+                    computeFlow<true>(source, x, y, settings.sedimentRate, targets[j], amounts[j]);
+                }
+                else {
+                    targets[j] = NO_FLOW;
+                    amounts[j] = 0.0f;
+                }
+            }
+        }
+
+        // A neighbor at (dx, dy) sends to this cell when its target is
+        // (-dx, -dy), i.e. code 8 - (dx * 3 + dy + 4). Terms are added in
+        // scan order, the order a sequential scatter pass applies them;
+        // adding 0 for the other neighbors leaves the sum unchanged.
+        double moved = 0.0;
+        for (int x = x0; x < x1; ++x) {
+            const float* in = source.row(x);
+            float* out = destination.row(x);
+            size_t rowOffset = static_cast<size_t>(x - x0 + 1) * haloSide;
+            const int8_t* t0 = scratch.targets.data() + rowOffset - haloSide;
+            const int8_t* t1 = scratch.targets.data() + rowOffset;
+            const int8_t* t2 = scratch.targets.data() + rowOffset + haloSide;
+            const float* a0 = scratch.amounts.data() + rowOffset - haloSide;
+            const float* a1 = scratch.amounts.data() + rowOffset;
+            const float* a2 = scratch.amounts.data() + rowOffset + haloSide;
+            for (int j = 1; j <= y1 - y0; ++j) {
+                float value = in[y0 + j - 1];
+                value += t0[j - 1] == 8 ? a0[j - 1] : 0.0f;
+                value += t0[j] == 7 ? a0[j] : 0.0f;
+                value += t0[j + 1] == 6 ? a0[j + 1] : 0.0f;
+                value += t1[j - 1] == 5 ? a1[j - 1] : 0.0f;
+                value -= a1[j];
+                value += t1[j + 1] == 3 ? a1[j + 1] : 0.0f;
+                value += t2[j - 1] == 2 ? a2[j - 1] : 0.0f;
+                value += t2[j] == 1 ? a2[j] : 0.0f;
+                value += t2[j + 1] == 0 ? a2[j + 1] : 0.0f;
+                out[y0 + j - 1] = value;
+                moved += a1[j];
+            }
+        }
+        return moved;
+    }
+
+public:
+    // Erodes heights in place, using scratch as the second buffer (its
+    // contents are replaced). Tiles run on pool when one is given. Returns
+    // the number of iterations run. The grid need not be square.
+    int run(Heightfield& heights, Heightfield& scratch, const ErosionSettings& settings, ThreadPool* pool) {
+        int rows = heights.rows();
+        int cols = heights.cols();
+        if (rows < 3 || cols < 3) return 0;
+
+        // Border cells never change, so both buffers keep the same border
+        scratch = heights;
+
+        int tileSize = std::max(1, settings.tileSize);
+        int tileRows = (rows - 2 + tileSize - 1) / tileSize;
+        int tileCols = (cols - 2 + tileSize - 1) / tileSize;
+        int tileCount = tileRows * tileCols;
+        tileScratch.resize(tileCount);
+        tileMovement.assign(tileCount, 0.0);
+
+        int iteration = 0;
+        while (iteration < settings.iterations) {
+            ConstHeightfieldView source = heights.view();
+            HeightfieldView destination = scratch.view();
+            auto erodeTileAt = [&](int tile) {
+                int x0 = 1 + (tile / tileCols) * tileSize;
+                int y0 = 1 + (tile % tileCols) * tileSize;
+                int x1 = std::min(x0 + tileSize, rows - 1);
+                int y1 = std::min(y0 + tileSize, cols - 1);
+                tileMovement[tile] = erodeTile(source, destination, settings, x0, y0, x1, y1, tileScratch[tile]);
+            };
+            if (pool) pool->parallelFor(tileCount, erodeTileAt);
+            else for (int tile = 0; tile < tileCount; ++tile) erodeTileAt(tile);
+
+            heights.swap(scratch);
+            ++iteration;
+
+            // Summed in tile order so the exit point doesn't depend on threads
+            double moved = 0.0;
+            for (double tileMoved : tileMovement) moved += tileMoved;
+            if (moved < static_cast<double>(settings.minMovement) * (rows - 2) * (cols - 2)) break;
+        }
+        return iteration;
+    }
+};
+
+struct HydraulicErosionSettings {
+    int droplets = 200000;  // Per chunk
+    // Droplets per batch and batches per round. Both fix which droplets see
+    // each other's changes, so they change the result; the thread count doesn't.
+    // Droplets in one round can all cut into the same slope, so a round of
+    // much more than a few thousand on a 257x257 chunk over-erodes into noise.
+    int batchSize = 256;
+    int batchesPerRound = 8;
+    int maxLifetime = 48;
+    float inertia = 0.05f;         // How much a droplet keeps its direction, 0-1
+    float capacityFactor = 4.0f;   // Sediment carried per unit of speed, water and slope
+    float minCapacity = 0.01f;
+    float erodeRate = 0.3f;
+    float depositRate = 0.3f;
+    float evaporateRate = 0.02f;
+    float gravity = 4.0f;
+    int brushRadius = 3;           // Erosion is spread over a disc of this radius
+};
+
+struct HydraulicErosionStats {
+    int droplets = 0;
+    double seconds = 0.0;
+
+    double dropletsPerSecond() const { return seconds > 0.0 ? droplets / seconds : 0.0; }
+};
+
+/*
+Droplet erosion: each droplet starts on a random cell, runs downhill with
+some inertia and picks up sediment while it is below its carrying capacity
+(speed times water times slope). Once it carries too much, or runs uphill,
+it drops sediment again. Water evaporates as it goes. Border cells are
+shared with the neighboring chunks and are never changed.
+
+Droplets are simulated in batches, a round of batches at a time. Every
+batch in a round reads the heights as they were at the start of the round
+plus its own changes, which it keeps in a private delta grid, so batches
+run on different threads without sharing anything. After the round the
+deltas are added to the heights in batch order. Start positions are hashed
+from the droplet index, so the result depends on the seed and the batch
+layout but not on the thread count.
+*/
+class HydraulicErosion {
+private:
+    struct BrushCell { int dx, dy; float weight; };
+    std::vector<BrushCell> brush;
+    // One change grid per batch in a round; kept zeroed between runs
+    std::vector<Heightfield> deltas;
+
+    static bool interior(int x, int y, int width) {
+        return x > 0 && y > 0 && x < width - 1 && y < width - 1;
+    }
+
+    static float heightAt(ConstHeightfieldView base, ConstHeightfieldView delta, int x, int y) {
+        return base(x, y) + delta(x, y);
+    }
+
+    // Bilinear height and gradient at (x, y) inside cell (cellX, cellY)
+    static float sample(ConstHeightfieldView base, ConstHeightfieldView delta, float x, float y,
+        int cellX, int cellY, float& gradientX, float& gradientY) {
+        float u = x - cellX;
+        float v = y - cellY;
+        float h00 = heightAt(base, delta, cellX, cellY);
+        float h10 = heightAt(base, delta, cellX + 1, cellY);
+        float h01 = heightAt(base, delta, cellX, cellY + 1);
+        float h11 = heightAt(base, delta, cellX + 1, cellY + 1);
+        gradientX = (h10 - h00) * (1.0f - v) + (h11 - h01) * v;
+        gradientY = (h01 - h00) * (1.0f - u) + (h11 - h10) * u;
+        return h00 * (1.0f - u) * (1.0f - v) + h10 * u * (1.0f - v) + h01 * (1.0f - u) * v + h11 * u * v;
+    }
+
+    void buildBrush(int radius) {
+        brush.clear();
+        float total = 0.0f;
+        for (int dx = -radius; dx <= radius; ++dx) {
+            for (int dy = -radius; dy <= radius; ++dy) {
+                float weight = radius - std::sqrt(static_cast<float>(dx * dx + dy * dy));
+                if (weight <= 0.0f) continue;
+                brush.push_back({ dx, dy, weight });
+                total += weight;
+            }
+        }
+        for (BrushCell& cell : brush) cell.weight /= total;
+        if (brush.empty()) brush.push_back({ 0, 0, 1.0f });
+    }
+
+    void simulateDroplet(ConstHeightfieldView base, HeightfieldView delta, const HydraulicErosionSettings& settings,
+        uint32_t dropletSeed) {
+        int width = base.rows();
+        // Stay where the 2x2 cell under the droplet is fully inside the grid
+        float limit = static_cast<float>(width - 2);
+        float x = 1.0f + hashToUnitFloat(hashCombine(dropletSeed, 0u)) * (limit - 1.0f);
+        float y = 1.0f + hashToUnitFloat(hashCombine(dropletSeed, 1u)) * (limit - 1.0f);
+        float directionX = 0.0f, directionY = 0.0f;
+        float speed = 1.0f;
+        float water = 1.0f;
+        float sediment = 0.0f;
+
+        for (int step = 0; step < settings.maxLifetime; ++step) {
+            int cellX = static_cast<int>(x);
+            int cellY = static_cast<int>(y);
+            float u = x - cellX;
+            float v = y - cellY;
+
+            float gradientX, gradientY;
+            float height = sample(base, delta, x, y, cellX, cellY, gradientX, gradientY);
+
+            directionX = directionX * settings.inertia - gradientX * (1.0f - settings.inertia);
+            directionY = directionY * settings.inertia - gradientY * (1.0f - settings.inertia);
+            float length = std::sqrt(directionX * directionX + directionY * directionY);
+            if (length == 0.0f) break;
+            directionX /= length;
+            directionY /= length;
+            x += directionX;
+            y += directionY;
+            if (x < 1.0f || y < 1.0f || x >= limit || y >= limit) break;
+
+            float unusedX, unusedY;
+            float newHeight = sample(base, delta, x, y, static_cast<int>(x), static_cast<int>(y), unusedX, unusedY);
+            float heightChange = newHeight - height;
+            float capacity = std::max(-heightChange * speed * water * settings.capacityFactor, settings.minCapacity);
+
+            if (sediment > capacity || heightChange > 0.0f) {
+                // Uphill: fill the pit behind, at most up to the new height
+                float deposit = heightChange > 0.0f ? std::min(heightChange, sediment)
+                                                    : (sediment - capacity) * settings.depositRate;
+                float weights[4] = { (1.0f - u) * (1.0f - v), u * (1.0f - v), (1.0f - u) * v, u * v };
+                int cornersX[4] = { cellX, cellX + 1, cellX, cellX + 1 };
+                int cornersY[4] = { cellY, cellY, cellY + 1, cellY + 1 };
+                for (int i = 0; i < 4; ++i) {
+                    if (!interior(cornersX[i], cornersY[i], width)) continue;
+                    float amount = deposit * weights[i];
+                    delta(cornersX[i], cornersY[i]) += amount;
+                    sediment -= amount;
+                }
+            }
+            else {
+                float erode = std::min((capacity - sediment) * settings.erodeRate, -heightChange);
+                for (const BrushCell& cell : brush) {
+                    int bx = cellX + cell.dx;
+                    int by = cellY + cell.dy;
+                    if (!interior(bx, by, width)) continue;
+                    // Never dig below zero
+                    float amount = std::min(erode * cell.weight, heightAt(base, delta, bx, by));
+                    delta(bx, by) -= amount;
+                    sediment += amount;
+                }
+            }
+
+            speed = std::sqrt(std::max(0.0f, speed * speed - heightChange * settings.gravity));
+            water *= 1.0f - settings.evaporateRate;
+        }
+    }
+
+public:
+    HydraulicErosionStats run(Heightfield& heights, uint32_t seed, const HydraulicErosionSettings& settings,
+        ThreadPool* pool) {
+        HydraulicErosionStats stats;
+        int width = heights.rows();
+        if (width < 4 || settings.droplets <= 0) return stats;
+        auto start = std::chrono::steady_clock::now();
+
+        buildBrush(settings.brushRadius);
+        int batchSize = std::max(1, settings.batchSize);
+        int batchCount = (settings.droplets + batchSize - 1) / batchSize;
+        int roundSize = std::max(1, std::min(settings.batchesPerRound, batchCount));
+        if (static_cast<int>(deltas.size()) < roundSize) deltas.resize(roundSize);
+        for (Heightfield& delta : deltas) {
+            if (delta.rows() != width) delta.resize(width, width);
+        }
+
+        for (int firstBatch = 0; firstBatch < batchCount; firstBatch += roundSize) {
+            int batches = std::min(roundSize, batchCount - firstBatch);
+            ConstHeightfieldView base = heights.view();
+
+            auto runBatch = [&](int i) {
+                Heightfield& delta = deltas[i];
+                int first = (firstBatch + i) * batchSize;
+                int last = std::min(first + batchSize, settings.droplets);
+                for (int droplet = first; droplet < last; ++droplet) {
+                    simulateDroplet(base, delta.view(), settings, hashCombine(seed, static_cast<uint32_t>(droplet)));
+                }
+            };
+            if (pool) pool->parallelFor(batches, runBatch);
+            else for (int i = 0; i < batches; ++i) runBatch(i);
+
+            // Merge in batch order; rows are independent
+            auto mergeRow = [&](int x) {
+                float* row = heights.row(x);
+                for (int i = 0; i < batches; ++i) {
+                    float* change = deltas[i].row(x);
+                    for (int y = 0; y < width; ++y) {
+                        row[y] += change[y];
+                        change[y] = 0.0f;
+                    }
+                }
+            };
+            if (pool) pool->parallelFor(width, mergeRow);
+            else for (int x = 0; x < width; ++x) mergeRow(x);
+        }
+
+        stats.droplets = settings.droplets;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+};
@@ -3,7 +3,30 @@
 #include <vector>
 #include <random>
 #include <iostream>
+#include <memory>
 #include <algorithm>  
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+
+#include "AllocationCounter.h"
+#include "ChunkCache.h"
+#include "ChunkGenerator.h"
+#include "CloudGenerator.h"
+#include "Hash.h"
+#include "Erosion.h"
+#include "Frustum.h"
+#include "GLExtensions.h"
+#include "Heightfield.h"
+#include "HeightPyramid.h"
+#include "Profiler.h"
+#include "TerrainLod.h"
+#include "ThreadPool.h"
 
 #define M_PI 3.14159265358979323846
 
@@ -15,6 +38,78 @@ float cameraYaw = 0.8f;
 float cameraPitch = 0.0f;  
 
 
+// Atmosphere program. The sky is a full-screen triangle whose color follows
+// the same time-of-day curve as updateAtmosphericConditions, darkening
+// towards the zenith; stars are one-pixel quads that fade and twinkle with
+// time. Sky vertices are tagged with a negative star brightness.
+const char* ATMOSPHERE_VERTEX_SHADER = R"GLSL(
+#version 120
+uniform float timeOfDay;
+uniform vec2 pixelSize;
+varying vec2 skyRay;
+varying float starAlpha;
+
+float starFade(float t) {
+    if (t < 1.0) return t;
+    if (t < 5.0) return 1.0;
+    if (t < 6.0) return 6.0 - t;
+    if (t < 18.0) return 0.0;
+    if (t < 19.0) return t - 18.0;
+    if (t < 23.0) return 1.0;
+    return 24.0 - t;
+}
+
+void main() {
+    vec4 star = gl_MultiTexCoord0;  // Corner offset in pixels, brightness, twinkle phase
+    if (star.z < 0.0) {
+        gl_Position = vec4(gl_Vertex.xy, 0.0, 1.0);
+        skyRay = gl_Vertex.xy / vec2(gl_ProjectionMatrix[0][0], gl_ProjectionMatrix[1][1]);
+        starAlpha = -1.0;
+        return;
+    }
+
+    vec4 position = gl_ModelViewProjectionMatrix * gl_Vertex;
+    position.xy += star.xy * pixelSize * position.w;
+    gl_Position = position;
+    skyRay = vec2(0.0);
+
+    float twinkle = sin(timeOfDay * 2.0 + star.w) * 0.2 + 1.0;
+    starAlpha = star.z * starFade(timeOfDay) * twinkle * 0.8;
+}
+)GLSL";
+
+const char* ATMOSPHERE_FRAGMENT_SHADER = R"GLSL(
+#version 120
+uniform float timeOfDay;
+uniform float cameraPitch;
+varying vec2 skyRay;
+varying float starAlpha;
+
+vec3 skyColor(float t) {
+    vec3 night = vec3(0.1, 0.1, 0.2);
+    vec3 day = vec3(0.6, 0.7, 0.8);
+    if (t < 6.0) return night;
+    if (t < 8.0) return day + vec3(0.4, 0.3, -0.3) * ((t - 6.0) / 2.0);
+    if (t < 16.0) return day;
+    if (t < 18.0) return day - vec3(0.5, 0.6, 0.6) * ((t - 16.0) / 2.0);
+    return night;
+}
+
+void main() {
+    if (starAlpha >= 0.0) {
+        if (starAlpha <= 0.0) discard;
+        gl_FragColor = vec4(1.0, 1.0, 1.0, starAlpha);
+        return;
+    }
+
+    // World-space elevation of the view ray through this pixel
+    float up = skyRay.y * cos(cameraPitch) + sin(cameraPitch);
+    float elevation = clamp(up / length(vec3(skyRay, 1.0)), 0.0, 1.0);
+    vec3 horizon = skyColor(timeOfDay);
+    gl_FragColor = vec4(mix(horizon, horizon * vec3(0.7, 0.8, 1.0), elevation), 1.0);
+}
+)GLSL";
+
 class AtmosphericRenderer {
 private:
     float timeOfDay;  
@@ -32,6 +127,95 @@ private:
     std::vector<Star> stars;
     const int NUM_STARS = 500;  // Adjust for desired star density
 
+    // Static GPU copy of the sky triangle and star quads, drawn in one call
+    struct AtmosphereVertex {
+        float position[3];
+        float star[4];  // Corner offset in pixels, brightness (negative for sky), twinkle phase
+    };
+    bool gpuInitialized;
+    GLuint atmosphereProgram;
+    GLuint atmosphereBuffer;
+    GLsizei atmosphereVertexCount;
+    GLint timeOfDayUniform;
+    GLint cameraPitchUniform;
+    GLint pixelSizeUniform;
+
+    void initializeGpu() {
+        gpuInitialized = true;
+        if (!glExt.hasBufferObjects) return;
+        atmosphereProgram = buildShaderProgram(ATMOSPHERE_VERTEX_SHADER, ATMOSPHERE_FRAGMENT_SHADER, "atmosphere");
+        if (!atmosphereProgram) {
+            std::cerr << "Atmosphere shader unavailable, drawing sky and stars on the CPU" << std::endl;
+            return;
+        }
+        timeOfDayUniform = glExt.getUniformLocation(atmosphereProgram, "timeOfDay");
+        cameraPitchUniform = glExt.getUniformLocation(atmosphereProgram, "cameraPitch");
+        pixelSizeUniform = glExt.getUniformLocation(atmosphereProgram, "pixelSize");
+
+        std::vector<AtmosphereVertex> vertices;
+        vertices.reserve(3 + stars.size() * 6);
+        vertices.push_back({ { -1.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f, 0.0f } });
+        vertices.push_back({ { 3.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f, 0.0f } });
+        vertices.push_back({ { -1.0f, 3.0f, 0.0f }, { 0.0f, 0.0f, -1.0f, 0.0f } });
+
+        static const float corners[6][2] = {
+            { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f },
+            { -0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f },
+        };
+        for (const Star& star : stars) {
+            for (const auto& corner : corners) {
+                // Slightly in front of the sky, as the point version was
+                vertices.push_back({ { star.x * 0.99f, star.y * 0.99f, star.z * 0.99f },
+                    { corner[0], corner[1], star.brightness, star.twinkleOffset } });
+            }
+        }
+
+        atmosphereVertexCount = static_cast<GLsizei>(vertices.size());
+        glExt.genBuffers(1, &atmosphereBuffer);
+        glExt.bindBuffer(GL_ARRAY_BUFFER, atmosphereBuffer);
+        glExt.bufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(AtmosphereVertex), vertices.data(), GL_STATIC_DRAW);
+        glExt.bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Sky and stars in a single draw; nothing is evaluated per star on the CPU
+    void renderAtmosphere() {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        glPushMatrix();
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_LIGHTING);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        // Same sky rotation the point stars used
+        glRotatef(cameraYaw * 180.0f / M_PI, 0, 0, 1);
+        glRotatef(cameraPitch * 180.0f / M_PI, 1, 0, 0);
+
+        glExt.useProgram(atmosphereProgram);
+        glExt.uniform1f(timeOfDayUniform, timeOfDay);
+        glExt.uniform1f(cameraPitchUniform, cameraPitch);
+        glExt.uniform2f(pixelSizeUniform, 2.0f / viewport[2], 2.0f / viewport[3]);
+
+        glExt.bindBuffer(GL_ARRAY_BUFFER, atmosphereBuffer);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(AtmosphereVertex),
+            reinterpret_cast<const void*>(offsetof(AtmosphereVertex, position)));
+        glTexCoordPointer(4, GL_FLOAT, sizeof(AtmosphereVertex),
+            reinterpret_cast<const void*>(offsetof(AtmosphereVertex, star)));
+        glDrawArrays(GL_TRIANGLES, 0, atmosphereVertexCount);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glExt.bindBuffer(GL_ARRAY_BUFFER, 0);
+        glExt.useProgram(0);
+
+        glDisable(GL_BLEND);
+        glEnable(GL_LIGHTING);
+        glEnable(GL_DEPTH_TEST);
+        glPopMatrix();
+    }
+
     void generateStars() {
         std::random_device rd;
         std::mt19937 gen(rd());
@@ -93,6 +277,7 @@ private:
         return 0.0f;
     }
 
+    // Fixed-function fallback
     void renderStars() {
         float starBrightness = calculateStarBrightness(timeOfDay);
 
@@ -125,17 +310,29 @@ private:
     }
 
 public:
-    AtmosphericRenderer() : timeOfDay(12.0f) {
+    AtmosphericRenderer()
+        : timeOfDay(12.0f), gpuInitialized(false), atmosphereProgram(0), atmosphereBuffer(0),
+        atmosphereVertexCount(0), timeOfDayUniform(-1), cameraPitchUniform(-1), pixelSizeUniform(-1) {
         updateAtmosphericConditions();
         generateStars();
     }
 
+    AtmosphericRenderer(const AtmosphericRenderer&) = delete;
+    AtmosphericRenderer& operator=(const AtmosphericRenderer&) = delete;
+
+    ~AtmosphericRenderer() {
+        if (atmosphereBuffer) glExt.deleteBuffers(1, &atmosphereBuffer);
+        if (atmosphereProgram) glExt.deleteProgram(atmosphereProgram);
+    }
+
     void updateTime(float deltaTime) {
         timeOfDay += deltaTime * 2.0f;
         if (timeOfDay >= 24.0f) timeOfDay = 0.0f;
         updateAtmosphericConditions();
     }
 
+    // Light parameters for the fixed-function terrain lighting. Only runs when
+    // the time changes; ATMOSPHERE_FRAGMENT_SHADER mirrors the sky colors.
     void updateAtmosphericConditions() {
         // Sky color transitions
         if (timeOfDay >= 0 && timeOfDay < 6) {  // Night
@@ -197,78 +394,184 @@ public:
         glLightfv(GL_LIGHT0, GL_AMBIENT, dynamicAmbientLight);
         glLightfv(GL_LIGHT0, GL_DIFFUSE, dynamicDiffuseLight);
 
-        // Render stars during night
-        renderStars();
+        if (!gpuInitialized) initializeGpu();
+        if (atmosphereProgram) {
+            renderAtmosphere();
+        }
+        else {
+            // Render stars during night
+            renderStars();
+        }
     }
 
 
     float getTimeOfDay() const { return timeOfDay; }
 };
 
-class CloudGenerator {
-private:
-    std::vector<std::vector<float>> cloudDensityMap;
-    int resolution;
-    unsigned int chunkSeed;
-
-    float cloudNoise(float x, float y, int octaves = 4) {
-        std::mt19937 rng(chunkSeed);
-        std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-
-        float noise = 0.0f;
-        float frequency = 1.0f;
-        float amplitude = 1.0f;
-        float maxValue = 0.0f;
-
-        for (int i = 0; i < octaves; ++i) {
-            float sampleX = x * frequency;
-            float sampleY = y * frequency;
+// Cloud layer program: the density texture is thresholded per fragment, and
+// opacity and shade follow from the density the same way the old per-cell
+// quads did. Lighting and fog match the fixed-function state the layers are
+// drawn under.
+const char* CLOUD_VERTEX_SHADER = R"GLSL(
+#version 120
+varying vec3 lighting;
+
+void main() {
+    vec4 eyePosition = gl_ModelViewMatrix * gl_Vertex;
+    gl_Position = gl_ProjectionMatrix * eyePosition;
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+
+    vec3 normal = normalize(gl_NormalMatrix * gl_Normal);
+    vec3 lightDirection = normalize(gl_LightSource[0].position.xyz);
+    float diffuse = max(dot(normal, lightDirection), 0.0);
+    lighting = gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +
+        diffuse * gl_LightSource[0].diffuse.rgb;
+    gl_FogFragCoord = abs(eyePosition.z);
+}
+)GLSL";
+
+const char* CLOUD_FRAGMENT_SHADER = R"GLSL(
+#version 120
+uniform sampler2D density;
+uniform float threshold;
+uniform float opacityScale;
+uniform float fogEnabled;
+varying vec3 lighting;
+
+void main() {
+    float value = texture2D(density, gl_TexCoord[0].st).r;
+    if (value <= threshold) discard;
+
+    float opacity = min(1.0, (value - threshold) * opacityScale);
+    vec3 color = clamp(vec3(1.0 - 0.1 * (1.0 - value)) * lighting, 0.0, 1.0);
+
+    float fogDensity = gl_Fog.density * gl_FogFragCoord;
+    float fog = mix(1.0, clamp(exp(-fogDensity * fogDensity), 0.0, 1.0), fogEnabled);
+    gl_FragColor = vec4(mix(gl_Fog.color.rgb, color, fog), opacity);
+}
+)GLSL";
 
-            
-            float randomOffset = dist(rng) * 0.1f;
-            noise += amplitude * (std::sin(sampleX + randomOffset) * std::cos(sampleY + randomOffset));
+const float CLOUD_THRESHOLD = 0.5f;      // Density below this is clear sky
+const float CLOUD_OPACITY_SCALE = 1.2f;  // Opacity per unit of density above the threshold
 
-            maxValue += amplitude;
-            amplitude *= 0.5f;
-            frequency *= 2.0f;
+// Program shared by every cloud layer, built on first use
+class CloudRenderer {
+private:
+    bool initialized;
+    GLuint program;
+    GLint densityUniform;
+    GLint thresholdUniform;
+    GLint opacityScaleUniform;
+    GLint fogEnabledUniform;
+
+    void initialize() {
+        initialized = true;
+        program = buildShaderProgram(CLOUD_VERTEX_SHADER, CLOUD_FRAGMENT_SHADER, "clouds");
+        if (program) {
+            densityUniform = glExt.getUniformLocation(program, "density");
+            thresholdUniform = glExt.getUniformLocation(program, "threshold");
+            opacityScaleUniform = glExt.getUniformLocation(program, "opacityScale");
+            fogEnabledUniform = glExt.getUniformLocation(program, "fogEnabled");
+        }
+        else {
+            std::cerr << "Cloud shader unavailable, drawing clouds as quads" << std::endl;
         }
-
-        return noise / maxValue;
     }
 
 public:
-    CloudGenerator(int res = 256, unsigned int seed = 12345)
-        : resolution(res), chunkSeed(seed) {
-        cloudDensityMap.resize(resolution, std::vector<float>(resolution, 0.0f));
-        generateClouds();
+    CloudRenderer()
+        : initialized(false), program(0), densityUniform(-1), thresholdUniform(-1),
+        opacityScaleUniform(-1), fogEnabledUniform(-1) {}
+
+    // False when there is no shader; the caller then draws quads instead
+    bool begin() {
+        if (!initialized) initialize();
+        if (!program) return false;
+
+        glExt.useProgram(program);
+        glExt.uniform1i(densityUniform, 0);
+        glExt.uniform1f(thresholdUniform, CLOUD_THRESHOLD);
+        glExt.uniform1f(opacityScaleUniform, CLOUD_OPACITY_SCALE);
+        glExt.uniform1f(fogEnabledUniform, glIsEnabled(GL_FOG) ? 1.0f : 0.0f);
+        return true;
     }
 
-    void regenerateClouds(unsigned int newSeed) {
-        chunkSeed = newSeed;
-        generateClouds();
+    void end() {
+        glExt.useProgram(0);
     }
+};
 
-    void generateClouds() {
-        for (int x = 0; x < resolution; ++x) {
-            for (int y = 0; y < resolution; ++y) {
-                float noiseValue = cloudNoise(x / 128.0f, y / 128.0f);
-                cloudDensityMap[x][y] = std::max(0.0f, std::min(1.0f, noiseValue));
-            }
+CloudRenderer cloudRenderer;
+
+// Draws the clouds of a CloudGenerator
+class CloudLayer {
+private:
+    CloudGenerator generator;
+
+    // GL copy of the density map. Generation may run on a worker thread, so
+    // the upload happens on the next draw after the revision changes.
+    GLuint densityTexture;
+    unsigned int uploadedRevision;
+
+    void uploadDensity() {
+        const Heightfield& cloudDensityMap = generator.getDensity();
+        int resolution = generator.getResolution();
+        bool created = densityTexture == 0;
+        if (created) glGenTextures(1, &densityTexture);
+        glBindTexture(GL_TEXTURE_2D, densityTexture);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(cloudDensityMap.stride()));
+
+        // Texture s runs along y (the contiguous axis), t along x
+        if (created) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE16, resolution, resolution, 0,
+                GL_LUMINANCE, GL_FLOAT, cloudDensityMap.data());
+        }
+        else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution, resolution,
+                GL_LUMINANCE, GL_FLOAT, cloudDensityMap.data());
         }
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        uploadedRevision = generator.getRevision();
     }
 
-    void renderClouds(float offsetX = 0, float offsetY = 0, float height = 50.0f) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // One quad per layer; cell (x, y) maps to texel (y, x) and, as with the
+    // quads, the last row and column are not drawn.
+    void renderTextured(float offsetX, float offsetY, float height) {
+        if (densityTexture == 0 || uploadedRevision != generator.getRevision()) uploadDensity();
+        glBindTexture(GL_TEXTURE_2D, densityTexture);
+
+        int resolution = generator.getResolution();
+        float extent = static_cast<float>(resolution - 1);
+        float coordinate = extent / resolution;
+        glNormal3f(0.0f, 0.0f, 1.0f);
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f);             glVertex3f(offsetX, offsetY, height);
+        glTexCoord2f(0.0f, coordinate);       glVertex3f(offsetX + extent, offsetY, height);
+        glTexCoord2f(coordinate, coordinate); glVertex3f(offsetX + extent, offsetY + extent, height);
+        glTexCoord2f(coordinate, 0.0f);       glVertex3f(offsetX, offsetY + extent, height);
+        glEnd();
 
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Fixed-function fallback: a blended quad per cloudy cell
+    void renderQuads(float offsetX, float offsetY, float height) {
+        const Heightfield& cloudDensityMap = generator.getDensity();
+        int resolution = generator.getResolution();
         glBegin(GL_QUADS);
         for (int x = 0; x < resolution - 1; ++x) {
+            const float* row = cloudDensityMap.row(x);
             for (int y = 0; y < resolution - 1; ++y) {
-                float density = cloudDensityMap[x][y];
+                float density = row[y];
 
-                if (density > 0.5f) {  
+                if (density > CLOUD_THRESHOLD) {  
 
-                    float opacity = std::min(1.0f, (density - 0.5f) * 1.2f);
+                    float opacity = std::min(1.0f, (density - CLOUD_THRESHOLD) * CLOUD_OPACITY_SCALE);
 
                     
                     float colorVar = 0.1f * (1.0f - density);
@@ -283,405 +586,759 @@ public:
             }
         }
         glEnd();
+    }
+
+public:
+    CloudLayer(int res = 256, unsigned int seed = 12345)
+        : generator(res, seed), densityTexture(0), uploadedRevision(0) {}
+
+    CloudLayer(const CloudLayer&) = delete;
+    CloudLayer& operator=(const CloudLayer&) = delete;
+
+    ~CloudLayer() {
+        if (densityTexture) glDeleteTextures(1, &densityTexture);
+    }
+
+    void regenerateClouds(unsigned int newSeed) {
+        generator.regenerateClouds(newSeed);
+    }
+
+    void renderClouds(float offsetX = 0, float offsetY = 0, float height = 50.0f) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        if (cloudRenderer.begin()) {
+            renderTextured(offsetX, offsetY, height);
+            cloudRenderer.end();
+        }
+        else {
+            renderQuads(offsetX, offsetY, height);
+        }
 
         glDisable(GL_BLEND);
     }
 };
 
-class ChunkGenerator {
-private:
-    int chunkSize;
-    float roughness;
-    unsigned int baseSeed;
-    std::mt19937 rng;
+// Terrain vertex program: geomorphs each vertex towards the coarser level as
+// it nears the end of its LOD range, then reproduces the fixed-function
+// lighting and fog the rest of the scene uses. The material ID travels in the
+// color alpha and is resolved through the palette texture.
+const char* TERRAIN_VERTEX_SHADER = R"GLSL(
+#version 120
+uniform sampler1D palette;
+uniform float materialCount;
+uniform vec2 cameraLocal;
+uniform vec2 morphRange;
+
+void main() {
+    float distance = length(gl_Vertex.xy - cameraLocal);
+    float morph = clamp((distance - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    vec4 position = vec4(gl_Vertex.xy, mix(gl_Vertex.z, gl_MultiTexCoord0.x, morph), 1.0);
+
+    vec4 eyePosition = gl_ModelViewMatrix * position;
+    gl_Position = gl_ProjectionMatrix * eyePosition;
+
+    float material = floor(gl_Color.a * 255.0 + 0.5);
+    vec3 base = texture1DLod(palette, (material + 0.5) / materialCount, 0.0).rgb;
+    vec3 normal = normalize(gl_NormalMatrix * gl_Normal);
+    vec3 lightDirection = normalize(gl_LightSource[0].position.xyz);
+    float diffuse = max(dot(normal, lightDirection), 0.0);
+    vec3 lit = base * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +
+        diffuse * gl_LightSource[0].diffuse.rgb);
+
+    gl_FrontColor = vec4(clamp(lit, 0.0, 1.0), 1.0);
+    gl_FogFragCoord = abs(eyePosition.z);
+}
+)GLSL";
 
-    std::vector<std::vector<float>> heightMap;
+const char* TERRAIN_FRAGMENT_SHADER = R"GLSL(
+#version 120
+uniform float fogEnabled;
 
-    float displace(float size) {
-        static std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
-        return dist(rng) * size;
-    }
+void main() {
+    float density = gl_Fog.density * gl_FogFragCoord;
+    float fog = mix(1.0, clamp(exp(-density * density), 0.0, 1.0), fogEnabled);
+    gl_FragColor = vec4(mix(gl_Fog.color.rgb, gl_Color.rgb, fog), gl_Color.a);
+}
+)GLSL";
 
-    void diamondSquareAlgorithm(unsigned int chunkSeed) {
-        int width = chunkSize + 1;
-        heightMap.resize(width, std::vector<float>(width, 0.0f));
+// Shared GL state for drawing chunk LODs: the shader, the palette texture and
+// one patch-ordered index buffer per LOD level. Index buffers depend only on
+// the chunk size, so every chunk uses the same ones.
+class TerrainRenderer {
+private:
+    struct Uniforms {
+        GLint palette = -1;
+        GLint materialCount = -1;
+        GLint cameraLocal = -1;
+        GLint morphRange = -1;
+        GLint fogEnabled = -1;
+    };
 
-        rng.seed(chunkSeed);
+    struct LevelIndices {
+        GLuint buffer = 0;
+        std::vector<uint32_t> indices;
+    };
 
-        
-        heightMap[0][0] = 0.2f + displace(0.1f);
-        heightMap[0][width - 1] = 0.3f + displace(0.1f);
-        heightMap[width - 1][0] = 0.1f + displace(0.1f);
-        heightMap[width - 1][width - 1] = 0.4f + displace(0.1f);
+    bool initialized;
+    GLuint program;
+    Uniforms uniforms;
+    GLuint paletteTexture;
+    int indexedChunkSize;
+    std::vector<LevelIndices> levelIndices;
+    LodSettings lodSettings;
+    int trianglesDrawn;
+
+    void initialize() {
+        initialized = true;
+        program = buildShaderProgram(TERRAIN_VERTEX_SHADER, TERRAIN_FRAGMENT_SHADER, "terrain");
+        if (program) {
+            uniforms.palette = glExt.getUniformLocation(program, "palette");
+            uniforms.materialCount = glExt.getUniformLocation(program, "materialCount");
+            uniforms.cameraLocal = glExt.getUniformLocation(program, "cameraLocal");
+            uniforms.morphRange = glExt.getUniformLocation(program, "morphRange");
+            uniforms.fogEnabled = glExt.getUniformLocation(program, "fogEnabled");
+        }
+        else {
+            std::cerr << "Terrain shader unavailable, drawing LOD without geomorphing" << std::endl;
+        }
 
+        // One texel per material, never filtered
+        const MaterialPalette& palette = ChunkGenerator::getPalette();
+        glGenTextures(1, &paletteTexture);
+        glBindTexture(GL_TEXTURE_1D, paletteTexture);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, MATERIAL_COUNT, 0, GL_RGBA, GL_UNSIGNED_BYTE, palette.packed);
+        glBindTexture(GL_TEXTURE_1D, 0);
+    }
 
-        
-        float size = width - 1;
-        float h = roughness * 1.2f;
-
-        while (size >= 1) {
-            
-            /*
-            This divides the grid into Smaller Diamond Steps and it 
-            calculates the center point of each division.
-            */
-            
-            for (int x = 0; x < width - 1; x += size) {
-                for (int y = 0; y < width - 1; y += size) {
-                    int midX = x + size / 2;
-                    int midY = y + size / 2;
-
-                    float avg = (
-                        heightMap[x][y] +
-                        heightMap[x + size][y] +
-                        heightMap[x][y + size] +
-                        heightMap[x + size][y + size]
-                        ) / 4.0f;
-
-                    float variation = displace(h) * (1.3f + std::abs(avg - 0.5f) * 1.5f);
-                    heightMap[midX][midY] = std::min(1.0f, std::max(0.0f, avg + variation));
-                }
+    void prepareIndices(int chunkSize, int levelCount) {
+        if (indexedChunkSize == chunkSize) return;
+        indexedChunkSize = chunkSize;
+
+        for (LevelIndices& level : levelIndices) {
+            if (level.buffer) glExt.deleteBuffers(1, &level.buffer);
+        }
+        levelIndices.assign(levelCount, LevelIndices());
+
+        for (int l = 0; l < levelCount; ++l) {
+            LevelIndices& level = levelIndices[l];
+            ChunkLod::buildPatchIndices(chunkSize, l, level.indices);
+            if (glExt.hasBufferObjects) {
+                glExt.genBuffers(1, &level.buffer);
+                glExt.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.buffer);
+                glExt.bufferData(GL_ELEMENT_ARRAY_BUFFER, level.indices.size() * sizeof(uint32_t),
+                    level.indices.data(), GL_STATIC_DRAW);
             }
+        }
+        if (glExt.hasBufferObjects) glExt.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
 
-            // Square step
-            for (int x = 0; x < width - 1; x += size) {
-                for (int y = 0; y < width - 1; y += size) {
-                    int midX = x + size / 2;
-                    int midY = y + size / 2;
+public:
+    TerrainRenderer()
+        : initialized(false), program(0), paletteTexture(0), indexedChunkSize(0), trianglesDrawn(0) {}
+
+    void setLodSettings(const LodSettings& settings) { lodSettings = settings; }
+    const LodSettings& getLodSettings() const { return lodSettings; }
+
+    void beginFrame() {
+        if (!initialized) initialize();
+        trianglesDrawn = 0;
+
+        if (program) {
+            glExt.useProgram(program);
+            glExt.uniform1i(uniforms.palette, 0);
+            glExt.uniform1f(uniforms.materialCount, static_cast<float>(MATERIAL_COUNT));
+            glExt.uniform1f(uniforms.fogEnabled, glIsEnabled(GL_FOG) ? 1.0f : 0.0f);
+            glBindTexture(GL_TEXTURE_1D, paletteTexture);
+        }
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
 
-                    if (x > 0) {
+    void endFrame() {
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        if (program) {
+            glBindTexture(GL_TEXTURE_1D, 0);
+            glExt.useProgram(0);
+        }
+    }
 
-                        float avg = (
-                            heightMap[x][y] +
-                            heightMap[x][y + size] +
-                            heightMap[midX][midY] +
-                            heightMap[x - size / 2][midY]
-                            ) / 4.0f;
+    // Draw one chunk's selected LOD patches. vertexBuffers holds one buffer per
+    // level (ignored without buffer-object support).
+    void drawChunk(const ChunkLod& lod, const GLuint* vertexBuffers, const std::vector<LodNode>& nodes,
+        float offsetX, float offsetY) {
+        prepareIndices(lod.getChunkSize(), lod.levelCount());
 
-                        heightMap[x][midY] = std::min(1.0f, std::max(0.0f,
-                            avg + displace(h) * (1.3f + std::abs(avg - 0.5f) * 1.5f)));
-                    }
+        glPushMatrix();
+        glTranslatef(offsetX, offsetY, 0.0f);
+        if (program) {
+            glExt.uniform2f(uniforms.cameraLocal, cameraPosX - offsetX, cameraPosY - offsetY);
+        }
 
-                    if (y > 0) {
+        const size_t patchBytes = ChunkLod::indicesPerPatch() * sizeof(uint32_t);
+        for (int l = 0; l < lod.levelCount(); ++l) {
+            const LevelIndices& level = levelIndices[l];
+            int patches = ChunkLod::patchesPerSide(lod.getChunkSize(), l);
+            bool bound = false;
 
-                        float avg = (
-                            heightMap[x][y] +
-                            heightMap[x + size][y] +
-                            heightMap[midX][midY] +
-                            heightMap[midX][y - size / 2]
-                            ) / 4.0f;
+            for (const LodNode& node : nodes) {
+                if (node.level != l) continue;
 
-                        heightMap[midX][y] = std::min(1.0f, std::max(0.0f,
-                            avg + displace(h) * (1.3f + std::abs(avg - 0.5f) * 1.5f)));
+                if (!bound) {
+                    const char* vertexBase = nullptr;
+                    if (glExt.hasBufferObjects) {
+                        glExt.bindBuffer(GL_ARRAY_BUFFER, vertexBuffers[l]);
+                        glExt.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.buffer);
                     }
+                    else {
+                        vertexBase = reinterpret_cast<const char*>(lod.level(l).vertices.data());
+                    }
+                    glVertexPointer(3, GL_FLOAT, sizeof(LodVertex), vertexBase + offsetof(LodVertex, x));
+                    glTexCoordPointer(1, GL_FLOAT, sizeof(LodVertex), vertexBase + offsetof(LodVertex, zMorph));
+                    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(LodVertex), vertexBase + offsetof(LodVertex, color));
+                    if (program) {
+                        glExt.uniform2f(uniforms.morphRange, lodSettings.morphStart(l), lodSettings.morphEnd(l));
+                    }
+                    bound = true;
                 }
-            }
 
-            size /= 2;
-            h *= 0.55f;
+                size_t patch = static_cast<size_t>(node.patchX) * patches + node.patchY;
+                const char* indices = glExt.hasBufferObjects
+                    ? static_cast<const char*>(nullptr) + patch * patchBytes
+                    : reinterpret_cast<const char*>(level.indices.data()) + patch * patchBytes;
+                glDrawElements(GL_TRIANGLES, ChunkLod::indicesPerPatch(), GL_UNSIGNED_INT, indices);
+                trianglesDrawn += ChunkLod::indicesPerPatch() / 3;
+            }
         }
 
-        // Smooth peaks
-        smoothPeaks();
+        if (glExt.hasBufferObjects) {
+            glExt.bindBuffer(GL_ARRAY_BUFFER, 0);
+            glExt.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+        glPopMatrix();
     }
 
-    void smoothPeaks() {
-        std::vector<std::vector<float>> smoothedHeightMap = heightMap;
-        int width = heightMap.size();
-
-        for (int x = 1; x < width - 1; ++x) {
+    int getTrianglesDrawn() const { return trianglesDrawn; }
+};
 
-            for (int y = 1; y < width - 1; ++y) {
+TerrainRenderer terrainRenderer;
 
-                float smoothedHeight = (
-                    heightMap[x - 1][y - 1] * 0.05f +
-                    heightMap[x - 1][y] * 0.1f +
-                    heightMap[x - 1][y + 1] * 0.05f +
-                    heightMap[x][y - 1] * 0.1f +
-                    heightMap[x][y] * 0.4f +
-                    heightMap[x][y + 1] * 0.1f +
-                    heightMap[x + 1][y - 1] * 0.05f +
-                    heightMap[x + 1][y] * 0.1f +
-                    heightMap[x + 1][y + 1] * 0.05f
-                    );
+// Per-frame culling counts, shown in the HUD
+struct TerrainRenderStats {
+    int chunksDrawn = 0;
+    int chunksCulled = 0;
+    int patchesDrawn = 0;
+    int patchesCulled = 0;
+};
 
-                smoothedHeightMap[x][y] = std::pow(smoothedHeight, 0.78f);
+// GPU copy of one chunk's LOD vertex grids, re-uploaded only when the chunk's
+// revision changes.
+class TerrainMesh {
+private:
+    std::vector<GLuint> vertexBuffers;
+    unsigned int uploadedRevision;
+    bool uploaded;
+    std::vector<LodNode> selectedNodes;
+
+    void upload(const ChunkGenerator& chunk) {
+        const ChunkLod& lod = chunk.getLod();
+        if (glExt.hasBufferObjects) {
+            if (static_cast<int>(vertexBuffers.size()) != lod.levelCount()) {
+                releaseBuffers();
+                vertexBuffers.assign(lod.levelCount(), 0);
+                glExt.genBuffers(lod.levelCount(), vertexBuffers.data());
             }
+            for (int l = 0; l < lod.levelCount(); ++l) {
+                const std::vector<LodVertex>& vertices = lod.level(l).vertices;
+                glExt.bindBuffer(GL_ARRAY_BUFFER, vertexBuffers[l]);
+                glExt.bufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(LodVertex),
+                    vertices.data(), GL_STATIC_DRAW);
+            }
+            glExt.bindBuffer(GL_ARRAY_BUFFER, 0);
         }
-
-        heightMap = smoothedHeightMap;
+        uploadedRevision = chunk.getRevision();
+        uploaded = true;
     }
 
-    
-    float fractalNoise(float x, float y, float persistence = 0.5f, int octaves = 6) {
-        float total = 0.0f;
-        float frequency = 1.0f;
-        float amplitude = 1.0f;
-        float maxValue = 0.0f;
+    void releaseBuffers() {
+        if (!vertexBuffers.empty() && glExt.hasBufferObjects) {
+            glExt.deleteBuffers(static_cast<GLsizei>(vertexBuffers.size()), vertexBuffers.data());
+        }
+        vertexBuffers.clear();
+    }
 
-        for (int i = 0; i < octaves; ++i) {
-            
-            float sampleX = x * frequency;
-            float sampleY = y * frequency;
+public:
+    TerrainMesh() : uploadedRevision(0), uploaded(false) {}
 
-            
-            float noise = 0.5f * (std::sin(sampleX) + std::cos(sampleY));
+    TerrainMesh(const TerrainMesh&) = delete;
+    TerrainMesh& operator=(const TerrainMesh&) = delete;
 
-            total += noise * amplitude;
-            maxValue += amplitude;
+    ~TerrainMesh() { releaseBuffers(); }
 
-            amplitude *= persistence;
-            frequency *= 2.0f;
+    // Call between terrainRenderer.beginFrame() and endFrame(). view is the
+    // camera frustum in world coordinates.
+    void render(const ChunkGenerator& chunk, float offsetX, float offsetY, const Frustum& view,
+        TerrainRenderStats& stats) {
+        if (!uploaded || uploadedRevision != chunk.getRevision()) {
+            upload(chunk);
         }
 
-        return total / maxValue;
+        const ChunkLod& lod = chunk.getLod();
+        selectedNodes.clear();
+        stats.patchesCulled += lod.selectNodes(cameraPosX - offsetX, cameraPosY - offsetY,
+            terrainRenderer.getLodSettings(), view.translated(offsetX, offsetY, 0.0f), selectedNodes);
+        stats.patchesDrawn += static_cast<int>(selectedNodes.size());
+        terrainRenderer.drawChunk(lod, vertexBuffers.data(), selectedNodes, offsetX, offsetY);
     }
+};
 
-    void addErosionSimulation() {
-        int width = heightMap.size();
-        std::vector<std::vector<float>> erosionMap = heightMap;
+// Global variables
+const int CHUNK_SIZE = 256;
+const int DEFAULT_RING_RADIUS = 1;  // 3x3 ring of chunks around the camera
+const float LOD_PIXEL_ERROR = 2.0f;  // On-screen size of a grid cell where LOD starts coarsening
+const float FIELD_OF_VIEW = 60.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 500.0f;
+float viewAspect = 16.0f / 9.0f;  // Updated by reshape
+
+// Steps of making a chunk, as tracked for the HUD
+enum GenerationStage {
+    GENERATION_DIAMOND_SQUARE,
+    GENERATION_SMOOTH_PEAKS,
+    GENERATION_EROSION,
+    GENERATION_SURFACE,
+    GENERATION_MESH,
+    GENERATION_CLOUDS,
+    GENERATION_STAGE_COUNT
+};
 
-       
-        for (int iteration = 0; iteration < 10; ++iteration) {
-            for (int x = 1; x < width - 1; ++x) {
-                for (int y = 1; y < width - 1; ++y) {
-                    
+const char* const GENERATION_STAGE_NAMES[GENERATION_STAGE_COUNT] = {
+    "diamond-square", "smooth peaks", "erosion", "surface", "mesh", "clouds"
+};
 
-                    float currentHeight = heightMap[x][y];
-                    float maxDropHeight = 0;
-                    int dropX = x, dropY = y;
-
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        for (int dy = -1; dy <= 1; ++dy) {
-                            float neighborHeight = heightMap[x + dx][y + dy];
-                            float dropHeight = currentHeight - neighborHeight;
-
-                            if (dropHeight > maxDropHeight) {
-                                maxDropHeight = dropHeight;
-                                dropX = x + dx;
-                                dropY = y + dy;
-                            }
-                        }
-                    }
+// Generation settings tuned live from the keyboard
+struct TerrainParameters {
+    float roughness = 0.82f;
+    int erosionIterations = 10;
+    BiomeSettings biome;
+};
 
-                    
-                    if (dropX != x || dropY != y) {
-                        float sedimentAmount = maxDropHeight * 0.1f;
-                        erosionMap[x][y] -= sedimentAmount;
-                        erosionMap[dropX][dropY] += sedimentAmount;
-                    }
-                }
-            }
+// Keeps a (2r+1)x(2r+1) window of chunks centered on the camera's chunk.
+//
+// Slots are addressed toroidally by world chunk coordinates, so when the
+// camera crosses a chunk border only the newly exposed row or column maps to
+// slots holding stale chunks. Those chunks are evicted by regenerating the
+// slot in place; memory use is fixed by the radius, not by distance travelled.
+class TerrainManager {
+private:
+    enum SlotState { SLOT_EMPTY, SLOT_PENDING, SLOT_READY };
+
+    struct ChunkSlot {
+        int chunkX = 0;
+        int chunkY = 0;
+        // Written by the generation task, read by the render thread
+        std::atomic<int> state{ SLOT_EMPTY };
+        ChunkGenerator terrain;
+        CloudLayer clouds;
+        // Chunk and cloud pattern the clouds were generated for
+        bool hasClouds = false;
+        int cloudChunkX = 0;
+        int cloudChunkY = 0;
+        unsigned int cloudEpoch = 0;
+        ErosionMode erosionMode = EROSION_THERMAL;  // Erosion the terrain was generated with
+        unsigned int parametersRevision = 0;  // TerrainParameters revision it was generated with
+        TerrainMesh mesh;  // Only touched on the render thread
+
+        ChunkSlot() : terrain(CHUNK_SIZE), clouds(CHUNK_SIZE) {}
+    };
 
+    int ringRadius;
+    int ringSide;
+    std::vector<ChunkSlot> slots;
+    int centerChunkX;
+    int centerChunkY;
+    unsigned int baseSeed;
+    bool cloudRenderingEnabled;
+    // Bumped to ask for a new cloud pattern; read by generation tasks
+    std::atomic<unsigned int> cloudEpoch;
+    // Erosion for newly generated chunks; chunks made with another one are redone
+    std::atomic<int> erosionMode;
+    // Settings for newly generated chunks, bumping parametersRevision on
+    // every change; chunks made with an older revision are redone
+    TerrainParameters parameters;
+    mutable std::mutex parametersMutex;
+    std::atomic<unsigned int> parametersRevision;
+    // Hydraulic erosion totals over every chunk generated with it
+    std::atomic<long long> erodedDroplets;
+    std::atomic<long long> erosionMicroseconds;
+    // Milliseconds per step over recent generated chunks
+    RollingStats generationStats[GENERATION_STAGE_COUNT];
+    mutable std::mutex generationStatsMutex;
+    Profiler* profiler;
+    TerrainRenderStats renderStats;
+    ChunkCache* chunkCache;  // Optional; chunks found there are loaded instead of generated
+    // Generation scratch per pool thread, indexed by ThreadPool::currentWorkerIndex
+    std::vector<ScratchArena> arenas;
+    // Reused by update and refreshClouds, which only run on the main thread
+    std::vector<ChunkSlot*> claimedSlots;
+    std::vector<ChunkSlot*> staleCloudSlots;
+    // Declared last so workers are joined before the slots they write to go away
+    ThreadPool generationPool;
+
+    static int wrap(int value, int modulus) {
+        int r = value % modulus;
+        return r < 0 ? r + modulus : r;
+    }
 
-            heightMap = erosionMap;
-        }
+    static int worldToChunk(float coordinate) {
+        return static_cast<int>(std::floor(coordinate / CHUNK_SIZE));
     }
 
-    void applyBiomeVariation() {
-        int width = heightMap.size();
+    ChunkSlot& slotFor(int chunkX, int chunkY) {
+        return slots[wrap(chunkX, ringSide) * ringSide + wrap(chunkY, ringSide)];
+    }
 
-        for (int x = 0; x < width; ++x) {
-            for (int y = 0; y < width; ++y) {
-                
-                float terrainNoise = fractalNoise(x / 256.0f, y / 256.0f);
-                float biomeNoise = fractalNoise(x / 128.0f, y / 128.0f, 0.6f, 4);
+    bool inRing(int chunkX, int chunkY) const {
+        return std::abs(chunkX - centerChunkX) <= ringRadius &&
+            std::abs(chunkY - centerChunkY) <= ringRadius;
+    }
 
-                
-                heightMap[x][y] = std::min(1.0f, std::max(0.0f,
-                    heightMap[x][y] +
-                    terrainNoise * 0.2f +
-                    biomeNoise * 0.1f
-                ));
-            }
-        }
+    unsigned int cloudSeedFor(int chunkX, int chunkY, unsigned int epoch) const {
+        return hashCombine(hashCoords(baseSeed, chunkX, chunkY), epoch);
     }
 
-    
-    void getTerrainColor(float height, float& r, float& g, float& b)  {
-        
-        if (height < 0.1f) {
-            
-            r = 0.0f; g = 0.1f; b = 0.4f;
-        }
-        else if (height < 0.2f) {
-            
-            r = 0.1f; g = 0.3f; b = 0.5f;
-        }
-        else if (height < 0.3f) {
-            
-            r = 0.85f; g = 0.8f; b = 0.6f;
+    void generateClouds(ChunkSlot& slot, unsigned int epoch) {
+        Profiler::Clock::time_point start = Profiler::Clock::now();
+        slot.clouds.regenerateClouds(cloudSeedFor(slot.chunkX, slot.chunkY, epoch));
+        slot.hasClouds = true;
+        slot.cloudChunkX = slot.chunkX;
+        slot.cloudChunkY = slot.chunkY;
+        slot.cloudEpoch = epoch;
+        Profiler::Clock::time_point end = Profiler::Clock::now();
+        if (profiler) profiler->record("generateClouds", "generation", start, end);
+        std::lock_guard<std::mutex> lock(generationStatsMutex);
+        generationStats[GENERATION_CLOUDS].add(std::chrono::duration<float, std::milli>(end - start).count());
+    }
+
+    void addGenerationStats(const ChunkTimings& timings) {
+        const double seconds[] = { timings.diamondSquare, timings.smoothPeaks, timings.erosion,
+            timings.biomeVariation + timings.surface, timings.mesh };
+        // Stages restored from a snapshot didn't run
+        const bool reused[] = { timings.baseReused, false, timings.erosionReused, false, false };
+        std::lock_guard<std::mutex> lock(generationStatsMutex);
+        for (int stage = 0; stage < GENERATION_CLOUDS; ++stage) {
+            if (!reused[stage]) generationStats[stage].add(static_cast<float>(seconds[stage] * 1000.0));
         }
-        else if (height < 0.45f) {
-            
-            r = 0.2f; g = 0.5f; b = 0.2f;
+    }
+
+    void generateSlot(ChunkSlot& slot) {
+        ErosionMode mode = static_cast<ErosionMode>(erosionMode.load());
+        slot.terrain.setErosionMode(mode);
+        TerrainParameters tuned;
+        unsigned int revision;
+        {
+            std::lock_guard<std::mutex> lock(parametersMutex);
+            tuned = parameters;
+            revision = parametersRevision.load();
         }
-        else if (height < 0.6f) {
-            
-            r = 0.4f; g = 0.6f; b = 0.3f;
+        ErosionSettings erosion;
+        erosion.iterations = tuned.erosionIterations;
+        slot.terrain.setRoughness(tuned.roughness);
+        slot.terrain.setErosionSettings(erosion);
+        slot.terrain.setBiomeSettings(tuned.biome);
+        // A thread only ever generates one chunk at a time
+        ScratchArena& arena = arenas[generationPool.currentWorkerIndex()];
+        bool cached = chunkCache && slot.terrain.loadChunk(*chunkCache, baseSeed, slot.chunkX, slot.chunkY, arena);
+        if (!cached) {
+            slot.terrain.generateChunk(baseSeed, slot.chunkX, slot.chunkY, arena);
+            if (chunkCache) slot.terrain.storeChunk(*chunkCache, arena);
+            addGenerationStats(slot.terrain.getTimings());
         }
-        else if (height < 0.75f) {
-            
-            r = 0.5f; g = 0.5f; b = 0.5f;
+        slot.erosionMode = mode;
+        slot.parametersRevision = revision;
+        if (!cached && mode == EROSION_HYDRAULIC) {
+            const HydraulicErosionStats& stats = slot.terrain.getHydraulicStats();
+            erodedDroplets += stats.droplets;
+            erosionMicroseconds += static_cast<long long>(stats.seconds * 1e6);
         }
-        else if (height < 0.9f) {
-            
-            r = 0.6f; g = 0.6f; b = 0.6f;
+        // Parameter changes redo the terrain of every slot, but its clouds
+        // only depend on the chunk and the pattern
+        unsigned int epoch = cloudEpoch.load();
+        if (!slot.hasClouds || slot.cloudChunkX != slot.chunkX || slot.cloudChunkY != slot.chunkY ||
+            slot.cloudEpoch != epoch) {
+            generateClouds(slot, epoch);
         }
-        else {
-            
-            r = 0.9f; g = 0.9f; b = 1.0f;
+        slot.state.store(SLOT_READY, std::memory_order_release);
+    }
+
+    typedef bool (HeightPyramid::*ChunkIntersect)(const HeightRay&, HeightRayHit&) const;
+
+    // Nearest hit over all loaded chunks. Each chunk is tested with the ray
+    // cut off at the best hit so far.
+    bool castRay(const HeightRay& ray, HeightRayHit& hit, ChunkIntersect intersect) const {
+        bool found = false;
+        HeightRay local = ray;
+        for (const ChunkSlot& slot : slots) {
+            if (slot.state.load(std::memory_order_acquire) != SLOT_READY) continue;
+            if (!inRing(slot.chunkX, slot.chunkY)) continue;
+
+            float xOffset = static_cast<float>(slot.chunkX) * CHUNK_SIZE;
+            float yOffset = static_cast<float>(slot.chunkY) * CHUNK_SIZE;
+            local.originX = ray.originX - xOffset;
+            local.originY = ray.originY - yOffset;
+
+            HeightRayHit chunkHit;
+            if ((slot.terrain.getPyramid().*intersect)(local, chunkHit)) {
+                found = true;
+                local.maxT = chunkHit.t;
+                hit = chunkHit;
+                hit.x += xOffset;
+                hit.y += yOffset;
+                hit.cellX += slot.chunkX * CHUNK_SIZE;
+                hit.cellY += slot.chunkY * CHUNK_SIZE;
+            }
         }
+        return found;
+    }
 
-        
-        float localVariation = fractalNoise(r, g, 0.5f, 3);
-        r += localVariation * 0.1f;
-        g += localVariation * 0.1f;
-        b += localVariation * 0.1f;
+    // Claim every ring slot whose chunk is missing or stale. Slots still being
+    // generated are left alone and picked up on a later call.
+    const std::vector<ChunkSlot*>& claimStaleSlots() {
+        ErosionMode mode = static_cast<ErosionMode>(erosionMode.load());
+        unsigned int revision = parametersRevision.load();
+        std::vector<ChunkSlot*>& claimed = claimedSlots;
+        claimed.clear();
+        for (int cx = centerChunkX - ringRadius; cx <= centerChunkX + ringRadius; ++cx) {
+            for (int cy = centerChunkY - ringRadius; cy <= centerChunkY + ringRadius; ++cy) {
+                ChunkSlot& slot = slotFor(cx, cy);
+                int state = slot.state.load(std::memory_order_acquire);
+                if (state == SLOT_PENDING) continue;
+                if (state == SLOT_READY && slot.chunkX == cx && slot.chunkY == cy &&
+                    slot.erosionMode == mode && slot.parametersRevision == revision) {
+                    continue;
+                }
+
+                slot.chunkX = cx;
+                slot.chunkY = cy;
+                slot.state.store(SLOT_PENDING, std::memory_order_relaxed);
+                claimed.push_back(&slot);
+            }
+        }
+        return claimed;
     }
 
 public:
-    ChunkGenerator(int size = 128, float rough = 0.82f)
-        : chunkSize(size), roughness(rough), baseSeed(12345) {}
-
-    void generateChunk(unsigned int chunkSeed) {
-        diamondSquareAlgorithm(chunkSeed);
+    // threadCount = 0 uses every hardware thread; the generated world is the
+    // same for any thread count. Chunk seeds come from world chunk coordinates.
+    // snapshotCache keeps the stage snapshots of retuned chunks, so parameter
+    // changes stay incremental for them when loaded from cache on a later
+    // run. Caches and profiler, if given, must outlive the manager.
+    TerrainManager(unsigned int seed = 12345, int radius = DEFAULT_RING_RADIUS, int threadCount = 0,
+        ChunkCache* cache = nullptr, Profiler* generationProfiler = nullptr, ChunkCache* snapshotCache = nullptr)
+        : ringRadius(radius),
+        ringSide(2 * radius + 1),
+        slots(ringSide * ringSide),
+        centerChunkX(0),
+        centerChunkY(0),
+        baseSeed(seed),
+        cloudRenderingEnabled(true),  // Default to rendering clouds
+        cloudEpoch(0),
+        erosionMode(EROSION_THERMAL),
+        parametersRevision(0),
+        erodedDroplets(0),
+        erosionMicroseconds(0),
+        profiler(generationProfiler),
+        chunkCache(cache),
+        generationPool(threadCount)
+    {
+        for (ChunkSlot& slot : slots) {
+            slot.terrain.setThreadPool(&generationPool);
+            slot.terrain.setProfiler(profiler);
+            slot.terrain.setSnapshotCache(snapshotCache);
+        }
+        arenas.resize(generationPool.threadCount());
+        // Slot lists never hold more than every slot, so they never regrow
+        claimedSlots.reserve(slots.size());
+        staleCloudSlots.reserve(slots.size());
+
+        // The first ring is generated up front so there is terrain on the first frame
+        const std::vector<ChunkSlot*>& initial = claimStaleSlots();
+        generationPool.parallelFor(static_cast<int>(initial.size()), [&](int index) {
+            generateSlot(*initial[index]);
+        });
+    }
 
-        addErosionSimulation();
-        applyBiomeVariation();
+    // Recenter the ring on the camera. Newly exposed chunks are generated in
+    // the background and drawn once they are ready.
+    void update(float cameraX, float cameraY) {
+        centerChunkX = worldToChunk(cameraX);
+        centerChunkY = worldToChunk(cameraY);
 
-        
-        smoothPeaks();
-    }
-
-    void render(float offsetX = 0, float offsetY = 0) {
-        float scale = 90.0f;
-        int width = heightMap.size();
-
-        glBegin(GL_TRIANGLES);
-        for (int x = 0; x < width - 1; ++x) {
-            for (int y = 0; y < width - 1; ++y) {
-                float h1 = std::pow(heightMap[x][y], 1.5f) * scale;
-                float h2 = std::pow(heightMap[x + 1][y], 1.5f) * scale;
-                float h3 = std::pow(heightMap[x][y + 1], 1.5f) * scale;
-                float h4 = std::pow(heightMap[x + 1][y + 1], 1.5f) * scale;
-
-                float r1, g1, b1, r2, g2, b2, r3, g3, b3, r4, g4, b4;
-                getTerrainColor(heightMap[x][y], r1, g1, b1);
-                getTerrainColor(heightMap[x + 1][y], r2, g2, b2);
-                getTerrainColor(heightMap[x][y + 1], r3, g3, b3);
-                getTerrainColor(heightMap[x + 1][y + 1], r4, g4, b4);
-
-                // First triangle
-                glColor3f(r1, g1, b1);
-                glVertex3f(x + offsetX, y + offsetY, h1);
-                glColor3f(r2, g2, b2);
-                glVertex3f(x + 1 + offsetX, y + offsetY, h2);
-                glColor3f(r3, g3, b3);
-                glVertex3f(x + offsetX, y + 1 + offsetY, h3);
-
-                // Second triangle
-                glColor3f(r2, g2, b2);
-                glVertex3f(x + 1 + offsetX, y + offsetY, h2);
-                glColor3f(r4, g4, b4);
-                glVertex3f(x + 1 + offsetX, y + 1 + offsetY, h4);
-                glColor3f(r3, g3, b3);
-                glVertex3f(x + offsetX, y + 1 + offsetY, h3);
-            }
+        for (ChunkSlot* slot : claimStaleSlots()) {
+            generationPool.enqueue([this, slot] { generateSlot(*slot); });
         }
-        glEnd();
+        refreshClouds();
     }
 
-    float getMaxHeight() const {
-        float maxHeight = 0.0f;
-        for (const auto& row : heightMap) {
-            for (float height : row) {
-                maxHeight = std::max(maxHeight, height);
-            }
+    // Switch every chunk to a new cloud pattern. Loaded chunks are redone
+    // right away; chunks still generating pick it up on a later update.
+    void reseedClouds() {
+        ++cloudEpoch;
+        refreshClouds();
+    }
+
+    // Regenerate clouds of loaded chunks made for an older pattern
+    void refreshClouds() {
+        unsigned int epoch = cloudEpoch.load();
+        std::vector<ChunkSlot*>& stale = staleCloudSlots;
+        stale.clear();
+        for (ChunkSlot& slot : slots) {
+            if (slot.state.load(std::memory_order_acquire) != SLOT_READY) continue;
+            if (slot.cloudEpoch != epoch) stale.push_back(&slot);
         }
-        return maxHeight * 90.0f;
+        generationPool.parallelFor(static_cast<int>(stale.size()), [&](int index) {
+            generateClouds(*stale[index], epoch);
+        });
     }
-};
 
-// Global variables
-const int MAX_CHUNKS = 9;  // 3x3 grid of chunks
-const int CHUNK_SIZE = 256;
-const float MOVE_SPEED = 0.5f;
-const float MAX_FORWARD_DISTANCE = CHUNK_SIZE * 3.0f;  // Limit movement to 3 chunk sizes
+    unsigned int getCloudEpoch() const { return cloudEpoch.load(); }
 
-class TerrainManager {
-private:
-    std::vector<std::vector<ChunkGenerator>> chunks;
-    std::vector<std::vector<CloudGenerator>> chunkClouds;
-    float currentOffset;
-    unsigned int baseSeed;
-    std::vector<std::vector<float>> heightMap;
-    bool cloudRenderingEnabled;
+    // Loaded chunks made with the other erosion are regenerated in the
+    // background from the next update on
+    void setErosionMode(ErosionMode mode) { erosionMode = mode; }
+    ErosionMode getErosionMode() const { return static_cast<ErosionMode>(erosionMode.load()); }
 
-public:
-    TerrainManager(unsigned int seed = 12345)
-        : currentOffset(0),
-        baseSeed(seed),
-        cloudRenderingEnabled(true)  // Default to rendering clouds
-    {
-        // Resize both terrain and cloud generators
-        chunks.resize(3, std::vector<ChunkGenerator>(3, ChunkGenerator(CHUNK_SIZE)));
-        chunkClouds.resize(3, std::vector<CloudGenerator>(3, CloudGenerator(CHUNK_SIZE)));
-
-        // Initial chunk and cloud generation
-        for (int x = 0; x < 3; ++x) {
-            for (int y = 0; y < 3; ++y) {
-                unsigned int chunkSeed = baseSeed + x * 3 + y;
-                chunks[x][y].generateChunk(chunkSeed);
-                chunkClouds[x][y].regenerateClouds(chunkSeed);
-            }
-        }
+    // Loaded chunks are regenerated in the background from the next update
+    // on. Each chunk reruns only the stages after the first one the change
+    // affects; the rest come from its generator's stage snapshots.
+    void setParameters(const TerrainParameters& tuned) {
+        std::lock_guard<std::mutex> lock(parametersMutex);
+        parameters = tuned;
+        ++parametersRevision;
     }
 
+    TerrainParameters getParameters() const {
+        std::lock_guard<std::mutex> lock(parametersMutex);
+        return parameters;
+    }
 
-    void moveForward(float distance) {
-        currentOffset = std::min(currentOffset + distance, MAX_FORWARD_DISTANCE);
+    // Average hydraulic erosion throughput so far, 0 before the first chunk
+    double getErosionDropletsPerSecond() const {
+        long long microseconds = erosionMicroseconds.load();
+        return microseconds > 0 ? erodedDroplets.load() * 1e6 / microseconds : 0.0;
     }
 
-    void moveBackward(float distance) {
-        currentOffset = std::max(currentOffset - distance, 0.0f);
+    // Recent per-chunk times of one generation step, in milliseconds
+    RollingStats getGenerationStats(GenerationStage stage) const {
+        std::lock_guard<std::mutex> lock(generationStatsMutex);
+        return generationStats[stage];
     }
 
     void toggleCloudRendering() {
         cloudRenderingEnabled = !cloudRenderingEnabled;
     }
 
-    void render() {
-        for (int x = 0; x < 3; ++x) {
-            for (int y = 0; y < 3; ++y) {
-                // Remove the chunk spacing, align chunks exactly
-                float xOffset = x * CHUNK_SIZE;
-                float yOffset = y * CHUNK_SIZE - currentOffset;
+    // view is the camera frustum the modelview/projection matrices were set up with
+    void render(const Frustum& view) {
+        renderStats = TerrainRenderStats();
+
+        terrainRenderer.beginFrame();
+        for (ChunkSlot& slot : slots) {
+            if (slot.state.load(std::memory_order_acquire) != SLOT_READY) continue;
+            if (!inRing(slot.chunkX, slot.chunkY)) continue;
 
-                // Render terrain
-                chunks[x][y].render(xOffset, yOffset);
+            // Chunks share their border row, so they are placed CHUNK_SIZE apart
+            float xOffset = static_cast<float>(slot.chunkX) * CHUNK_SIZE;
+            float yOffset = static_cast<float>(slot.chunkY) * CHUNK_SIZE;
 
-                // If clouds are enabled, render clouds for this chunk
-                if (cloudRenderingEnabled) {
-                    float cloudHeight = chunks[x][y].getMaxHeight() + 50.0f;
-                    chunkClouds[x][y].renderClouds(xOffset, yOffset, cloudHeight);
+            const LodBounds& bounds = slot.terrain.getLod().chunkBounds();
+            if (view.testBox(xOffset, yOffset, bounds.minZ,
+                    xOffset + CHUNK_SIZE, yOffset + CHUNK_SIZE, bounds.maxZ) == Frustum::OUTSIDE) {
+                ++renderStats.chunksCulled;
+                continue;
+            }
+            ++renderStats.chunksDrawn;
+            slot.mesh.render(slot.terrain, xOffset, yOffset, view, renderStats);
+        }
+        terrainRenderer.endFrame();
+
+        for (ChunkSlot& slot : slots) {
+            if (slot.state.load(std::memory_order_acquire) != SLOT_READY) continue;
+            if (!inRing(slot.chunkX, slot.chunkY)) continue;
+
+            // Chunks share their border row, so they are placed CHUNK_SIZE apart
+            float xOffset = static_cast<float>(slot.chunkX) * CHUNK_SIZE;
+            float yOffset = static_cast<float>(slot.chunkY) * CHUNK_SIZE;
+
+            // If clouds are enabled, render clouds for this chunk
+            if (cloudRenderingEnabled) {
+                float cloudHeight = slot.terrain.getMaxHeight() + 50.0f;
+                if (view.testBox(xOffset, yOffset, cloudHeight,
+                        xOffset + CHUNK_SIZE, yOffset + CHUNK_SIZE, cloudHeight) == Frustum::OUTSIDE) {
+                    continue;
                 }
+                slot.clouds.renderClouds(xOffset, yOffset, cloudHeight);
             }
         }
     }
 
+    // Highest cached chunk height over the loaded ring
     float getMaxHeight() const {
         float maxHeight = 0.0f;
-        for (const auto& row : heightMap) {
-            for (float height : row) {
-                maxHeight = std::max(maxHeight, height);
-            }
+        for (const ChunkSlot& slot : slots) {
+            if (slot.state.load(std::memory_order_acquire) != SLOT_READY) continue;
+            if (!inRing(slot.chunkX, slot.chunkY)) continue;
+            maxHeight = std::max(maxHeight, slot.terrain.getMaxHeight());
         }
-        return maxHeight * 90.0f;
+        return maxHeight;
     }
 
-    float getCurrentOffset() const { return currentOffset; }
-    float getMaxForwardDistance() const { return MAX_FORWARD_DISTANCE; }
+    const TerrainRenderStats& getRenderStats() const { return renderStats; }
+
+    // World-space ray cast against the loaded terrain, as drawn at full detail
+    bool raycast(const HeightRay& ray, HeightRayHit& hit) const {
+        return castRay(ray, hit, &HeightPyramid::intersect);
+    }
+
+    // Same result by stepping cell by cell; only for comparison
+    bool raycastMarching(const HeightRay& ray, HeightRayHit& hit) const {
+        return castRay(ray, hit, &HeightPyramid::intersectMarching);
+    }
+
+    // Cast count rays on the generation pool. found[i] says whether hits[i]
+    // was written. Call from the render thread, like update().
+    void raycastBatch(const HeightRay* rays, HeightRayHit* hits, bool* found, int count) {
+        const int raysPerTask = 256;
+        int tasks = (count + raysPerTask - 1) / raysPerTask;
+        generationPool.parallelFor(tasks, [&](int task) {
+            int end = std::min(count, (task + 1) * raysPerTask);
+            for (int i = task * raysPerTask; i < end; ++i) {
+                found[i] = raycast(rays[i], hits[i]);
+            }
+        });
+    }
+
+    // Material under a world position, or false when that chunk is not loaded
+    bool materialAt(float worldX, float worldY, TerrainMaterial& material) {
+        int cx = worldToChunk(worldX);
+        int cy = worldToChunk(worldY);
+        ChunkSlot& slot = slotFor(cx, cy);
+        if (slot.state.load(std::memory_order_acquire) != SLOT_READY) return false;
+        if (slot.chunkX != cx || slot.chunkY != cy) return false;
+
+        int x = static_cast<int>(std::lround(worldX - static_cast<float>(cx) * CHUNK_SIZE));
+        int y = static_cast<int>(std::lround(worldY - static_cast<float>(cy) * CHUNK_SIZE));
+        material = slot.terrain.getMaterial(std::min(x, CHUNK_SIZE), std::min(y, CHUNK_SIZE));
+        return true;
+    }
+
+    int getRingRadius() const { return ringRadius; }
 };
 
 
@@ -718,6 +1375,8 @@ void setupLighting() {
     glFogf(GL_FOG_END, 200.0f);
 }
 // Global variables
+ChunkCache* chunkCache = nullptr;
+ChunkCache* snapshotCache = nullptr;
 TerrainManager* terrainManager = nullptr;
 
 
@@ -729,7 +1388,7 @@ bool rightMouseButtonDown = false;
 
 
 AtmosphericRenderer* atmosphericRenderer = nullptr;
-CloudGenerator* cloudGenerator = nullptr;
+CloudLayer* cloudLayer = nullptr;
 
 bool renderClouds = true;
 
@@ -743,6 +1402,186 @@ void renderBitmapString(float x, float y, void* font, const char* string) {
     }
 }
 
+// Only counted in builds with FRACTALS_COUNT_ALLOCATIONS; includes generation
+// work finished on the pool threads during the frame
+long long allocationsBeforeFrame = 0;
+long long allocationsLastFrame = 0;
+
+// GPU time between marks placed in the command stream, from timestamp
+// queries. Results are read a few frames late, so the CPU never waits on the
+// GPU; a frame whose results still aren't in when its queries come round
+// again is dropped. Does nothing without timer query support.
+class GpuFrameTimer {
+public:
+    static const int MAX_PHASES = 8;
+
+private:
+    static const int FRAMES_IN_FLIGHT = 4;
+
+    struct Frame {
+        GLuint queries[MAX_PHASES + 1];  // Frame start, then the end of each phase
+        const char* names[MAX_PHASES];
+        RollingStats* stats[MAX_PHASES];
+        int phases = 0;
+        bool pending = false;
+    };
+
+    Frame frames[FRAMES_IN_FLIGHT];
+    int current;
+    bool initialized;
+    bool enabled;
+    Profiler* profiler;
+
+    // False if the GPU isn't done with the frame yet
+    bool resolve(Frame& frame) {
+        GLint available = 0;
+        glExt.getQueryObjectiv(frame.queries[frame.phases], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+
+        // The GPU clock has its own origin. Lining it up with the CPU clock
+        // through the current GPU time is close enough to place the events
+        // on the trace next to the CPU work that issued them.
+        long long gpuNow = 0;
+        glExt.getInteger64v(GL_TIMESTAMP, &gpuNow);
+        int64_t offset = profiler ? profiler->nanoseconds(Profiler::Clock::now()) - gpuNow : 0;
+
+        unsigned long long stamps[MAX_PHASES + 1];
+        for (int i = 0; i <= frame.phases; ++i) {
+            glExt.getQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamps[i]);
+        }
+        for (int i = 0; i < frame.phases; ++i) {
+            int64_t duration = static_cast<int64_t>(stamps[i + 1] - stamps[i]);
+            if (frame.stats[i]) frame.stats[i]->add(duration * 1e-6f);
+            if (profiler) {
+                profiler->record(frame.names[i], "gpu", static_cast<int64_t>(stamps[i]) + offset, duration,
+                    Profiler::GPU_THREAD);
+            }
+        }
+        frame.pending = false;
+        return true;
+    }
+
+public:
+    GpuFrameTimer() : current(0), initialized(false), enabled(false), profiler(nullptr) {}
+
+    void setProfiler(Profiler* target) { profiler = target; }
+    bool isEnabled() const { return enabled; }
+
+    // Needs a current context
+    void beginFrame() {
+        if (!initialized) {
+            initialized = true;
+            enabled = glExt.hasTimerQueries;
+            if (enabled) {
+                for (Frame& frame : frames) glExt.genQueries(MAX_PHASES + 1, frame.queries);
+            }
+        }
+        if (!enabled) return;
+
+        // Oldest first, starting with the frame about to be reused and
+        // stopping at the first one the GPU is still on
+        for (int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+            Frame& frame = frames[(current + i) % FRAMES_IN_FLIGHT];
+            if (frame.pending && !resolve(frame)) break;
+        }
+        Frame& frame = frames[current];
+        frame.pending = false;
+        frame.phases = 0;
+        glExt.queryCounter(frame.queries[0], GL_TIMESTAMP);
+    }
+
+    // Ends the phase that started at the previous mark
+    void mark(const char* name, RollingStats* stats) {
+        Frame& frame = frames[current];
+        if (!enabled || frame.phases == MAX_PHASES) return;
+        frame.names[frame.phases] = name;
+        frame.stats[frame.phases] = stats;
+        ++frame.phases;
+        glExt.queryCounter(frame.queries[frame.phases], GL_TIMESTAMP);
+    }
+
+    void endFrame() {
+        if (!enabled) return;
+        frames[current].pending = frames[current].phases > 0;
+        current = (current + 1) % FRAMES_IN_FLIGHT;
+    }
+};
+
+// Parts of display(), in order
+enum FramePhase {
+    FRAME_SKY,
+    FRAME_STREAMING,  // Recentering the chunk ring and queueing generation
+    FRAME_TERRAIN,
+    FRAME_CLOUDS,
+    FRAME_HUD,
+    FRAME_PHASE_COUNT
+};
+
+const char* const FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = { "sky", "streaming", "terrain", "clouds", "hud" };
+
+// Seconds of history written by the trace hotkey
+const double PROFILE_TRACE_SECONDS = 10.0;
+
+Profiler* profiler = nullptr;
+GpuFrameTimer gpuFrameTimer;
+RollingStats frameIntervals;  // Display start to display start, in ms
+RollingStats frameCpuTimes;   // Display start to after the buffer swap
+RollingStats phaseCpuTimes[FRAME_PHASE_COUNT];
+RollingStats phaseGpuTimes[FRAME_PHASE_COUNT];
+Profiler::Clock::time_point lastFrameStart;
+
+// Frame and generation timings, top right
+void displayProfile(int width, int height, void* font) {
+    float x = static_cast<float>(width - 470);
+    float y = static_cast<float>(height - 20);
+    char line[128];
+
+    float interval = frameIntervals.mean();
+    std::snprintf(line, sizeof(line), "Frame %.2f ms (%.0f fps)  p50 %.2f  p95 %.2f  p99 %.2f",
+        interval, interval > 0.0f ? 1000.0f / interval : 0.0f, frameIntervals.percentile(50.0f),
+        frameIntervals.percentile(95.0f), frameIntervals.percentile(99.0f));
+    renderBitmapString(x, y, font, line);
+    std::snprintf(line, sizeof(line), "CPU frame %.2f ms  p95 %.2f  p99 %.2f", frameCpuTimes.mean(),
+        frameCpuTimes.percentile(95.0f), frameCpuTimes.percentile(99.0f));
+    renderBitmapString(x, y - 20, font, line);
+
+    renderBitmapString(x, y - 45, font, gpuFrameTimer.isEnabled() ?
+        "Phase          CPU ms (p95)      GPU ms (p95)" : "Phase          CPU ms (p95)      (no GPU timers)");
+    for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase) {
+        const RollingStats& cpu = phaseCpuTimes[phase];
+        const RollingStats& gpu = phaseGpuTimes[phase];
+        int length = std::snprintf(line, sizeof(line), "%-12s %6.2f (%6.2f)", FRAME_PHASE_NAMES[phase],
+            cpu.mean(), cpu.percentile(95.0f));
+        if (gpuFrameTimer.isEnabled() && length > 0) {
+            std::snprintf(line + length, sizeof(line) - length, "    %6.2f (%6.2f)", gpu.mean(), gpu.percentile(95.0f));
+        }
+        renderBitmapString(x, y - 65 - 20 * phase, font, line);
+    }
+
+    float generationY = y - 75 - 20 * FRAME_PHASE_COUNT;
+    renderBitmapString(x, generationY, font, "Chunk generation   ms p50 / p95 (chunks)");
+    for (int stage = 0; stage < GENERATION_STAGE_COUNT; ++stage) {
+        RollingStats stats = terrainManager->getGenerationStats(static_cast<GenerationStage>(stage));
+        std::snprintf(line, sizeof(line), "%-16s %7.2f / %7.2f (%d)", GENERATION_STAGE_NAMES[stage],
+            stats.percentile(50.0f), stats.percentile(95.0f), stats.size());
+        renderBitmapString(x, generationY - 20 - 20 * stage, font, line);
+    }
+}
+
+// Last PROFILE_TRACE_SECONDS of frame and generation events, for
+// chrome://tracing or ui.perfetto.dev
+void dumpProfileTrace() {
+    char name[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "profile_%Y%m%d_%H%M%S.json", std::localtime(&now));
+    if (profiler->writeChromeTrace(name, PROFILE_TRACE_SECONDS)) {
+        std::printf("Wrote the last %.0f s of profile to %s\n", PROFILE_TRACE_SECONDS, name);
+    }
+    else {
+        std::printf("Could not write %s\n", name);
+    }
+}
+
 void displayInstructions() {
     
     glMatrixMode(GL_PROJECTION);
@@ -770,7 +1609,43 @@ void displayInstructions() {
     renderBitmapString(10, startY - 80, font, "Right Mouse: Look Around");
     renderBitmapString(10, startY - 100, font, "T/t: Advance/Rewind Time");
     renderBitmapString(10, startY - 120, font, "C: Toggle Cloud Rendering");
-    renderBitmapString(10, startY - 140, font, "ESC: Exit");
+    renderBitmapString(10, startY - 140, font, "N: New Cloud Pattern");
+    renderBitmapString(10, startY - 160, font, "Left Mouse: Pick Terrain");
+    renderBitmapString(10, startY - 180, font, "B: Ray Cast Benchmark");
+    renderBitmapString(10, startY - 200, font, "H: Toggle Hydraulic Erosion");
+    renderBitmapString(10, startY - 220, font, "P: Dump Profile Trace");
+    renderBitmapString(10, startY - 240, font, "r/R: Raise/Lower Roughness  i/I: Erosion Iterations");
+    renderBitmapString(10, startY - 260, font, "l/L, o/O: Terrain/Biome Noise Octaves");
+    renderBitmapString(10, startY - 280, font, "g/G, v/V: Terrain/Biome Noise Weight");
+    renderBitmapString(10, startY - 300, font, "ESC: Exit");
+
+    const TerrainRenderStats& renderStats = terrainManager->getRenderStats();
+    char stats[96];
+    TerrainParameters tuned = terrainManager->getParameters();
+    std::snprintf(stats, sizeof(stats), "Roughness %.2f  Erosion %d  Octaves %d/%d  Weights %.2f/%.2f",
+        tuned.roughness, tuned.erosionIterations, tuned.biome.terrainOctaves, tuned.biome.biomeOctaves,
+        tuned.biome.terrainWeight, tuned.biome.biomeWeight);
+    renderBitmapString(10, startY - 330, font, stats);
+    std::snprintf(stats, sizeof(stats), "Terrain triangles: %d", terrainRenderer.getTrianglesDrawn());
+    renderBitmapString(10, startY - 350, font, stats);
+    std::snprintf(stats, sizeof(stats), "Chunks drawn/culled: %d/%d  Patches drawn/culled: %d/%d",
+        renderStats.chunksDrawn, renderStats.chunksCulled, renderStats.patchesDrawn, renderStats.patchesCulled);
+    renderBitmapString(10, startY - 370, font, stats);
+    if (chunkCache) {
+        std::snprintf(stats, sizeof(stats), "Chunk cache: %lld loaded, %lld generated, %.1f MB",
+            chunkCache->hits(), chunkCache->misses(), chunkCache->sizeBytes() / (1024.0 * 1024.0));
+        renderBitmapString(10, startY - 390, font, stats);
+    }
+    if (terrainManager->getErosionMode() == EROSION_HYDRAULIC) {
+        std::snprintf(stats, sizeof(stats), "Hydraulic erosion: %.0f droplets/s",
+            terrainManager->getErosionDropletsPerSecond());
+        renderBitmapString(10, startY - 410, font, stats);
+    }
+    if (allocationCountingEnabled()) {
+        std::snprintf(stats, sizeof(stats), "Heap allocations last frame: %lld", allocationsLastFrame);
+        renderBitmapString(10, startY - 430, font, stats);
+    }
+    displayProfile(width, height, font);
     renderBitmapString(1530, 20, font, "Love Dewangan 500109339");
 
     // Restore previous states
@@ -783,12 +1658,7 @@ void displayInstructions() {
     glPopMatrix();
 }
 
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
-
-    atmosphericRenderer->applySkyAndLighting();
-
+void applyCameraView() {
     // Calculate look-at point based on camera orientation
     float lookAtX = cameraPosX + cos(cameraYaw) * cos(cameraPitch);
     float lookAtY = cameraPosY + sin(cameraYaw) * cos(cameraPitch);
@@ -799,21 +1669,78 @@ void display() {
         lookAtX, lookAtY, lookAtZ,           // Look-at point
         0.0f, 0.0f, 1.0f                    // Up vector
     );
+}
+
+// Same parameters as applyCameraView and gluPerspective in reshape
+Frustum cameraFrustum() {
+    float lookAtX = cameraPosX + cos(cameraYaw) * cos(cameraPitch);
+    float lookAtY = cameraPosY + sin(cameraYaw) * cos(cameraPitch);
+    float lookAtZ = cameraPosZ + sin(cameraPitch);
+
+    const float eye[3] = { cameraPosX, cameraPosY, cameraPosZ };
+    const float target[3] = { lookAtX, lookAtY, lookAtZ };
+    const float up[3] = { 0.0f, 0.0f, 1.0f };
+    return Frustum(eye, target, up, FIELD_OF_VIEW, viewAspect, NEAR_PLANE, FAR_PLANE);
+}
+
+void display() {
+    Profiler::Clock::time_point frameStart = Profiler::Clock::now();
+    if (lastFrameStart != Profiler::Clock::time_point()) {
+        frameIntervals.add(std::chrono::duration<float, std::milli>(frameStart - lastFrameStart).count());
+    }
+    lastFrameStart = frameStart;
+    gpuFrameTimer.beginFrame();
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glLoadIdentity();
+
+    {
+        ProfileScope scope(profiler, FRAME_PHASE_NAMES[FRAME_SKY], &phaseCpuTimes[FRAME_SKY]);
+        atmosphericRenderer->applySkyAndLighting();
+    }
+    gpuFrameTimer.mark(FRAME_PHASE_NAMES[FRAME_SKY], &phaseGpuTimes[FRAME_SKY]);
+
+    applyCameraView();
+    Frustum view = cameraFrustum();
 
     glEnable(GL_FOG);  
 
-    terrainManager->render();
+    {
+        ProfileScope scope(profiler, FRAME_PHASE_NAMES[FRAME_STREAMING], &phaseCpuTimes[FRAME_STREAMING]);
+        terrainManager->update(cameraPosX, cameraPosY);
+    }
+    gpuFrameTimer.mark(FRAME_PHASE_NAMES[FRAME_STREAMING], &phaseGpuTimes[FRAME_STREAMING]);
+    {
+        ProfileScope scope(profiler, FRAME_PHASE_NAMES[FRAME_TERRAIN], &phaseCpuTimes[FRAME_TERRAIN]);
+        terrainManager->render(view);
+    }
+    gpuFrameTimer.mark(FRAME_PHASE_NAMES[FRAME_TERRAIN], &phaseGpuTimes[FRAME_TERRAIN]);
 
     glDisable(GL_FOG);
 
-    if (renderClouds) {
-        cloudGenerator->renderClouds(0, 0, terrainManager->getMaxHeight() + 50.0f);
+    {
+        ProfileScope scope(profiler, FRAME_PHASE_NAMES[FRAME_CLOUDS], &phaseCpuTimes[FRAME_CLOUDS]);
+        if (renderClouds) {
+            cloudLayer->renderClouds(0, 0, terrainManager->getMaxHeight() + 50.0f);
+        }
     }
+    gpuFrameTimer.mark(FRAME_PHASE_NAMES[FRAME_CLOUDS], &phaseGpuTimes[FRAME_CLOUDS]);
 
-    
-    displayInstructions();
+    {
+        ProfileScope scope(profiler, FRAME_PHASE_NAMES[FRAME_HUD], &phaseCpuTimes[FRAME_HUD]);
+        displayInstructions();
+    }
+    gpuFrameTimer.mark(FRAME_PHASE_NAMES[FRAME_HUD], &phaseGpuTimes[FRAME_HUD]);
+    gpuFrameTimer.endFrame();
 
     glutSwapBuffers();
+    Profiler::Clock::time_point frameEnd = Profiler::Clock::now();
+    if (profiler) profiler->record("frame", "cpu", frameStart, frameEnd);
+    frameCpuTimes.add(std::chrono::duration<float, std::milli>(frameEnd - frameStart).count());
+
+    long long allocations = allocationCount();
+    allocationsLastFrame = allocations - allocationsBeforeFrame;
+    allocationsBeforeFrame = allocations;
 }
 
 
@@ -844,6 +1771,89 @@ void mouseMotion(int x, int y) {
     }
 }
 
+// World-space ray from the near to the far plane through window pixel (x, y)
+HeightRay pickRay(int x, int y) {
+    GLdouble modelview[16], projection[16];
+    GLint viewport[4];
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    applyCameraView();
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+    glPopMatrix();
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Through the pixel center; GLUT window coordinates start at the top
+    GLdouble windowX = x + 0.5;
+    GLdouble windowY = viewport[3] - y - 0.5;
+    GLdouble nearX, nearY, nearZ, farX, farY, farZ;
+    gluUnProject(windowX, windowY, 0.0, modelview, projection, viewport, &nearX, &nearY, &nearZ);
+    gluUnProject(windowX, windowY, 1.0, modelview, projection, viewport, &farX, &farY, &farZ);
+
+    HeightRay ray;
+    ray.originX = static_cast<float>(nearX);
+    ray.originY = static_cast<float>(nearY);
+    ray.originZ = static_cast<float>(nearZ);
+    ray.dirX = static_cast<float>(farX - nearX);
+    ray.dirY = static_cast<float>(farY - nearY);
+    ray.dirZ = static_cast<float>(farZ - nearZ);
+    ray.maxT = 1.0f;
+    return ray;
+}
+
+// Times the pyramid ray cast against cell-by-cell marching on rays fanned out
+// from the camera, and checks that both find the same hits.
+void benchmarkRaycasts() {
+    const int rayCount = 100000;
+    std::vector<HeightRay> rays(rayCount);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> yawDist(0.0f, 2.0f * static_cast<float>(M_PI));
+    std::uniform_real_distribution<float> pitchDist(-1.2f, -0.02f);
+    for (HeightRay& ray : rays) {
+        float yaw = yawDist(rng);
+        float pitch = pitchDist(rng);
+        ray = { cameraPosX, cameraPosY, cameraPosZ,
+            std::cos(yaw) * std::cos(pitch), std::sin(yaw) * std::cos(pitch), std::sin(pitch), 2.0f * FAR_PLANE };
+    }
+
+    std::vector<HeightRayHit> marchHits(rayCount), pyramidHits(rayCount), batchHits(rayCount);
+    std::vector<char> marchFound(rayCount), pyramidFound(rayCount);
+    std::unique_ptr<bool[]> batchFound(new bool[rayCount]);
+
+    auto seconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rayCount; ++i) marchFound[i] = terrainManager->raycastMarching(rays[i], marchHits[i]);
+    double marchTime = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rayCount; ++i) pyramidFound[i] = terrainManager->raycast(rays[i], pyramidHits[i]);
+    double pyramidTime = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    terrainManager->raycastBatch(rays.data(), batchHits.data(), batchFound.get(), rayCount);
+    double batchTime = seconds(start);
+
+    int hits = 0, mismatches = 0;
+    for (int i = 0; i < rayCount; ++i) {
+        hits += pyramidFound[i] ? 1 : 0;
+        bool same = marchFound[i] == pyramidFound[i] && batchFound[i] == static_cast<bool>(pyramidFound[i]);
+        if (same && pyramidFound[i]) {
+            same = std::abs(marchHits[i].t - pyramidHits[i].t) <= 1e-3f && batchHits[i].t == pyramidHits[i].t;
+        }
+        mismatches += same ? 0 : 1;
+    }
+
+    std::printf("Ray cast benchmark: %d rays, %d hits, %d mismatches\n", rayCount, hits, mismatches);
+    std::printf("  marching: %8.1f ms (%.2f Mrays/s)\n", marchTime * 1000.0, rayCount / marchTime * 1e-6);
+    std::printf("  pyramid:  %8.1f ms (%.2f Mrays/s)\n", pyramidTime * 1000.0, rayCount / pyramidTime * 1e-6);
+    std::printf("  batched:  %8.1f ms (%.2f Mrays/s)\n", batchTime * 1000.0, rayCount / batchTime * 1e-6);
+}
+
 void mouseButton(int button, int state, int x, int y) {
     
     if (button == GLUT_RIGHT_BUTTON) {
@@ -859,12 +1869,54 @@ void mouseButton(int button, int state, int x, int y) {
     
     else if (button == GLUT_LEFT_BUTTON) {
         if (state == GLUT_DOWN) {
-            
-            std::cout << "Left mouse button clicked at (" << x << ", " << y << ")" << std::endl;
+            HeightRayHit hit;
+            TerrainMaterial material;
+            if (!terrainManager->raycast(pickRay(x, y), hit)) {
+                std::cout << "Left mouse button clicked at (" << x << ", " << y << "): no terrain" << std::endl;
+            }
+            else if (terrainManager->materialAt(hit.x, hit.y, material)) {
+                std::cout << "Terrain hit at (" << hit.x << ", " << hit.y << ", " << hit.z << "): "
+                    << MATERIAL_NAMES[material] << std::endl;
+            }
         }
     }
 }
 
+// Lowercase raises a generation parameter, uppercase lowers it. False if
+// key isn't one of them.
+bool tuneTerrain(unsigned char key) {
+    TerrainParameters tuned = terrainManager->getParameters();
+    BiomeSettings& biome = tuned.biome;
+    int step = std::islower(key) ? 1 : -1;
+    switch (std::tolower(key)) {
+    case 'r':
+        tuned.roughness = std::clamp(tuned.roughness + 0.05f * step, 0.3f, 1.2f);
+        break;
+    case 'i':
+        tuned.erosionIterations = std::clamp(tuned.erosionIterations + 2 * step, 0, 40);
+        break;
+    case 'l':
+        biome.terrainOctaves = std::clamp(biome.terrainOctaves + step, 1, 10);
+        break;
+    case 'o':
+        biome.biomeOctaves = std::clamp(biome.biomeOctaves + step, 1, 10);
+        break;
+    case 'g':
+        biome.terrainWeight = std::clamp(biome.terrainWeight + 0.02f * step, 0.0f, 0.4f);
+        break;
+    case 'v':
+        biome.biomeWeight = std::clamp(biome.biomeWeight + 0.02f * step, 0.0f, 0.4f);
+        break;
+    default:
+        return false;
+    }
+    terrainManager->setParameters(tuned);
+    std::printf("Roughness %.2f, erosion %d, octaves %d/%d, weights %.2f/%.2f, regenerating terrain\n",
+        tuned.roughness, tuned.erosionIterations, biome.terrainOctaves, biome.biomeOctaves,
+        biome.terrainWeight, biome.biomeWeight);
+    return true;
+}
+
 void keyboard(unsigned char key, int x, int y) {
     float moveSpeed = 7.0f;
 
@@ -878,13 +1930,11 @@ void keyboard(unsigned char key, int x, int y) {
     case 'w':  
         cameraPosX += forwardX * moveSpeed;
         cameraPosY += forwardY * moveSpeed;
-        terrainManager->moveForward(MOVE_SPEED);
         break;
 
     case 's':  
         cameraPosX -= forwardX * moveSpeed;
         cameraPosY -= forwardY * moveSpeed;
-        terrainManager->moveBackward(MOVE_SPEED);
         break;
 
     case 'a':  
@@ -913,6 +1963,31 @@ void keyboard(unsigned char key, int x, int y) {
         atmosphericRenderer->updateTime(-1.0f);
         break;
 
+    case 'b':
+        benchmarkRaycasts();
+        break;
+
+    case 'h': {
+        bool hydraulic = terrainManager->getErosionMode() != EROSION_HYDRAULIC;
+        terrainManager->setErosionMode(hydraulic ? EROSION_HYDRAULIC : EROSION_THERMAL);
+        std::cout << (hydraulic ? "Hydraulic" : "Thermal") << " erosion, regenerating terrain" << std::endl;
+        break;
+    }
+
+    case 'n': {
+        auto start = std::chrono::steady_clock::now();
+        terrainManager->reseedClouds();
+        cloudLayer->regenerateClouds(hashCombine(12345u, terrainManager->getCloudEpoch()));
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("Clouds regenerated in %.2f ms\n", milliseconds);
+        break;
+    }
+
+    case 'p':
+    case 'P':
+        dumpProfileTrace();
+        break;
+
     case 'c':  
         terrainManager->toggleCloudRendering();
         std::cout << "Clouds " << (renderClouds ? "enabled" : "disabled") << std::endl;
@@ -921,6 +1996,10 @@ void keyboard(unsigned char key, int x, int y) {
     case 27:
         exit(0);
         break;
+
+    default:
+        tuneTerrain(key);
+        break;
     }
 
     glutPostRedisplay();
@@ -929,8 +2008,11 @@ void reshape(int w, int h) {
     glViewport(0, 0, w, h);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(60.0f, (float)w / (float)h, 0.1f, 500.0f);
+    viewAspect = (float)w / (float)h;
+    gluPerspective(FIELD_OF_VIEW, viewAspect, NEAR_PLANE, FAR_PLANE);
     glMatrixMode(GL_MODELVIEW);
+
+    terrainRenderer.setLodSettings(LodSettings::fromScreenError((float)h, FIELD_OF_VIEW, LOD_PIXEL_ERROR));
 }
 
 
@@ -940,15 +2022,25 @@ int main(int argc, char** argv) {
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(1920, 1080);
     glutCreateWindow("Dynamic Terrain Generation");
+    glExt.load(glutGetProcAddress);
 
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.6f, 0.7f, 0.8f, 1.0f);  // Sky color
 
-    
-    terrainManager = new TerrainManager();
+    profiler = new Profiler();
+    profiler->setThreadName("main");
+    gpuFrameTimer.setProfiler(profiler);
+
+    // Chunks generated on earlier runs load from disk instead, along with
+    // their stage snapshots for live tuning
+    chunkCache = new ChunkCache();
+    ChunkCacheSettings snapshotSettings;
+    snapshotSettings.directory = "chunk_cache/stages";
+    snapshotCache = new ChunkCache(snapshotSettings);
+    terrainManager = new TerrainManager(12345, DEFAULT_RING_RADIUS, 0, chunkCache, profiler, snapshotCache);
     
     atmosphericRenderer = new AtmosphericRenderer();
-    cloudGenerator = new CloudGenerator();
+    cloudLayer = new CloudLayer();
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
@@ -962,5 +2054,8 @@ int main(int argc, char** argv) {
     glutMainLoop();
 
     delete terrainManager;
+    delete chunkCache;
+    delete snapshotCache;
+    delete profiler;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cmath>
+
+// View frustum built from the same parameters as gluLookAt/gluPerspective,
+// as six inward-facing planes. Used to skip chunks and LOD patches whose
+// bounding boxes are entirely outside the view.
+class Frustum {
+public:
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+private:
+    struct Plane {
+        float nx, ny, nz, d;  // Inside where nx*x + ny*y + nz*z + d >= 0
+
+        float distance(float x, float y, float z) const { return nx * x + ny * y + nz * z + d; }
+    };
+
+    Plane planes[6];
+
+    static void cross(const float a[3], const float b[3], float out[3]) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    static void normalize(float v[3]) {
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length > 0.0f) {
+            v[0] /= length; v[1] /= length; v[2] /= length;
+        }
+    }
+
+    // Plane through p with normal n, flipped if needed to face along inward
+    static Plane makePlane(const float n[3], const float p[3], const float inward[3]) {
+        float normal[3] = { n[0], n[1], n[2] };
+        normalize(normal);
+        if (normal[0] * inward[0] + normal[1] * inward[1] + normal[2] * inward[2] < 0.0f) {
+            normal[0] = -normal[0]; normal[1] = -normal[1]; normal[2] = -normal[2];
+        }
+        return { normal[0], normal[1], normal[2],
+            -(normal[0] * p[0] + normal[1] * p[1] + normal[2] * p[2]) };
+    }
+
+public:
+    Frustum() : planes() {}
+
+    Frustum(const float eye[3], const float target[3], const float up[3],
+        float fovYDegrees, float aspect, float nearPlane, float farPlane) {
+        float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+        normalize(forward);
+        float side[3];
+        cross(forward, up, side);
+        normalize(side);
+        float trueUp[3];
+        cross(side, forward, trueUp);
+
+        float tanY = std::tan(fovYDegrees * 0.5f * 3.14159265358979323846f / 180.0f);
+        float tanX = tanY * aspect;
+
+        float nearPoint[3], farPoint[3];
+        for (int i = 0; i < 3; ++i) {
+            nearPoint[i] = eye[i] + forward[i] * nearPlane;
+            farPoint[i] = eye[i] + forward[i] * farPlane;
+        }
+        float backward[3] = { -forward[0], -forward[1], -forward[2] };
+        planes[0] = makePlane(forward, nearPoint, forward);
+        planes[1] = makePlane(backward, farPoint, backward);
+
+        // Side planes contain the eye and one edge direction of the view pyramid
+        float edges[4][3];
+        for (int i = 0; i < 3; ++i) {
+            edges[0][i] = forward[i] + side[i] * tanX;     // Right
+            edges[1][i] = forward[i] - side[i] * tanX;     // Left
+            edges[2][i] = forward[i] + trueUp[i] * tanY;   // Top
+            edges[3][i] = forward[i] - trueUp[i] * tanY;   // Bottom
+        }
+        float normal[3];
+        cross(trueUp, edges[0], normal); planes[2] = makePlane(normal, eye, forward);
+        cross(trueUp, edges[1], normal); planes[3] = makePlane(normal, eye, forward);
+        cross(side, edges[2], normal);   planes[4] = makePlane(normal, eye, forward);
+        cross(side, edges[3], normal);   planes[5] = makePlane(normal, eye, forward);
+    }
+
+    // The same frustum in a space whose origin sits at (x, y, z), e.g. a
+    // chunk's local coordinates
+    Frustum translated(float x, float y, float z) const {
+        Frustum result = *this;
+        for (Plane& plane : result.planes) {
+            plane.d += plane.nx * x + plane.ny * y + plane.nz * z;
+        }
+        return result;
+    }
+
+    Result testBox(float minX, float minY, float minZ, float maxX, float maxY, float maxZ) const {
+        Result result = INSIDE;
+        for (const Plane& plane : planes) {
+            // Box corners furthest along and against the plane normal
+            float px = plane.nx >= 0.0f ? maxX : minX;
+            float py = plane.ny >= 0.0f ? maxY : minY;
+            float pz = plane.nz >= 0.0f ? maxZ : minZ;
+            if (plane.distance(px, py, pz) < 0.0f) return OUTSIDE;
+
+            float qx = plane.nx >= 0.0f ? minX : maxX;
+            float qy = plane.ny >= 0.0f ? minY : maxY;
+            float qz = plane.nz >= 0.0f ? minZ : maxZ;
+            if (plane.distance(qx, qy, qz) < 0.0f) result = INTERSECTS;
+        }
+        return result;
+    }
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <freeglut.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Entry points above OpenGL 1.1. The Windows SDK gl.h stops at 1.1, so the
+// few newer functions the renderer needs are declared and loaded here rather
+// than pulling in a loader library. Everything is optional: callers check the
+// has* flags and fall back to 1.1 paths when a feature is missing.
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_VERSION_1_5
+typedef std::ptrdiff_t GLsizeiptr;
+typedef std::ptrdiff_t GLintptr;
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+#ifndef GL_VERSION_2_0
+typedef char GLchar;
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_INFO_LOG_LENGTH
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+
+typedef void (*GLProc)();
+typedef GLProc (*GLProcLoader)(const char* name);
+
+struct GLExtensions {
+    // Buffer objects (GL 1.5)
+    void (APIENTRY* genBuffers)(GLsizei n, GLuint* buffers) = nullptr;
+    void (APIENTRY* deleteBuffers)(GLsizei n, const GLuint* buffers) = nullptr;
+    void (APIENTRY* bindBuffer)(GLenum target, GLuint buffer) = nullptr;
+    void (APIENTRY* bufferData)(GLenum target, GLsizeiptr size, const void* data, GLenum usage) = nullptr;
+    void (APIENTRY* bufferSubData)(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) = nullptr;
+
+    // GLSL programs (GL 2.0)
+    GLuint (APIENTRY* createShader)(GLenum type) = nullptr;
+    void (APIENTRY* shaderSource)(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths) = nullptr;
+    void (APIENTRY* compileShader)(GLuint shader) = nullptr;
+    void (APIENTRY* getShaderiv)(GLuint shader, GLenum name, GLint* value) = nullptr;
+    void (APIENTRY* getShaderInfoLog)(GLuint shader, GLsizei size, GLsizei* length, GLchar* log) = nullptr;
+    void (APIENTRY* deleteShader)(GLuint shader) = nullptr;
+    GLuint (APIENTRY* createProgram)() = nullptr;
+    void (APIENTRY* attachShader)(GLuint program, GLuint shader) = nullptr;
+    void (APIENTRY* linkProgram)(GLuint program) = nullptr;
+    void (APIENTRY* getProgramiv)(GLuint program, GLenum name, GLint* value) = nullptr;
+    void (APIENTRY* getProgramInfoLog)(GLuint program, GLsizei size, GLsizei* length, GLchar* log) = nullptr;
+    void (APIENTRY* deleteProgram)(GLuint program) = nullptr;
+    void (APIENTRY* useProgram)(GLuint program) = nullptr;
+    GLint (APIENTRY* getUniformLocation)(GLuint program, const GLchar* name) = nullptr;
+    void (APIENTRY* uniform1i)(GLint location, GLint v0) = nullptr;
+    void (APIENTRY* uniform1f)(GLint location, GLfloat v0) = nullptr;
+    void (APIENTRY* uniform2f)(GLint location, GLfloat v0, GLfloat v1) = nullptr;
+    void (APIENTRY* uniform3f)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) = nullptr;
+
+    // Timestamp queries (GL 3.3 or ARB_timer_query). 64-bit values are
+    // spelled out, since GLint64/GLuint64 are missing from old headers.
+    void (APIENTRY* genQueries)(GLsizei n, GLuint* ids) = nullptr;
+    void (APIENTRY* deleteQueries)(GLsizei n, const GLuint* ids) = nullptr;
+    void (APIENTRY* queryCounter)(GLuint id, GLenum target) = nullptr;
+    void (APIENTRY* getQueryObjectiv)(GLuint id, GLenum name, GLint* value) = nullptr;
+    void (APIENTRY* getQueryObjectui64v)(GLuint id, GLenum name, unsigned long long* value) = nullptr;
+    void (APIENTRY* getInteger64v)(GLenum name, long long* value) = nullptr;
+
+    bool hasBufferObjects = false;
+    bool hasShaders = false;
+    bool hasTimerQueries = false;
+
+    // Proc addresses can resolve for functions the driver doesn't support,
+    // so the version or extension string decides
+    static bool timerQueriesSupported() {
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+        if (version && std::sscanf(version, "%d.%d", &major, &minor) == 2 &&
+            (major > 3 || (major == 3 && minor >= 3))) {
+            return true;
+        }
+        const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        return extensions && std::strstr(extensions, "GL_ARB_timer_query");
+    }
+
+    template <typename Fn>
+    static bool resolve(GLProcLoader loader, const char* name, Fn& function) {
+        function = reinterpret_cast<Fn>(loader(name));
+        return function != nullptr;
+    }
+
+    // Needs a current context. Safe to call again after a context change.
+    void load(GLProcLoader loader) {
+        hasBufferObjects =
+            resolve(loader, "glGenBuffers", genBuffers) &
+            resolve(loader, "glDeleteBuffers", deleteBuffers) &
+            resolve(loader, "glBindBuffer", bindBuffer) &
+            resolve(loader, "glBufferData", bufferData) &
+            resolve(loader, "glBufferSubData", bufferSubData);
+
+        hasShaders =
+            resolve(loader, "glCreateShader", createShader) &
+            resolve(loader, "glShaderSource", shaderSource) &
+            resolve(loader, "glCompileShader", compileShader) &
+            resolve(loader, "glGetShaderiv", getShaderiv) &
+            resolve(loader, "glGetShaderInfoLog", getShaderInfoLog) &
+            resolve(loader, "glDeleteShader", deleteShader) &
+            resolve(loader, "glCreateProgram", createProgram) &
+            resolve(loader, "glAttachShader", attachShader) &
+            resolve(loader, "glLinkProgram", linkProgram) &
+            resolve(loader, "glGetProgramiv", getProgramiv) &
+            resolve(loader, "glGetProgramInfoLog", getProgramInfoLog) &
+            resolve(loader, "glDeleteProgram", deleteProgram) &
+            resolve(loader, "glUseProgram", useProgram) &
+            resolve(loader, "glGetUniformLocation", getUniformLocation) &
+            resolve(loader, "glUniform1i", uniform1i) &
+            resolve(loader, "glUniform1f", uniform1f) &
+            resolve(loader, "glUniform2f", uniform2f) &
+            resolve(loader, "glUniform3f", uniform3f);
+
+        hasTimerQueries =
+            resolve(loader, "glGenQueries", genQueries) &
+            resolve(loader, "glDeleteQueries", deleteQueries) &
+            resolve(loader, "glQueryCounter", queryCounter) &
+            resolve(loader, "glGetQueryObjectiv", getQueryObjectiv) &
+            resolve(loader, "glGetQueryObjectui64v", getQueryObjectui64v) &
+            resolve(loader, "glGetInteger64v", getInteger64v) &&
+            timerQueriesSupported();
+    }
+};
+
+inline GLExtensions glExt;
+
+inline GLuint compileShaderStage(GLenum type, const char* source, const char* label) {
+    GLuint shader = glExt.createShader(type);
+    glExt.shaderSource(shader, 1, &source, nullptr);
+    glExt.compileShader(shader);
+
+    GLint status = 0;
+    glExt.getShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        GLint length = 0;
+        glExt.getShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<GLchar> log(length + 1, '\0');
+        glExt.getShaderInfoLog(shader, length, nullptr, log.data());
+        std::cerr << label << ": shader compile failed\n" << log.data() << std::endl;
+        glExt.deleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Returns 0 (and logs why) when shaders are unavailable or fail to build, so
+// callers can keep their fixed-function path.
+inline GLuint buildShaderProgram(const char* vertexSource, const char* fragmentSource, const char* label) {
+    if (!glExt.hasShaders) return 0;
+
+    GLuint vertexShader = compileShaderStage(GL_VERTEX_SHADER, vertexSource, label);
+    GLuint fragmentShader = compileShaderStage(GL_FRAGMENT_SHADER, fragmentSource, label);
+    if (!vertexShader || !fragmentShader) {
+        if (vertexShader) glExt.deleteShader(vertexShader);
+        if (fragmentShader) glExt.deleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glExt.createProgram();
+    glExt.attachShader(program, vertexShader);
+    glExt.attachShader(program, fragmentShader);
+    glExt.linkProgram(program);
+    glExt.deleteShader(vertexShader);
+    glExt.deleteShader(fragmentShader);
+
+    GLint status = 0;
+    glExt.getProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        GLint length = 0;
+        glExt.getProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<GLchar> log(length + 1, '\0');
+        glExt.getProgramInfoLog(program, length, nullptr, log.data());
+        std::cerr << label << ": program link failed\n" << log.data() << std::endl;
+        glExt.deleteProgram(program);
+        return 0;
+    }
+    return program;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+// Stateless integer hashing for deriving seeds and per-sample random values
+// from coordinates. Results depend only on the inputs, never on call order.
+
+inline uint32_t hashMix(uint32_t h) {
+    // Murmur3 finalizer
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t value) {
+    return hashMix(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline uint32_t hashCoords(uint32_t seed, int x, int y) {
+    return hashCombine(hashCombine(seed, static_cast<uint32_t>(x)), static_cast<uint32_t>(y));
+}
+
+// Map a hash to a float in [0, 1)
+inline float hashToUnitFloat(uint32_t h) {
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// Map a hash to a float in [-1, 1)
+inline float hashToSignedUnitFloat(uint32_t h) {
+    return (h >> 8) * (1.0f / 8388608.0f) - 1.0f;
+}
+
+// 64-bit variants, for keys that must not collide across many inputs
+inline uint64_t hashMix64(uint64_t h) {
+    // SplitMix64 finalizer
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+inline uint64_t hashCombine64(uint64_t seed, uint64_t value) {
+    return hashMix64(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
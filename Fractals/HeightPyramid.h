@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "Heightfield.h"
+
+// Ray in heightfield coordinates: points are origin + t * direction for t in
+// [0, maxT]. The direction does not need to be normalized; t is in its units.
+struct HeightRay {
+    float originX, originY, originZ;
+    float dirX, dirY, dirZ;
+    float maxT;
+};
+
+struct HeightRayHit {
+    float t;
+    float x, y, z;
+    int cellX, cellY;
+};
+
+/*
+Max-height pyramid over a heightfield, for ray casting against the surface
+as drawn at full resolution (two triangles per cell, split along the same
+diagonal as the terrain index buffers).
+
+Level 0 holds the highest corner of every cell, and each level above holds
+the maximum of the 2x2 block below it, up to a single value for the whole
+grid. A ray walks the pyramid front to back and only descends into nodes it
+passes beneath, so open sky is skipped a whole node at a time instead of
+cell by cell. A matching min pyramid does the same for rays that run under
+the surface (a camera below the terrain, or rays leaving a hill).
+*/
+class HeightPyramid {
+private:
+    ConstHeightfieldView heights;
+    int cells;  // Cells per side, a power of two
+    std::vector<Heightfield> levels;     // Max heights
+    std::vector<Heightfield> minLevels;  // Min heights, same layout
+
+    static bool clipAxis(float origin, float direction, float low, float high, float& tNear, float& tFar) {
+        if (direction == 0.0f) return origin >= low && origin <= high;
+        float inverse = 1.0f / direction;
+        float t0 = (low - origin) * inverse;
+        float t1 = (high - origin) * inverse;
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+        return tNear <= tFar;
+    }
+
+    // Parametric range where the ray is inside the node's footprint and height range
+    bool clipNode(const HeightRay& ray, int level, int nodeX, int nodeY, float tMax,
+        float& tNear, float& tFar) const {
+        float size = static_cast<float>(1 << level);
+        float minX = nodeX * size;
+        float minY = nodeY * size;
+        tNear = 0.0f;
+        tFar = tMax;
+        return clipAxis(ray.originX, ray.dirX, minX, minX + size, tNear, tFar) &&
+            clipAxis(ray.originY, ray.dirY, minY, minY + size, tNear, tFar) &&
+            clipAxis(ray.originZ, ray.dirZ, minLevels[level](nodeX, nodeY), levels[level](nodeX, nodeY), tNear, tFar);
+    }
+
+    static bool intersectTriangle(const HeightRay& ray, const float a[3], const float b[3], const float c[3],
+        float tMax, float& t) {
+        // Moller-Trumbore
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float p[3] = {
+            ray.dirY * e2[2] - ray.dirZ * e2[1],
+            ray.dirZ * e2[0] - ray.dirX * e2[2],
+            ray.dirX * e2[1] - ray.dirY * e2[0] };
+        float determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (std::abs(determinant) < 1e-12f) return false;
+        float inverse = 1.0f / determinant;
+
+        float s[3] = { ray.originX - a[0], ray.originY - a[1], ray.originZ - a[2] };
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+        if (u < 0.0f || u > 1.0f) return false;
+        float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        float v = (ray.dirX * q[0] + ray.dirY * q[1] + ray.dirZ * q[2]) * inverse;
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        float hitT = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+        if (hitT < 0.0f || hitT > tMax) return false;
+        t = hitT;
+        return true;
+    }
+
+    bool intersectCell(const HeightRay& ray, int x, int y, float tMax, HeightRayHit& hit) const {
+        float fx = static_cast<float>(x);
+        float fy = static_cast<float>(y);
+        float v00[3] = { fx, fy, heights(x, y) };
+        float v10[3] = { fx + 1.0f, fy, heights(x + 1, y) };
+        float v01[3] = { fx, fy + 1.0f, heights(x, y + 1) };
+        float v11[3] = { fx + 1.0f, fy + 1.0f, heights(x + 1, y + 1) };
+
+        float t = tMax;
+        bool found = false;
+        float candidate;
+        if (intersectTriangle(ray, v00, v10, v01, t, candidate)) { t = candidate; found = true; }
+        if (intersectTriangle(ray, v10, v11, v01, t, candidate)) { t = candidate; found = true; }
+        if (!found) return false;
+
+        hit.t = t;
+        hit.x = ray.originX + ray.dirX * t;
+        hit.y = ray.originY + ray.dirY * t;
+        hit.z = ray.originZ + ray.dirZ * t;
+        hit.cellX = x;
+        hit.cellY = y;
+        return true;
+    }
+
+    bool intersectNode(const HeightRay& ray, int level, int nodeX, int nodeY, float tMax, HeightRayHit& hit) const {
+        if (level == 0) return intersectCell(ray, nodeX, nodeY, tMax, hit);
+
+        // Children in the order the ray reaches them. Their footprints are
+        // disjoint, so the first child with a hit holds the nearest one.
+        struct Child { float tNear; int x, y; };
+        Child children[4];
+        int count = 0;
+        for (int child = 0; child < 4; ++child) {
+            int childX = nodeX * 2 + (child >> 1);
+            int childY = nodeY * 2 + (child & 1);
+            float tNear, tFar;
+            if (!clipNode(ray, level - 1, childX, childY, tMax, tNear, tFar)) continue;
+
+            int slot = count++;
+            while (slot > 0 && children[slot - 1].tNear > tNear) {
+                children[slot] = children[slot - 1];
+                --slot;
+            }
+            children[slot] = { tNear, childX, childY };
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (intersectNode(ray, level - 1, children[i].x, children[i].y, tMax, hit)) return true;
+        }
+        return false;
+    }
+
+public:
+    HeightPyramid() : cells(0) {}
+
+    // heights is a (cells + 1)^2 grid of corner heights with cells a power of
+    // two. It is referenced, not copied, and must outlive the pyramid's use.
+    void build(ConstHeightfieldView cornerHeights) {
+        heights = cornerHeights;
+        cells = cornerHeights.rows() - 1;
+
+        int levelCount = 1;
+        while ((1 << (levelCount - 1)) < cells) ++levelCount;
+        levels.resize(levelCount);
+        minLevels.resize(levelCount);
+
+        levels[0].resize(cells, cells);
+        minLevels[0].resize(cells, cells);
+        for (int x = 0; x < cells; ++x) {
+            const float* row = heights.row(x);
+            const float* next = heights.row(x + 1);
+            float* high = levels[0].row(x);
+            float* low = minLevels[0].row(x);
+            for (int y = 0; y < cells; ++y) {
+                high[y] = std::max(std::max(row[y], row[y + 1]), std::max(next[y], next[y + 1]));
+                low[y] = std::min(std::min(row[y], row[y + 1]), std::min(next[y], next[y + 1]));
+            }
+        }
+
+        for (int l = 1; l < levelCount; ++l) {
+            int side = cells >> l;
+            levels[l].resize(side, side);
+            minLevels[l].resize(side, side);
+            for (int x = 0; x < side; ++x) {
+                const float* highRow = levels[l - 1].row(x * 2);
+                const float* highNext = levels[l - 1].row(x * 2 + 1);
+                const float* lowRow = minLevels[l - 1].row(x * 2);
+                const float* lowNext = minLevels[l - 1].row(x * 2 + 1);
+                float* high = levels[l].row(x);
+                float* low = minLevels[l].row(x);
+                for (int y = 0; y < side; ++y) {
+                    high[y] = std::max(std::max(highRow[y * 2], highRow[y * 2 + 1]),
+                        std::max(highNext[y * 2], highNext[y * 2 + 1]));
+                    low[y] = std::min(std::min(lowRow[y * 2], lowRow[y * 2 + 1]),
+                        std::min(lowNext[y * 2], lowNext[y * 2 + 1]));
+                }
+            }
+        }
+    }
+
+    // Nearest hit along the ray, using the pyramid to skip empty space
+    bool intersect(const HeightRay& ray, HeightRayHit& hit) const {
+        if (levels.empty()) return false;
+        int top = static_cast<int>(levels.size()) - 1;
+        float tNear, tFar;
+        if (!clipNode(ray, top, 0, 0, ray.maxT, tNear, tFar)) return false;
+        return intersectNode(ray, top, 0, 0, ray.maxT, hit);
+    }
+
+    // Reference version: visits every cell under the ray in order (2D DDA)
+    // and tests its triangles. Same results as intersect, kept for comparison.
+    bool intersectMarching(const HeightRay& ray, HeightRayHit& hit) const {
+        if (levels.empty()) return false;
+        float tNear = 0.0f;
+        float tFar = ray.maxT;
+        float size = static_cast<float>(cells);
+        if (!clipAxis(ray.originX, ray.dirX, 0.0f, size, tNear, tFar) ||
+            !clipAxis(ray.originY, ray.dirY, 0.0f, size, tNear, tFar)) {
+            return false;
+        }
+
+        float startX = ray.originX + ray.dirX * tNear;
+        float startY = ray.originY + ray.dirY * tNear;
+        int x = std::min(std::max(static_cast<int>(std::floor(startX)), 0), cells - 1);
+        int y = std::min(std::max(static_cast<int>(std::floor(startY)), 0), cells - 1);
+        int stepX = ray.dirX > 0.0f ? 1 : -1;
+        int stepY = ray.dirY > 0.0f ? 1 : -1;
+        float deltaX = ray.dirX != 0.0f ? std::abs(1.0f / ray.dirX) : FLT_MAX;
+        float deltaY = ray.dirY != 0.0f ? std::abs(1.0f / ray.dirY) : FLT_MAX;
+        float nextX = ray.dirX != 0.0f ? ((stepX > 0 ? x + 1 : x) - ray.originX) / ray.dirX : FLT_MAX;
+        float nextY = ray.dirY != 0.0f ? ((stepY > 0 ? y + 1 : y) - ray.originY) / ray.dirY : FLT_MAX;
+
+        for (;;) {
+            if (intersectCell(ray, x, y, tFar, hit)) return true;
+            if (nextX < nextY) {
+                if (nextX > tFar) return false;
+                x += stepX;
+                nextX += deltaX;
+            }
+            else {
+                if (nextY > tFar) return false;
+                y += stepY;
+                nextY += deltaY;
+            }
+            if (x < 0 || y < 0 || x >= cells || y >= cells) return false;
+        }
+    }
+
+    int levelCount() const { return static_cast<int>(levels.size()); }
+    float maxHeight() const { return levels.empty() ? 0.0f : levels.back()(0, 0); }
+};
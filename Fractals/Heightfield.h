@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Flat 2D storage for terrain layers.
+//
+// Rows are indexed by x and are contiguous in y, matching the old
+// heightMap[x][y] layout, so a pass that walks y in its inner loop reads
+// memory linearly. Every row starts on a 64-byte boundary: the stride is the
+// row length rounded up to a whole cache line.
+
+constexpr std::size_t GRID_ALIGNMENT = 64;
+
+// Non-owning window into a Grid (or any strided buffer).
+template <typename T>
+class GridView {
+private:
+    T* base;
+    int numRows;
+    int numCols;
+    std::ptrdiff_t rowStride;
+
+public:
+    GridView() : base(nullptr), numRows(0), numCols(0), rowStride(0) {}
+
+    GridView(T* data, int rows, int cols, std::ptrdiff_t stride)
+        : base(data), numRows(rows), numCols(cols), rowStride(stride) {}
+
+    // Allow GridView<float> -> GridView<const float>
+    template <typename U, typename = std::enable_if_t<std::is_same<const U, T>::value>>
+    GridView(const GridView<U>& other)
+        : base(other.data()), numRows(other.rows()), numCols(other.cols()), rowStride(other.stride()) {}
+
+    T& operator()(int x, int y) const { return base[x * rowStride + y]; }
+    T* row(int x) const { return base + x * rowStride; }
+
+    GridView subview(int x0, int y0, int rows, int cols) const {
+        return GridView(base + x0 * rowStride + y0, rows, cols, rowStride);
+    }
+
+    T* data() const { return base; }
+    int rows() const { return numRows; }
+    int cols() const { return numCols; }
+    std::ptrdiff_t stride() const { return rowStride; }
+    bool empty() const { return numRows == 0 || numCols == 0; }
+};
+
+// Owning, 64-byte aligned, row-padded grid. Copies are deep; assigning a grid
+// of the same shape reuses the existing allocation.
+template <typename T>
+class Grid {
+    static_assert(std::is_trivially_copyable<T>::value, "Grid holds plain values only");
+
+private:
+    T* base;
+    int numRows;
+    int numCols;
+    std::ptrdiff_t rowStride;
+
+    static std::ptrdiff_t paddedStride(int cols) {
+        const std::size_t perLine = GRID_ALIGNMENT / sizeof(T);
+        return static_cast<std::ptrdiff_t>((cols + perLine - 1) / perLine * perLine);
+    }
+
+    void release() {
+        if (base) {
+            ::operator delete(base, std::align_val_t(GRID_ALIGNMENT));
+            base = nullptr;
+        }
+    }
+
+    void allocate(int rows, int cols) {
+        numRows = rows;
+        numCols = cols;
+        rowStride = paddedStride(cols);
+        std::size_t bytes = static_cast<std::size_t>(rows) * rowStride * sizeof(T);
+        base = bytes ? static_cast<T*>(::operator new(bytes, std::align_val_t(GRID_ALIGNMENT))) : nullptr;
+    }
+
+public:
+    Grid() : base(nullptr), numRows(0), numCols(0), rowStride(0) {}
+
+    Grid(int rows, int cols, T value = T()) : base(nullptr) {
+        allocate(rows, cols);
+        fill(value);
+    }
+
+    Grid(const Grid& other) : base(nullptr) {
+        allocate(other.numRows, other.numCols);
+        copyFrom(other);
+    }
+
+    Grid(Grid&& other) noexcept
+        : base(other.base), numRows(other.numRows), numCols(other.numCols), rowStride(other.rowStride) {
+        other.base = nullptr;
+        other.numRows = other.numCols = 0;
+        other.rowStride = 0;
+    }
+
+    Grid& operator=(const Grid& other) {
+        if (this != &other) {
+            if (!sameShape(other)) {
+                release();
+                allocate(other.numRows, other.numCols);
+            }
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    Grid& operator=(Grid&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~Grid() { release(); }
+
+    void swap(Grid& other) noexcept {
+        std::swap(base, other.base);
+        std::swap(numRows, other.numRows);
+        std::swap(numCols, other.numCols);
+        std::swap(rowStride, other.rowStride);
+    }
+
+    // Reshape, reallocating only when the shape changes. Contents are reset to value.
+    void resize(int rows, int cols, T value = T()) {
+        if (rows != numRows || cols != numCols) {
+            release();
+            allocate(rows, cols);
+        }
+        fill(value);
+    }
+
+    void fill(T value) {
+        std::fill(base, base + static_cast<std::size_t>(numRows) * rowStride, value);
+    }
+
+    // Copy the contents of a grid with the same shape, without reallocating.
+    void copyFrom(const Grid& other) {
+        if (base && other.base) {
+            std::memcpy(base, other.base, static_cast<std::size_t>(numRows) * rowStride * sizeof(T));
+        }
+    }
+
+    bool sameShape(const Grid& other) const {
+        return numRows == other.numRows && numCols == other.numCols;
+    }
+
+    T& operator()(int x, int y) { return base[x * rowStride + y]; }
+    const T& operator()(int x, int y) const { return base[x * rowStride + y]; }
+
+    T* row(int x) { return base + x * rowStride; }
+    const T* row(int x) const { return base + x * rowStride; }
+
+    GridView<T> view() { return GridView<T>(base, numRows, numCols, rowStride); }
+    GridView<const T> view() const { return GridView<const T>(base, numRows, numCols, rowStride); }
+
+    T* data() { return base; }
+    const T* data() const { return base; }
+    int rows() const { return numRows; }
+    int cols() const { return numCols; }
+    std::ptrdiff_t stride() const { return rowStride; }
+    bool empty() const { return numRows == 0 || numCols == 0; }
+};
+
+using Heightfield = Grid<float>;
+using HeightfieldView = GridView<float>;
+using ConstHeightfieldView = GridView<const float>;
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "ChunkGenerator.h"
+#include "StagePipeline.h"
+#include "ThreadPool.h"
+#include "TiledHeightfield.h"
+
+/*
+Out-of-core bake of one continuous map, chunksX x chunksY chunks across,
+streamed through TiledHeightfield tiles so memory is bounded by the tile
+budgets and the worker count rather than the map size.
+
+Tiles are chunk sized. The base pass runs diamond-square per tile; each
+tile is a chunk whose borders already match its neighbors. The finish pass
+runs the other stages over the map as a whole: a tile is widened by a halo
+copied from its neighbors, the stages run on that window, and only the
+tile's own cells are written back. The halo is at least how far the stages
+reach (one cell per smoothing pass, two per erosion iteration), so the
+result equals running them over the whole map in memory, in any tile order
+on any number of threads.
+
+Unlike generateChunk, smoothing and erosion run across chunk borders; only
+the map's edge stays fixed. Erosion always runs its full iteration count,
+since an early exit would depend on the whole map. Hydraulic erosion moves
+droplets arbitrarily far and isn't supported.
+*/
+
+struct MapBakeSettings {
+    unsigned int worldSeed = 12345;
+    int chunkX = 0;        // World chunk at map cell (0, 0)
+    int chunkY = 0;
+    int chunksX = 4;
+    int chunksY = 4;
+    int chunkSize = 256;   // Also the tile size
+    ErosionSettings erosion;
+    BiomeSettings biome;
+};
+
+struct MapBakeTimings {
+    double base = 0.0;
+    double finish = 0.0;
+};
+
+class MapBaker {
+private:
+    // Everything one thread touches; windows are sized by the tile, not the map
+    struct Worker {
+        std::unique_ptr<ChunkGenerator> generator;
+        ScratchArena arena;
+        Heightfield window;
+        Heightfield windowScratch;
+        std::vector<float> stageRows;
+        ThermalErosion erosion;
+    };
+
+    MapBakeSettings settings;
+    ThreadPool* pool;
+    std::vector<Worker> workers;
+    GradientNoise variationNoise;
+    MapBakeTimings timings;
+    std::atomic<bool> failed;
+
+    Worker& currentWorker() {
+        return workers[pool ? pool->currentWorkerIndex() : 0];
+    }
+
+    // body(tileX, tileY) for every tile of map, roughly in file order
+    template <typename Body>
+    void forEachTile(const TiledHeightfield& map, const Body& body) {
+        auto runSlot = [&](int slot) {
+            int tileX, tileY;
+            map.tileAtSlot(slot, tileX, tileY);
+            body(tileX, tileY);
+        };
+        if (pool) pool->parallelFor(map.tileCount(), runSlot);
+        else for (int slot = 0; slot < map.tileCount(); ++slot) runSlot(slot);
+    }
+
+    // Copy the cells of map under window, whose cell (0, 0) is map cell (x0, y0)
+    void readWindow(TiledHeightfield& map, int x0, int y0, Heightfield& window) {
+        int side = map.tileSize();
+        int x1 = x0 + window.rows();
+        int y1 = y0 + window.cols();
+        for (int tileX = x0 / side; tileX * side < x1; ++tileX) {
+            for (int tileY = y0 / side; tileY * side < y1; ++tileY) {
+                TileLock tile(map, tileX, tileY);
+                const HeightfieldView& view = tile.view();
+                if (view.empty()) {
+                    failed = true;
+                    continue;
+                }
+                int firstX = std::max(x0, tileX * side);
+                int lastX = std::min(x1, tileX * side + view.rows());
+                int firstY = std::max(y0, tileY * side);
+                int lastY = std::min(y1, tileY * side + view.cols());
+                for (int x = firstX; x < lastX; ++x) {
+                    std::memcpy(window.row(x - x0) + (firstY - y0), view.row(x - tileX * side) + (firstY - tileY * side),
+                        (lastY - firstY) * sizeof(float));
+                }
+            }
+        }
+    }
+
+    // Copy the tile's part of source, whose cell (0, 0) is map cell (x0, y0)
+    void writeTile(TiledHeightfield& map, int tileX, int tileY, const Heightfield& source, int x0, int y0) {
+        TileLock tile(map, tileX, tileY);
+        const HeightfieldView& view = tile.view();
+        if (view.empty()) {
+            failed = true;
+            return;
+        }
+        int side = map.tileSize();
+        for (int x = 0; x < view.rows(); ++x) {
+            std::memcpy(view.row(x), source.row(tileX * side - x0 + x) + (tileY * side - y0),
+                view.cols() * sizeof(float));
+        }
+    }
+
+    void bakeBase(TiledHeightfield& base) {
+        forEachTile(base, [&](int tileX, int tileY) {
+            Worker& worker = currentWorker();
+            ChunkGenerator& generator = *worker.generator;
+            generator.generateBaseHeights(settings.worldSeed, settings.chunkX + tileX, settings.chunkY + tileY,
+                worker.arena);
+            writeTile(base, tileX, tileY, generator.getHeights(), tileX * settings.chunkSize, tileY * settings.chunkSize);
+        });
+    }
+
+    void bakeFinish(TiledHeightfield& base, TiledHeightfield& result) {
+        int halo = haloCells(settings.erosion);
+        ErosionSettings erosion = settings.erosion;
+        erosion.minMovement = 0.0f;
+        int originX = settings.chunkX * settings.chunkSize;
+        int originY = settings.chunkY * settings.chunkSize;
+
+        forEachTile(result, [&](int tileX, int tileY) {
+            Worker& worker = currentWorker();
+            int side = result.tileSize();
+            int x0 = std::max(0, tileX * side - halo);
+            int y0 = std::max(0, tileY * side - halo);
+            int x1 = std::min(result.rows(), (tileX + 1) * side + halo);
+            int y1 = std::min(result.cols(), (tileY + 1) * side + halo);
+            Heightfield& window = worker.window;
+            if (window.rows() != x1 - x0 || window.cols() != y1 - y0) window.resize(x1 - x0, y1 - y0);
+            readWindow(base, x0, y0, window);
+
+            // The same stages as generateChunk after diamond-square
+            runStaged(window, worker.windowScratch, worker.stageRows, RowChain<>(), SmoothPeaksStage(), RowChain<>());
+            worker.erosion.run(window, worker.windowScratch, erosion, nullptr);
+            auto pre = makeRowChain(BiomeVariationStage(variationNoise, originX + x0, originY + y0, settings.biome));
+            runStaged(window, worker.windowScratch, worker.stageRows, pre, SmoothPeaksStage(), RowChain<>());
+
+            writeTile(result, tileX, tileY, window, x0, y0);
+        });
+    }
+
+public:
+    // Tiles run on pool when one is given; the result is the same without
+    MapBaker(const MapBakeSettings& bakeSettings, ThreadPool* workerPool)
+        : settings(bakeSettings), pool(workerPool), workers(workerPool ? workerPool->threadCount() : 1),
+        variationNoise(ChunkGenerator::variationSeed(bakeSettings.worldSeed)), failed(false) {
+        for (Worker& worker : workers) {
+            worker.generator.reset(new ChunkGenerator(settings.chunkSize));
+            worker.generator->setMeshBuilding(false);
+        }
+    }
+
+    // Cells each side of a tile the finish pass reads
+    static int haloCells(const ErosionSettings& erosion) {
+        return 1 + 2 * erosion.iterations + 1;
+    }
+
+    int rows() const { return settings.chunksX * settings.chunkSize; }
+    int cols() const { return settings.chunksY * settings.chunkSize; }
+
+    // Fill base with diamond-square heights and result with the finished
+    // map. Both must have been created with rows() x cols() cells and
+    // chunkSize tiles, and each needs a tile budget of at least the pool's
+    // thread count. False if a tile couldn't be mapped.
+    bool bake(TiledHeightfield& base, TiledHeightfield& result) {
+        typedef std::chrono::steady_clock Clock;
+        failed = false;
+        Clock::time_point start = Clock::now();
+        bakeBase(base);
+        Clock::time_point baseDone = Clock::now();
+        bakeFinish(base, result);
+        timings.base = std::chrono::duration<double>(baseDone - start).count();
+        timings.finish = std::chrono::duration<double>(Clock::now() - baseDone).count();
+        return !failed;
+    }
+
+    const MapBakeTimings& getTimings() const { return timings; }
+};
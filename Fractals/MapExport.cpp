@@ -0,0 +1,57 @@
+#include "MapExport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "ChunkGenerator.h"
+
+bool exportMap(const std::string& base, TiledHeightfield& map, bool raw) {
+    int rows = map.rows();
+    int cols = map.cols();
+    char heightHeader[64] = "";
+    char materialHeader[64] = "";
+    if (!raw) {
+        std::snprintf(heightHeader, sizeof(heightHeader), "P5\n%d %d\n65535\n", rows, cols);
+        std::snprintf(materialHeader, sizeof(materialHeader), "P5\n%d %d\n%d\n", rows, cols, MATERIAL_COUNT - 1);
+    }
+    std::ofstream heights(base + (raw ? ".r16" : ".pgm"), std::ios::binary);
+    std::ofstream materials(base + (raw ? "_material.raw" : "_material.pgm"), std::ios::binary);
+    heights << heightHeader;
+    materials << materialHeader;
+    std::streamoff heightStart = static_cast<std::streamoff>(std::strlen(heightHeader));
+    std::streamoff materialStart = static_cast<std::streamoff>(std::strlen(materialHeader));
+
+    int side = map.tileSize();
+    std::vector<uint8_t> heightRun(static_cast<size_t>(side) * 2);
+    std::vector<uint8_t> materialRun(side);
+    for (int slot = 0; slot < map.tileCount() && heights && materials; ++slot) {
+        int tileX, tileY;
+        map.tileAtSlot(slot, tileX, tileY);
+        TileLock tile(map, tileX, tileY);
+        const HeightfieldView& view = tile.view();
+        if (view.empty()) return false;
+        // One image row of the tile at a time: fixed y, x across the tile
+        for (int y = 0; y < view.cols(); ++y) {
+            for (int x = 0; x < view.rows(); ++x) {
+                float h = std::min(1.0f, std::max(0.0f, view(x, y)));
+                uint16_t sample = static_cast<uint16_t>(std::lround(h * 65535.0f));
+                heightRun[x * 2 + (raw ? 0 : 1)] = static_cast<uint8_t>(sample & 0xff);
+                heightRun[x * 2 + (raw ? 1 : 0)] = static_cast<uint8_t>(sample >> 8);
+                materialRun[x] = classifyMaterial(view(x, y));
+            }
+            std::streamoff cell = static_cast<std::streamoff>(tileY * side + y) * rows + tileX * side;
+            heights.seekp(heightStart + cell * 2);
+            heights.write(reinterpret_cast<const char*>(heightRun.data()), view.rows() * 2);
+            materials.seekp(materialStart + cell);
+            materials.write(reinterpret_cast<const char*>(materialRun.data()), view.rows());
+        }
+    }
+    heights.close();
+    materials.close();
+    return !heights.fail() && !materials.fail();
+}
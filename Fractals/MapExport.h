@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+#include "TiledHeightfield.h"
+
+// Write both layers of a tiled map as base.pgm and base_material.pgm (P5,
+// 16-bit big-endian heights and one material class per byte), or with raw
+// as base.r16 (little-endian) and base_material.raw. Heights are clamped to
+// [0, 1] and scaled to 0..65535; image rows run along y. The map is written
+// a tile at a time, so it is never in memory as a whole.
+bool exportMap(const std::string& base, TiledHeightfield& map, bool raw);
@@ -0,0 +1,139 @@
+#include "Noise.h"
+#include "SimdKernels.h"
+#include "SimdOps.h"
+
+#include "Hash.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+    // Brings the single-octave range to about [-1, 1]
+    const float NOISE_SCALE = 0.66f;
+    // Where the two domain-warp fields are sampled, relative to the point
+    const float WARP_SHIFT_X = 431.7f;
+    const float WARP_SHIFT_Y = 179.3f;
+    // Batched calls work through the points this many at a time
+    const int POINT_BLOCK = 256;
+
+    // Per-octave constants, worked out once per call so every path uses the
+    // same values
+    struct NoisePlan {
+        NoiseFractal fractal;
+        int octaves;
+        float warp;
+        float frequencies[NOISE_MAX_OCTAVES];
+        float shifts[NOISE_MAX_OCTAVES];   // Keeps octaves from sharing lattice points
+        float weights[NOISE_MAX_OCTAVES];  // Amplitudes normalized to sum to 1
+
+        explicit NoisePlan(const NoiseSettings& settings)
+            : fractal(settings.fractal), octaves(std::min(std::max(settings.octaves, 1), NOISE_MAX_OCTAVES)),
+            warp(settings.warp) {
+            float frequency = settings.frequency;
+            float amplitude = 1.0f;
+            float total = 0.0f;
+            for (int i = 0; i < octaves; ++i) {
+                frequencies[i] = frequency;
+                shifts[i] = i * 17.31f;
+                weights[i] = amplitude;
+                total += amplitude;
+                frequency *= settings.lacunarity;
+                amplitude *= settings.gain;
+            }
+            for (int i = 0; i < octaves; ++i) weights[i] /= total;
+        }
+    };
+}
+
+namespace scalar_kernels {
+#include "NoiseImpl.inl"
+}
+
+#if SIMD_KERNELS_X86
+
+#if defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace sse41_kernels {
+#include "NoiseImpl.inl"
+}
+
+#if defined(__GNUC__)
+#pragma GCC pop_options
+// No "fma", as in SimdKernels.cpp
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2_kernels {
+#include "NoiseImpl.inl"
+}
+
+#if defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif  // SIMD_KERNELS_X86
+
+namespace {
+    typedef void (*SamplePointsKernel)(const int32_t*, const float*, const float*, int, const NoisePlan&, float*);
+
+    // Indexed by SimdLevel
+    const SamplePointsKernel samplePointsKernels[] = {
+        scalar_kernels::samplePoints,
+#if SIMD_KERNELS_X86
+        sse41_kernels::samplePoints,
+        avx2_kernels::samplePoints,
+#else
+        scalar_kernels::samplePoints,
+        scalar_kernels::samplePoints,
+#endif
+    };
+}
+
+void GradientNoise::reseed(uint32_t seed) {
+    seedValue = seed;
+    for (int i = 0; i < 256; ++i) permutation[i] = i;
+    // Fisher-Yates driven by the hash, so the table is the same on every platform
+    for (int i = 255; i > 0; --i) {
+        uint32_t j = hashCombine(seed, static_cast<uint32_t>(i)) % static_cast<uint32_t>(i + 1);
+        std::swap(permutation[i], permutation[j]);
+    }
+    for (int i = 0; i < 256; ++i) permutation[256 + i] = permutation[i];
+}
+
+float GradientNoise::noise(float x, float y) const {
+    NoiseSettings settings;
+    settings.octaves = 1;
+    return sample(x, y, settings);
+}
+
+float GradientNoise::sample(float x, float y, const NoiseSettings& settings) const {
+    float value;
+    scalar_kernels::samplePoints(permutation, &x, &y, 1, NoisePlan(settings), &value);
+    return value;
+}
+
+void GradientNoise::sampleRow(float x, float y0, int count, const NoiseSettings& settings, float* out) const {
+    sampleTile(x, y0, 1, count, settings, out, 0);
+}
+
+void GradientNoise::sampleTile(float x0, float y0, int rows, int columns, const NoiseSettings& settings,
+    float* out, std::ptrdiff_t stride) const {
+    NoisePlan plan(settings);
+    SamplePointsKernel kernel = samplePointsKernels[activeSimdLevel()];
+
+    float xs[POINT_BLOCK];
+    float ys[POINT_BLOCK];
+    for (int i = 0; i < rows; ++i) {
+        std::fill(xs, xs + POINT_BLOCK, x0 + static_cast<float>(i));
+        float* row = out + i * stride;
+        for (int start = 0; start < columns; start += POINT_BLOCK) {
+            int count = std::min(POINT_BLOCK, columns - start);
+            for (int j = 0; j < count; ++j) ys[j] = y0 + static_cast<float>(start + j);
+            kernel(permutation, xs, ys, count, plan, row + start);
+        }
+    }
+}
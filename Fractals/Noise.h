@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+2D gradient (Perlin) noise over a permutation table shuffled from a seed,
+with fractal sums on top.
+
+Batched forms fill a row or a tile per call and run on the same AVX2 /
+SSE4.1 / scalar dispatch as the SimdKernels row kernels. Every path runs the
+same operations in the same order, so a value does not depend on the CPU,
+on the batch it was computed in or on its position within that batch:
+sample(x, y) equals the matching entry of any row or tile containing it.
+Terrain relies on that for seams, since neighboring chunks compute their
+shared border in different rows.
+
+Coordinates are in caller units (e.g. grid cells) and are multiplied by the
+settings' frequency. Batched coordinates step by exactly 1, so integral
+starting points give exact sample positions.
+*/
+
+enum NoiseFractal {
+    NOISE_FBM,     // Sum of octaves, in [-1, 1]
+    NOISE_RIDGED   // Sum of (1 - |noise|)^2 octaves, in [0, 1]; sharp crests along noise zeros
+};
+
+const int NOISE_MAX_OCTAVES = 16;
+
+struct NoiseSettings {
+    NoiseFractal fractal = NOISE_FBM;
+    int octaves = 6;          // Clamped to [1, NOISE_MAX_OCTAVES]
+    float frequency = 1.0f;   // Of the first octave
+    float lacunarity = 2.0f;  // Frequency ratio between octaves
+    float gain = 0.5f;        // Amplitude ratio between octaves
+    // Domain warp: when nonzero, the point is first displaced by two fBm
+    // fields (same octaves and frequency) scaled by this, in caller units
+    float warp = 0.0f;
+};
+
+class GradientNoise {
+private:
+    uint32_t seedValue;
+    // 256-entry permutation stored twice, so lookups need no wrap
+    int32_t permutation[512];
+
+public:
+    explicit GradientNoise(uint32_t seed = 0) { reseed(seed); }
+
+    void reseed(uint32_t seed);
+    uint32_t seed() const { return seedValue; }
+
+    // Single octave at (x, y), roughly in [-1, 1]; 0 at integer points
+    float noise(float x, float y) const;
+
+    float sample(float x, float y, const NoiseSettings& settings) const;
+
+    // out[i] = sample(x, y0 + i)
+    void sampleRow(float x, float y0, int count, const NoiseSettings& settings, float* out) const;
+
+    // out[i * stride + j] = sample(x0 + i, y0 + j), matching Heightfield rows
+    void sampleTile(float x0, float y0, int rows, int columns, const NoiseSettings& settings,
+        float* out, std::ptrdiff_t stride) const;
+};
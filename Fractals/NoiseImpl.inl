@@ -0,0 +1,81 @@
+// Kernel bodies for GradientNoise. Noise.cpp includes this once per ISA inside
+// the matching namespace from SimdOps.h, as SimdKernels.cpp does with
+// SimdKernelsImpl.inl.
+
+// 6t^5 - 15t^4 + 10t^3
+static inline V fadeV(V t) {
+    return mul(mul(mul(t, t), t), add(mul(t, sub(mul(t, set(6.0f)), set(15.0f))), set(10.0f)));
+}
+
+static inline V lerpV(V t, V a, V b) {
+    return add(a, mul(t, sub(b, a)));
+}
+
+// Offset (x, y) dotted with one of eight gradients, (+-1, +-2) or (+-2, +-1)
+static inline V gradientV(VI hash, V x, V y) {
+    M xFirst = iequal(iand(hash, iset(4)), iset(0));
+    V u = select(xFirst, x, y);
+    V v = select(xFirst, y, x);
+    u = select(iequal(iand(hash, iset(1)), iset(1)), sub(set(0.0f), u), u);
+    v = select(iequal(iand(hash, iset(2)), iset(2)), sub(set(0.0f), v), v);
+    return add(u, add(v, v));
+}
+
+static inline V gradientNoiseV(const int32_t* permutation, V x, V y) {
+    V floorX = vfloor(x);
+    V floorY = vfloor(y);
+    V fracX = sub(x, floorX);
+    V fracY = sub(y, floorY);
+    VI cellX = iand(toInt(floorX), iset(255));
+    VI cellY = iand(toInt(floorY), iset(255));
+
+    VI a = iadd(gather(permutation, cellX), cellY);
+    VI b = iadd(gather(permutation, iadd(cellX, iset(1))), cellY);
+    VI hash00 = gather(permutation, a);
+    VI hash01 = gather(permutation, iadd(a, iset(1)));
+    VI hash10 = gather(permutation, b);
+    VI hash11 = gather(permutation, iadd(b, iset(1)));
+
+    V fracX1 = sub(fracX, set(1.0f));
+    V fracY1 = sub(fracY, set(1.0f));
+    V u = fadeV(fracX);
+    V v = fadeV(fracY);
+    V low = lerpV(u, gradientV(hash00, fracX, fracY), gradientV(hash10, fracX1, fracY));
+    V high = lerpV(u, gradientV(hash01, fracX, fracY1), gradientV(hash11, fracX1, fracY1));
+    return mul(lerpV(v, low, high), set(NOISE_SCALE));
+}
+
+static inline V fractalV(const int32_t* permutation, V x, V y, const NoisePlan& plan, NoiseFractal fractal) {
+    V sum = set(0.0f);
+    for (int i = 0; i < plan.octaves; ++i) {
+        V frequency = set(plan.frequencies[i]);
+        V shift = set(plan.shifts[i]);
+        V n = gradientNoiseV(permutation, add(mul(x, frequency), shift), add(mul(y, frequency), shift));
+        if (fractal == NOISE_RIDGED) {
+            n = sub(set(1.0f), vmax(n, sub(set(0.0f), n)));
+            n = mul(n, n);
+        }
+        sum = add(sum, mul(n, set(plan.weights[i])));
+    }
+    return sum;
+}
+
+// Lanes left over after the last full vector go through the scalar path,
+// which computes exactly the same thing one value at a time.
+
+void samplePoints(const int32_t* permutation, const float* xs, const float* ys, int count,
+    const NoisePlan& plan, float* out) {
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        V x = load(xs + i);
+        V y = load(ys + i);
+        if (plan.warp != 0.0f) {
+            V warpX = fractalV(permutation, add(x, set(WARP_SHIFT_X)), add(y, set(WARP_SHIFT_Y)), plan, NOISE_FBM);
+            V warpY = fractalV(permutation, add(x, set(WARP_SHIFT_Y)), add(y, set(WARP_SHIFT_X)), plan, NOISE_FBM);
+            x = add(x, mul(warpX, set(plan.warp)));
+            y = add(y, mul(warpY, set(plan.warp)));
+        }
+        store(out + i, fractalV(permutation, x, y, plan, plan.fractal));
+    }
+    if (i < count) scalar_kernels::samplePoints(permutation, xs + i, ys + i, count - i, plan, out + i);
+}
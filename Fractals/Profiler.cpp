@@ -0,0 +1,67 @@
+#include "Profiler.h"
+
+#include <cstdio>
+
+Profiler::Profiler(size_t capacity)
+    : origin(Clock::now()), events(std::max<size_t>(1, capacity)), nextEvent(0), eventCount(0) {
+    std::fill(threadNames, threadNames + MAX_NAMED_THREADS, nullptr);
+    threadNames[GPU_THREAD] = "GPU";
+}
+
+int Profiler::threadId() {
+    static std::atomic<int> nextId(GPU_THREAD + 1);
+    thread_local int id = nextId++;
+    return id;
+}
+
+void Profiler::setThreadName(const char* name) {
+    int id = threadId();
+    if (id >= MAX_NAMED_THREADS) return;
+    std::lock_guard<std::mutex> lock(eventMutex);
+    threadNames[id] = name;
+}
+
+void Profiler::record(const char* name, const char* category, int64_t startNs, int64_t durationNs, int thread) {
+    std::lock_guard<std::mutex> lock(eventMutex);
+    events[nextEvent] = { name, category, startNs, durationNs, thread };
+    nextEvent = (nextEvent + 1) % events.size();
+    eventCount = std::min(eventCount + 1, events.size());
+}
+
+bool Profiler::writeChromeTrace(const std::string& path, double seconds) const {
+    std::vector<Event> recent;
+    const char* names[MAX_NAMED_THREADS];
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+        size_t first = (nextEvent + events.size() - eventCount) % events.size();
+        recent.reserve(eventCount);
+        for (size_t i = 0; i < eventCount; ++i) recent.push_back(events[(first + i) % events.size()]);
+        std::copy(threadNames, threadNames + MAX_NAMED_THREADS, names);
+    }
+
+    int64_t end = nanoseconds(Clock::now());
+    int64_t begin = end - static_cast<int64_t>(seconds * 1e9);
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    // Names are program literals, so nothing needs escaping. Times are in
+    // microseconds, as the format expects.
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Fractals\"}}");
+    std::vector<bool> seen(MAX_NAMED_THREADS, false);
+    for (const Event& event : recent) {
+        if (event.startNs + event.durationNs < begin) continue;
+        if (event.thread >= 0 && event.thread < MAX_NAMED_THREADS && !seen[event.thread]) {
+            seen[event.thread] = true;
+            if (names[event.thread]) {
+                std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", event.thread, names[event.thread]);
+            }
+        }
+        std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f}", event.name, event.category, event.thread,
+            event.startNs / 1000.0, event.durationNs / 1000.0);
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The last CAPACITY samples of some duration, for the HUD. Fixed size, so
+// adding and querying never allocate.
+class RollingStats {
+public:
+    static constexpr int CAPACITY = 240;
+
+private:
+    float samples[CAPACITY];
+    int count;
+    int next;
+
+public:
+    RollingStats() : count(0), next(0) {}
+
+    void add(float value) {
+        samples[next] = value;
+        next = (next + 1) % CAPACITY;
+        count = std::min(count + 1, CAPACITY);
+    }
+
+    int size() const { return count; }
+
+    float mean() const {
+        float sum = 0.0f;
+        for (int i = 0; i < count; ++i) sum += samples[i];
+        return count > 0 ? sum / count : 0.0f;
+    }
+
+    // Nearest-rank percentile, p in [0, 100]; 0 when empty
+    float percentile(float p) const {
+        if (count <= 0) return 0.0f;
+        float sorted[CAPACITY];
+        std::copy(samples, samples + count, sorted);
+        int rank = static_cast<int>(std::ceil(p / 100.0f * count)) - 1;
+        rank = std::max(0, std::min(count - 1, rank));
+        std::nth_element(sorted, sorted + rank, sorted + count);
+        return sorted[rank];
+    }
+};
+
+/*
+Timeline of named events from any thread, kept in a fixed ring buffer so
+the last stretch of a session can be written out as a Chrome trace
+(chrome://tracing or ui.perfetto.dev).
+
+Recording takes a short lock and copies a few words; it never allocates.
+Names and categories must be string literals or otherwise outlive the
+profiler, since only the pointers are stored. Threads get small ids in the
+order they first record; id 0 is reserved for GPU events.
+*/
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr int GPU_THREAD = 0;
+
+    struct Event {
+        const char* name;
+        const char* category;
+        int64_t startNs;     // Since the profiler was created
+        int64_t durationNs;
+        int thread;
+    };
+
+private:
+    static constexpr int MAX_NAMED_THREADS = 64;
+
+    Clock::time_point origin;
+    std::vector<Event> events;  // Ring buffer, sized once
+    size_t nextEvent;
+    size_t eventCount;
+    const char* threadNames[MAX_NAMED_THREADS];
+    mutable std::mutex eventMutex;
+
+public:
+    explicit Profiler(size_t capacity = 1 << 17);
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    int64_t nanoseconds(Clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - origin).count();
+    }
+
+    // Id of the calling thread, the same for every profiler
+    static int threadId();
+    // Label for the calling thread in traces
+    void setThreadName(const char* name);
+
+    void record(const char* name, const char* category, Clock::time_point start, Clock::time_point end) {
+        record(name, category, nanoseconds(start), nanoseconds(end) - nanoseconds(start), threadId());
+    }
+    void record(const char* name, const char* category, int64_t startNs, int64_t durationNs, int thread);
+
+    // Write events that ended in the last seconds as Chrome trace JSON.
+    // False if the file cannot be written.
+    bool writeChromeTrace(const std::string& path, double seconds) const;
+};
+
+// Records the time from construction to destruction on profiler (if any)
+// and adds it in milliseconds to stats (if any)
+class ProfileScope {
+private:
+    Profiler* profiler;
+    RollingStats* stats;
+    const char* name;
+    const char* category;
+    Profiler::Clock::time_point start;
+
+public:
+    ProfileScope(Profiler* target, const char* scopeName, RollingStats* scopeStats = nullptr,
+        const char* scopeCategory = "cpu")
+        : profiler(target), stats(scopeStats), name(scopeName), category(scopeCategory),
+        start(Profiler::Clock::now()) {}
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        Profiler::Clock::time_point end = Profiler::Clock::now();
+        if (profiler) profiler->record(name, category, start, end);
+        if (stats) stats->add(std::chrono::duration<float, std::milli>(end - start).count());
+    }
+};
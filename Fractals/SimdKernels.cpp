@@ -0,0 +1,159 @@
+#include "SimdKernels.h"
+#include "SimdOps.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace scalar_kernels {
+#include "SimdKernelsImpl.inl"
+}
+
+#if SIMD_KERNELS_X86
+
+#if defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace sse41_kernels {
+#include "SimdKernelsImpl.inl"
+}
+
+#if defined(__GNUC__)
+#pragma GCC pop_options
+// No "fma": the compiler must not fuse multiply-adds, or this path would
+// round differently from the others
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2_kernels {
+#include "SimdKernelsImpl.inl"
+}
+
+#if defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif  // SIMD_KERNELS_X86
+
+namespace {
+    struct KernelTable {
+        void (*powRow)(const float*, float*, int, float);
+        void (*sinRow)(const float*, float*, int);
+        void (*cosRow)(const float*, float*, int);
+        void (*smoothStencilPowRow)(const float*, const float*, const float*, float*, int, float);
+        void (*addClampRow)(float*, float, const float*, int);
+        void (*displacedAverageRow)(const float*, const float*, const float*, const float*, float*, int,
+            uint32_t, int, float);
+    };
+
+#define SIMD_KERNEL_TABLE(ns) \
+    { ns::powRow, ns::sinRow, ns::cosRow, ns::smoothStencilPowRow, ns::addClampRow, ns::displacedAverageRow }
+
+    // Indexed by SimdLevel
+    const KernelTable kernelTables[] = {
+        SIMD_KERNEL_TABLE(scalar_kernels),
+#if SIMD_KERNELS_X86
+        SIMD_KERNEL_TABLE(sse41_kernels),
+        SIMD_KERNEL_TABLE(avx2_kernels),
+#else
+        SIMD_KERNEL_TABLE(scalar_kernels),
+        SIMD_KERNEL_TABLE(scalar_kernels),
+#endif
+    };
+
+#undef SIMD_KERNEL_TABLE
+
+    std::atomic<int> activeLevel{ -1 };
+
+    const KernelTable& kernels() {
+        int level = activeLevel.load(std::memory_order_relaxed);
+        if (level < 0) {
+            level = detectSimdLevel();
+            activeLevel.store(level, std::memory_order_relaxed);
+        }
+        return kernelTables[level];
+    }
+}
+
+SimdLevel detectSimdLevel() {
+#if SIMD_KERNELS_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    // AVX state must also be enabled by the OS
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2) return SIMD_AVX2;
+    if (sse41) return SIMD_SSE41;
+    return SIMD_SCALAR;
+#elif SIMD_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+    return SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel activeSimdLevel() {
+    kernels();
+    return static_cast<SimdLevel>(activeLevel.load(std::memory_order_relaxed));
+}
+
+void setSimdLevel(SimdLevel level) {
+    activeLevel.store(std::min<int>(level, detectSimdLevel()), std::memory_order_relaxed);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_SSE41: return "SSE4.1";
+    default: return "scalar";
+    }
+}
+
+float fastPow(float x, float exponent) { return scalar_kernels::powV(x, exponent); }
+float fastSin(float x) { return scalar_kernels::sinV(x); }
+float fastCos(float x) { return scalar_kernels::cosV(x); }
+
+float displacedAverage(float a, float b, float c, float d, uint32_t rowSeed, int column, float scale) {
+    int32_t hash = scalar_kernels::hashColumnsV(static_cast<int32_t>(rowSeed),
+        static_cast<int32_t>(scalar_kernels::hashCombineMixed(rowSeed)), column);
+    return scalar_kernels::displacedAverageV(a, b, c, d, hash, scale);
+}
+
+void powRow(const float* in, float* out, int count, float exponent) {
+    kernels().powRow(in, out, count, exponent);
+}
+
+void sinRow(const float* in, float* out, int count) {
+    kernels().sinRow(in, out, count);
+}
+
+void cosRow(const float* in, float* out, int count) {
+    kernels().cosRow(in, out, count);
+}
+
+void smoothStencilPowRow(const float* above, const float* center, const float* below, float* out,
+    int count, float exponent) {
+    kernels().smoothStencilPowRow(above, center, below, out, count, exponent);
+}
+
+void addClampRow(float* row, float rowTerm, const float* columnTerms, int count) {
+    kernels().addClampRow(row, rowTerm, columnTerms, count);
+}
+
+void displacedAverageRow(const float* a, const float* b, const float* c, const float* d, float* out,
+    int count, uint32_t rowSeed, int firstColumn, float scale) {
+    kernels().displacedAverageRow(a, b, c, d, out, count, rowSeed, firstColumn, scale);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+Row kernels for the terrain passes, with runtime dispatch to AVX2, SSE4.1 or
+a portable scalar path.
+
+All three paths run the same operations in the same order (no FMA), so they
+produce bit-identical results and the generated world does not depend on
+the CPU it runs on. The scalar fast* functions are the one-lane form of the
+same code, for values that are not laid out in rows (e.g. grid columns).
+
+pow, sin and cos are polynomial approximations, not the C library
+functions. Against std::pow/std::sin/std::cos in float:
+  fastPow  relative error <= 2e-6 for x in (0, 1], exponent in [0.5, 2];
+           x <= 0 gives 0
+  fastSin, fastCos  absolute error <= 1e-7 for |x| <= 1e4, 1e-6 for |x| <= 1e5;
+           the range reduction breaks down beyond that
+*/
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE41,
+    SIMD_AVX2
+};
+
+// Best level this CPU supports
+SimdLevel detectSimdLevel();
+// Level the kernels currently dispatch to
+SimdLevel activeSimdLevel();
+// Select a level, e.g. to compare paths; clamped to what the CPU supports
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+float fastPow(float x, float exponent);
+float fastSin(float x);
+float fastCos(float x);
+// One lane of displacedAverageRow
+float displacedAverage(float a, float b, float c, float d, uint32_t rowSeed, int column, float scale);
+
+// out[i] = fastPow(in[i], exponent); in and out may alias
+void powRow(const float* in, float* out, int count, float exponent);
+void sinRow(const float* in, float* out, int count);
+void cosRow(const float* in, float* out, int count);
+
+// 3x3 weighted average (0.4 center, 0.1 edges, 0.05 corners) raised to
+// exponent, for out[0, count). Reads index -1 to count of the three rows.
+void smoothStencilPowRow(const float* above, const float* center, const float* below, float* out,
+    int count, float exponent);
+
+// row[i] = clamp(row[i] + (rowTerm + columnTerms[i]), 0, 1)
+void addClampRow(float* row, float rowTerm, const float* columnTerms, int count);
+
+// Diamond-square displacement:
+//   avg = (a[i] + b[i] + c[i] + d[i]) / 4
+//   out[i] = clamp(avg + u * scale * (1.3 + |avg - 0.5| * 1.5), 0, 1)
+// where u = hashToSignedUnitFloat(hashCombine(rowSeed, firstColumn + i)),
+// so every value depends only on its inputs and position. out may alias
+// any input at the same index.
+void displacedAverageRow(const float* a, const float* b, const float* c, const float* d, float* out,
+    int count, uint32_t rowSeed, int firstColumn, float scale);
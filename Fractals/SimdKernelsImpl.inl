@@ -0,0 +1,199 @@
+// Kernel bodies shared by every instruction set. SimdKernels.cpp includes this
+// once per ISA inside the matching namespace from SimdOps.h, which defines the
+// vector type V (WIDTH lanes), the integer vector VI, the mask type M and the
+// operations used below. Keeping one copy of the arithmetic is what makes the
+// paths bit-identical.
+
+// Cephes-style expf; inputs are clamped to the float range
+static inline V expV(V x) {
+    x = vmin(x, set(88.3762626647949f));
+    x = vmax(x, set(-88.3762626647949f));
+
+    V n = vfloor(add(mul(x, set(1.44269504088896341f)), set(0.5f)));
+    x = sub(x, mul(n, set(0.693359375f)));
+    x = sub(x, mul(n, set(-2.12194440e-4f)));
+
+    V z = mul(x, x);
+    V y = set(1.9875691500e-4f);
+    y = add(mul(y, x), set(1.3981999507e-3f));
+    y = add(mul(y, x), set(8.3334519073e-3f));
+    y = add(mul(y, x), set(4.1665795894e-2f));
+    y = add(mul(y, x), set(1.6666665459e-1f));
+    y = add(mul(y, x), set(5.0000001201e-1f));
+    y = add(add(mul(y, z), x), set(1.0f));
+
+    VI exponent = shiftLeft23(iadd(toInt(n), iset(127)));
+    return mul(y, asFloat(exponent));
+}
+
+// Cephes-style logf for positive inputs; denormals are treated as the smallest normal
+static inline V logV(V x) {
+    x = vmax(x, set(1.17549435e-38f));
+
+    VI bits = asInt(x);
+    V e = toFloat(isub(shiftRight23(bits), iset(126)));
+    V m = asFloat(ior(iand(bits, iset(static_cast<int32_t>(0x807fffffu))), iset(0x3f000000)));
+
+    // Keep the mantissa in [sqrt(1/2), sqrt(2)) around 1
+    M small = less(m, set(0.707106781186547524f));
+    e = sub(e, select(small, set(1.0f), set(0.0f)));
+    m = add(sub(m, set(1.0f)), select(small, m, set(0.0f)));
+
+    V z = mul(m, m);
+    V y = set(7.0376836292e-2f);
+    y = add(mul(y, m), set(-1.1514610310e-1f));
+    y = add(mul(y, m), set(1.1676998740e-1f));
+    y = add(mul(y, m), set(-1.2420140846e-1f));
+    y = add(mul(y, m), set(1.4249322787e-1f));
+    y = add(mul(y, m), set(-1.6668057665e-1f));
+    y = add(mul(y, m), set(2.0000714765e-1f));
+    y = add(mul(y, m), set(-2.4999993993e-1f));
+    y = add(mul(y, m), set(3.3333331174e-1f));
+    y = mul(mul(y, m), z);
+
+    y = add(y, mul(e, set(-2.12194440e-4f)));
+    y = sub(y, mul(z, set(0.5f)));
+    V result = add(m, y);
+    return add(result, mul(e, set(0.693359375f)));
+}
+
+static inline V powV(V x, V exponent) {
+    V result = expV(mul(exponent, logV(x)));
+    return select(lessEqual(x, set(0.0f)), set(0.0f), result);
+}
+
+// Reduces x by the nearest multiple k of pi/2 (three-part Cody-Waite) and
+// evaluates both polynomials on the remainder; quadrant is k mod 4.
+static inline void sinCosReduced(V x, V& sine, V& cosine, VI& quadrant) {
+    V k = vfloor(add(mul(x, set(0.636619772367581343f)), set(0.5f)));
+    V r = sub(x, mul(k, set(1.5703125f)));
+    r = sub(r, mul(k, set(4.837512969970703125e-4f)));
+    r = sub(r, mul(k, set(7.54978995489188216e-8f)));
+    quadrant = iand(toInt(k), iset(3));
+
+    V z = mul(r, r);
+    V s = set(-1.9515295891e-4f);
+    s = add(mul(s, z), set(8.3321608736e-3f));
+    s = add(mul(s, z), set(-1.6666654611e-1f));
+    sine = add(mul(mul(s, z), r), r);
+
+    V c = set(2.443315711809948e-5f);
+    c = add(mul(c, z), set(-1.388731625493765e-3f));
+    c = add(mul(c, z), set(4.166664568298827e-2f));
+    c = mul(mul(c, z), z);
+    cosine = add(sub(c, mul(z, set(0.5f))), set(1.0f));
+}
+
+static inline V sinV(V x) {
+    V s, c;
+    VI quadrant;
+    sinCosReduced(x, s, c, quadrant);
+    V value = select(iequal(iand(quadrant, iset(1)), iset(1)), c, s);
+    return select(iequal(iand(quadrant, iset(2)), iset(2)), sub(set(0.0f), value), value);
+}
+
+static inline V cosV(V x) {
+    V s, c;
+    VI quadrant;
+    sinCosReduced(x, s, c, quadrant);
+    V value = select(iequal(iand(quadrant, iset(1)), iset(1)), s, c);
+    VI shifted = iadd(quadrant, iset(1));
+    return select(iequal(iand(shifted, iset(2)), iset(2)), sub(set(0.0f), value), value);
+}
+
+// Lanes left over after the last full vector go through the scalar path,
+// which computes exactly the same thing one value at a time.
+
+void powRow(const float* in, float* out, int count, float exponent) {
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        store(out + i, powV(load(in + i), set(exponent)));
+    }
+    if (i < count) scalar_kernels::powRow(in + i, out + i, count - i, exponent);
+}
+
+void sinRow(const float* in, float* out, int count) {
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        store(out + i, sinV(load(in + i)));
+    }
+    if (i < count) scalar_kernels::sinRow(in + i, out + i, count - i);
+}
+
+void cosRow(const float* in, float* out, int count) {
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        store(out + i, cosV(load(in + i)));
+    }
+    if (i < count) scalar_kernels::cosRow(in + i, out + i, count - i);
+}
+
+void smoothStencilPowRow(const float* above, const float* center, const float* below, float* out,
+    int count, float exponent) {
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        // Same summation order as the original scalar stencil
+        V sum = mul(load(above + i - 1), set(0.05f));
+        sum = add(sum, mul(load(above + i), set(0.1f)));
+        sum = add(sum, mul(load(above + i + 1), set(0.05f)));
+        sum = add(sum, mul(load(center + i - 1), set(0.1f)));
+        sum = add(sum, mul(load(center + i), set(0.4f)));
+        sum = add(sum, mul(load(center + i + 1), set(0.1f)));
+        sum = add(sum, mul(load(below + i - 1), set(0.05f)));
+        sum = add(sum, mul(load(below + i), set(0.1f)));
+        sum = add(sum, mul(load(below + i + 1), set(0.05f)));
+        store(out + i, powV(sum, set(exponent)));
+    }
+    if (i < count) {
+        scalar_kernels::smoothStencilPowRow(above + i, center + i, below + i, out + i, count - i, exponent);
+    }
+}
+
+void addClampRow(float* row, float rowTerm, const float* columnTerms, int count) {
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        V value = add(load(row + i), add(set(rowTerm), load(columnTerms + i)));
+        store(row + i, vmin(set(1.0f), vmax(set(0.0f), value)));
+    }
+    if (i < count) scalar_kernels::addClampRow(row + i, rowTerm, columnTerms + i, count - i);
+}
+
+// hashCombine(seed, column) from Hash.h, per lane; mixed is the part of the
+// combine that depends on seed alone
+static inline VI hashColumnsV(VI seed, VI mixed, VI column) {
+    VI h = ixor(seed, iadd(column, mixed));
+    h = ixor(h, shiftRightLogical<16>(h));
+    h = imul(h, iset(static_cast<int32_t>(0x85ebca6bu)));
+    h = ixor(h, shiftRightLogical<13>(h));
+    h = imul(h, iset(static_cast<int32_t>(0xc2b2ae35u)));
+    return ixor(h, shiftRightLogical<16>(h));
+}
+
+static inline uint32_t hashCombineMixed(uint32_t seed) {
+    return 0x9e3779b9u + (seed << 6) + (seed >> 2);
+}
+
+// Average of a, b, c and d moved by hash (as a value in [-1, 1)) times
+// scale, more so away from mid height, and clamped to [0, 1]
+static inline V displacedAverageV(V a, V b, V c, V d, VI hash, V scale) {
+    V average = mul(add(add(add(a, b), c), d), set(0.25f));
+    V unit = sub(mul(toFloat(shiftRightLogical<8>(hash)), set(1.0f / 8388608.0f)), set(1.0f));
+    V offset = sub(average, set(0.5f));
+    V spread = add(set(1.3f), mul(vmax(offset, sub(set(0.0f), offset)), set(1.5f)));
+    return vmin(set(1.0f), vmax(set(0.0f), add(average, mul(mul(unit, scale), spread))));
+}
+
+void displacedAverageRow(const float* a, const float* b, const float* c, const float* d, float* out,
+    int count, uint32_t rowSeed, int firstColumn, float scale) {
+    VI seed = iset(static_cast<int32_t>(rowSeed));
+    VI mixed = iset(static_cast<int32_t>(hashCombineMixed(rowSeed)));
+    int i = 0;
+    for (; i + WIDTH <= count; i += WIDTH) {
+        VI hash = hashColumnsV(seed, mixed, iadd(iset(firstColumn + i), laneIndices()));
+        store(out + i, displacedAverageV(load(a + i), load(b + i), load(c + i), load(d + i), hash, set(scale)));
+    }
+    if (i < count) {
+        scalar_kernels::displacedAverageRow(a + i, b + i, c + i, d + i, out + i, count - i, rowSeed,
+            firstColumn + i, scale);
+    }
+}
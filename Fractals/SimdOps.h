@@ -0,0 +1,167 @@
+#pragma once
+
+/*
+Vector operations for the row kernels, one namespace per instruction set.
+Each namespace defines the float vector V (WIDTH lanes), the integer vector
+VI, the mask M and the same set of operations, so a kernel body written
+against them compiles unchanged for every ISA. Only the kernel .cpp files
+include this; they include their kernel bodies into the same namespaces,
+inside the same target regions.
+*/
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define SIMD_KERNELS_X86 0
+#endif
+
+// Scalar path: one lane. Also handles the tails of the vector paths.
+namespace scalar_kernels {
+    typedef float V;
+    typedef int32_t VI;
+    typedef bool M;
+    const int WIDTH = 1;
+
+    static inline V set(float value) { return value; }
+    static inline V load(const float* p) { return *p; }
+    static inline void store(float* p, V value) { *p = value; }
+    static inline V add(V a, V b) { return a + b; }
+    static inline V sub(V a, V b) { return a - b; }
+    static inline V mul(V a, V b) { return a * b; }
+    // Same operand order and zero handling as minps/maxps
+    static inline V vmin(V a, V b) { return a < b ? a : b; }
+    static inline V vmax(V a, V b) { return a > b ? a : b; }
+    static inline V vfloor(V a) { return std::floor(a); }
+    static inline M less(V a, V b) { return a < b; }
+    static inline M lessEqual(V a, V b) { return a <= b; }
+    static inline V select(M mask, V a, V b) { return mask ? a : b; }
+
+    static inline VI iset(int32_t value) { return value; }
+    // Integer arithmetic wraps, as in the vector paths
+    static inline VI iadd(VI a, VI b) { return static_cast<VI>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+    static inline VI isub(VI a, VI b) { return static_cast<VI>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+    static inline VI imul(VI a, VI b) { return static_cast<VI>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+    static inline VI iand(VI a, VI b) { return a & b; }
+    static inline VI ior(VI a, VI b) { return a | b; }
+    static inline VI ixor(VI a, VI b) { return a ^ b; }
+    static inline M iequal(VI a, VI b) { return a == b; }
+    static inline VI shiftLeft23(VI a) { return static_cast<VI>(static_cast<uint32_t>(a) << 23); }
+    static inline VI shiftRight23(VI a) { return static_cast<VI>(static_cast<uint32_t>(a) >> 23); }
+    template <int Bits> static inline VI shiftRightLogical(VI a) { return static_cast<VI>(static_cast<uint32_t>(a) >> Bits); }
+    // 0, 1, ... WIDTH - 1
+    static inline VI laneIndices() { return 0; }
+    static inline VI toInt(V a) { return static_cast<VI>(a); }
+    static inline V toFloat(VI a) { return static_cast<V>(a); }
+    static inline VI asInt(V a) { VI bits; std::memcpy(&bits, &a, sizeof(bits)); return bits; }
+    static inline V asFloat(VI a) { V value; std::memcpy(&value, &a, sizeof(value)); return value; }
+    static inline VI gather(const int32_t* table, VI index) { return table[index]; }
+}
+
+#if SIMD_KERNELS_X86
+
+#if defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace sse41_kernels {
+    typedef __m128 V;
+    typedef __m128i VI;
+    typedef __m128 M;
+    const int WIDTH = 4;
+
+    static inline V set(float value) { return _mm_set1_ps(value); }
+    static inline V load(const float* p) { return _mm_loadu_ps(p); }
+    static inline void store(float* p, V value) { _mm_storeu_ps(p, value); }
+    static inline V add(V a, V b) { return _mm_add_ps(a, b); }
+    static inline V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static inline V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static inline V vmin(V a, V b) { return _mm_min_ps(a, b); }
+    static inline V vmax(V a, V b) { return _mm_max_ps(a, b); }
+    static inline V vfloor(V a) { return _mm_floor_ps(a); }
+    static inline M less(V a, V b) { return _mm_cmplt_ps(a, b); }
+    static inline M lessEqual(V a, V b) { return _mm_cmple_ps(a, b); }
+    static inline V select(M mask, V a, V b) { return _mm_blendv_ps(b, a, mask); }
+
+    static inline VI iset(int32_t value) { return _mm_set1_epi32(value); }
+    static inline VI iadd(VI a, VI b) { return _mm_add_epi32(a, b); }
+    static inline VI isub(VI a, VI b) { return _mm_sub_epi32(a, b); }
+    static inline VI imul(VI a, VI b) { return _mm_mullo_epi32(a, b); }
+    static inline VI iand(VI a, VI b) { return _mm_and_si128(a, b); }
+    static inline VI ior(VI a, VI b) { return _mm_or_si128(a, b); }
+    static inline VI ixor(VI a, VI b) { return _mm_xor_si128(a, b); }
+    static inline M iequal(VI a, VI b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+    static inline VI shiftLeft23(VI a) { return _mm_slli_epi32(a, 23); }
+    static inline VI shiftRight23(VI a) { return _mm_srli_epi32(a, 23); }
+    template <int Bits> static inline VI shiftRightLogical(VI a) { return _mm_srli_epi32(a, Bits); }
+    static inline VI laneIndices() { return _mm_setr_epi32(0, 1, 2, 3); }
+    static inline VI toInt(V a) { return _mm_cvttps_epi32(a); }
+    static inline V toFloat(VI a) { return _mm_cvtepi32_ps(a); }
+    static inline VI asInt(V a) { return _mm_castps_si128(a); }
+    static inline V asFloat(VI a) { return _mm_castsi128_ps(a); }
+    // No gather before AVX2
+    static inline VI gather(const int32_t* table, VI index) {
+        return _mm_setr_epi32(table[_mm_extract_epi32(index, 0)], table[_mm_extract_epi32(index, 1)],
+            table[_mm_extract_epi32(index, 2)], table[_mm_extract_epi32(index, 3)]);
+    }
+}
+
+#if defined(__GNUC__)
+#pragma GCC pop_options
+// No "fma": the compiler must not fuse multiply-adds, or this path would
+// round differently from the others
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2_kernels {
+    typedef __m256 V;
+    typedef __m256i VI;
+    typedef __m256 M;
+    const int WIDTH = 8;
+
+    static inline V set(float value) { return _mm256_set1_ps(value); }
+    static inline V load(const float* p) { return _mm256_loadu_ps(p); }
+    static inline void store(float* p, V value) { _mm256_storeu_ps(p, value); }
+    static inline V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static inline V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static inline V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static inline V vmin(V a, V b) { return _mm256_min_ps(a, b); }
+    static inline V vmax(V a, V b) { return _mm256_max_ps(a, b); }
+    static inline V vfloor(V a) { return _mm256_floor_ps(a); }
+    static inline M less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline M lessEqual(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static inline V select(M mask, V a, V b) { return _mm256_blendv_ps(b, a, mask); }
+
+    static inline VI iset(int32_t value) { return _mm256_set1_epi32(value); }
+    static inline VI iadd(VI a, VI b) { return _mm256_add_epi32(a, b); }
+    static inline VI isub(VI a, VI b) { return _mm256_sub_epi32(a, b); }
+    static inline VI imul(VI a, VI b) { return _mm256_mullo_epi32(a, b); }
+    static inline VI iand(VI a, VI b) { return _mm256_and_si256(a, b); }
+    static inline VI ior(VI a, VI b) { return _mm256_or_si256(a, b); }
+    static inline VI ixor(VI a, VI b) { return _mm256_xor_si256(a, b); }
+    static inline M iequal(VI a, VI b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+    static inline VI shiftLeft23(VI a) { return _mm256_slli_epi32(a, 23); }
+    static inline VI shiftRight23(VI a) { return _mm256_srli_epi32(a, 23); }
+    template <int Bits> static inline VI shiftRightLogical(VI a) { return _mm256_srli_epi32(a, Bits); }
+    static inline VI laneIndices() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+    static inline VI toInt(V a) { return _mm256_cvttps_epi32(a); }
+    static inline V toFloat(VI a) { return _mm256_cvtepi32_ps(a); }
+    static inline VI asInt(V a) { return _mm256_castps_si256(a); }
+    static inline V asFloat(VI a) { return _mm256_castsi256_ps(a); }
+    static inline VI gather(const int32_t* table, VI index) { return _mm256_i32gather_epi32(table, index, 4); }
+}
+
+#if defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif  // SIMD_KERNELS_X86
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "Heightfield.h"
+#include "ThreadPool.h"
+
+/*
+Per-cell terrain stages as compile-time functors, and the passes that run
+them over a grid.
+
+A row stage works on one grid row of count cells:
+    static constexpr int scratchRows;  // floats of scratch needed, in rows
+    void operator()(int x, float* row, int count, float* scratch) const;
+It may rewrite row or only read it (e.g. to emit derived layers). scratch
+holds scratchRows * count floats that no other call is using.
+
+A stencil stage turns a row and its neighbors into one output row:
+    void operator()(int x, const float* above, const float* center,
+                    const float* below, float* out, int count) const;
+above and below are null on the first and last rows.
+
+RowChain<A, B, ...> runs row stages back to back on a row while it is in
+cache. runStaged makes one full pass per step, runFused one pass in total;
+both call the same functors on the same values, so their output is
+identical.
+*/
+
+template <typename... Stages>
+class RowChain {
+private:
+    std::tuple<Stages...> stages;
+
+    template <size_t... I>
+    void apply(int x, float* row, int count, float* scratch, std::index_sequence<I...>) const {
+        // Unused by the empty chain
+        (void)x;
+        (void)row;
+        (void)count;
+        (void)scratch;
+        (std::get<I>(stages)(x, row, count, scratch), ...);
+    }
+
+public:
+    static constexpr int scratchRows = std::max({ 0, Stages::scratchRows... });
+
+    explicit RowChain(const Stages&... s) : stages(s...) {}
+
+    void operator()(int x, float* row, int count, float* scratch) const {
+        apply(x, row, count, scratch, std::index_sequence_for<Stages...>());
+    }
+};
+
+template <typename... Stages>
+RowChain<Stages...> makeRowChain(const Stages&... stages) {
+    return RowChain<Stages...>(stages...);
+}
+
+// Reference form: pre over every row of map, then the stencil into scratch,
+// then post over every output row. map ends up holding the output. With
+// passSeconds, the time of each of the three passes is written to it.
+template <typename Pre, typename Stencil, typename Post>
+void runStaged(Heightfield& map, Heightfield& scratch, std::vector<float>& stageScratch,
+    const Pre& pre, const Stencil& stencil, const Post& post, double* passSeconds = nullptr) {
+    typedef std::chrono::steady_clock Clock;
+    int rows = map.rows();
+    int cols = map.cols();
+    if (!scratch.sameShape(map)) scratch.resize(rows, cols);
+    stageScratch.resize(static_cast<size_t>(std::max(Pre::scratchRows, Post::scratchRows)) * cols);
+
+    Clock::time_point start = Clock::now();
+    auto lap = [&](int pass) {
+        if (!passSeconds) return;
+        Clock::time_point now = Clock::now();
+        passSeconds[pass] = std::chrono::duration<double>(now - start).count();
+        start = now;
+    };
+
+    for (int x = 0; x < rows; ++x) pre(x, map.row(x), cols, stageScratch.data());
+    lap(0);
+    for (int x = 0; x < rows; ++x) {
+        const float* above = x > 0 ? map.row(x - 1) : nullptr;
+        const float* below = x + 1 < rows ? map.row(x + 1) : nullptr;
+        stencil(x, above, map.row(x), below, scratch.row(x), cols);
+    }
+    map.swap(scratch);
+    lap(1);
+    for (int x = 0; x < rows; ++x) post(x, map.row(x), cols, stageScratch.data());
+    lap(2);
+}
+
+/*
+Same result in one sweep. Rows are split into bands of bandRows, run on
+pool when there is one. A band keeps its last three pre-processed rows in a
+small window and recomputes the row on each side of it, so bands share
+nothing but the read-only input. map is left untouched until the final swap.
+*/
+template <typename Pre, typename Stencil, typename Post>
+void runFused(Heightfield& map, Heightfield& scratch, std::vector<float>& stageScratch, int bandRows,
+    ThreadPool* pool, const Pre& pre, const Stencil& stencil, const Post& post) {
+    int rows = map.rows();
+    int cols = map.cols();
+    if (!scratch.sameShape(map)) scratch.resize(rows, cols);
+
+    bandRows = std::max(1, bandRows);
+    int bands = (rows + bandRows - 1) / bandRows;
+    size_t window = static_cast<size_t>(3 + std::max(Pre::scratchRows, Post::scratchRows)) * cols;
+    stageScratch.resize(window * bands);
+
+    const Heightfield& input = map;
+    auto runBand = [&](int band) {
+        float* base = stageScratch.data() + window * band;
+        float* slots[3] = { base, base + cols, base + 2 * cols };
+        float* stageRows = base + 3 * cols;
+
+        // Pre-processed row r lives in slots[r % 3]
+        auto load = [&](int r) {
+            float* row = slots[r % 3];
+            std::memcpy(row, input.row(r), cols * sizeof(float));
+            pre(r, row, cols, stageRows);
+        };
+
+        int begin = band * bandRows;
+        int end = std::min(rows, begin + bandRows);
+        if (begin > 0) load(begin - 1);
+        load(begin);
+        for (int x = begin; x < end; ++x) {
+            if (x + 1 < rows) load(x + 1);
+            const float* above = x > 0 ? slots[(x - 1) % 3] : nullptr;
+            const float* below = x + 1 < rows ? slots[(x + 1) % 3] : nullptr;
+            stencil(x, above, slots[x % 3], below, scratch.row(x), cols);
+            post(x, scratch.row(x), cols, stageRows);
+        }
+    };
+
+    if (pool) pool->parallelFor(bands, runBand);
+    else for (int band = 0; band < bands; ++band) runBand(band);
+
+    map.swap(scratch);
+}
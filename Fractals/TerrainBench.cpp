@@ -0,0 +1,229 @@
+// Stage benchmark for chunk generation, for tracking regressions over time.
+//
+//   fractals-bench [options]
+//     --sizes A,B,...     chunk sizes, powers of two (128,256,512,1024,2048,4096)
+//     --threads A,B,...   pool sizes (1, then powers of two up to the core count)
+//     --chunks N          measured chunks per configuration, after a warm-up (3)
+//     --erosion MODE      thermal or hydraulic (thermal)
+//     --fused             run the production fused post-erosion pass; biome
+//                         variation and the second smoothing pass then count
+//                         toward surface
+//     --json              one JSON object per line instead of CSV
+//
+// Each configuration generates one warm-up chunk and then --chunks distinct
+// chunks with the same generator and arena, so the numbers are for steady
+// state. Per stage it reports the median time per chunk and cells per second;
+// the chunk row adds heap allocations per chunk, which need the allocation
+// counter (the CMake target builds with it). Cloud generation doesn't use the
+// pool and is measured once per size.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "ChunkGenerator.h"
+#include "CloudGenerator.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+
+namespace {
+    struct Options {
+        std::vector<int> sizes = { 128, 256, 512, 1024, 2048, 4096 };
+        std::vector<int> threads;
+        int chunks = 3;
+        ErosionMode erosion = EROSION_THERMAL;
+        bool fused = false;
+        bool json = false;
+    };
+
+    struct Result {
+        const char* stage;
+        int size;
+        int threads;
+        double seconds;       // Median per chunk
+        double allocations;   // Mean per chunk, or negative when not measured
+    };
+
+    const unsigned int BENCH_SEED = 12345;
+
+    void usage() {
+        std::fprintf(stderr,
+            "usage: fractals-bench [--sizes A,B,...] [--threads A,B,...] [--chunks N]\n"
+            "                      [--erosion thermal|hydraulic] [--fused] [--json]\n");
+    }
+
+    bool parseList(const char* text, std::vector<int>& values) {
+        values.clear();
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            char* end;
+            long value = std::strtol(item.c_str(), &end, 10);
+            if (item.empty() || *end != '\0' || value <= 0) return false;
+            values.push_back(static_cast<int>(value));
+        }
+        return !values.empty();
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            std::vector<int> chunks;
+            if (arg == "--sizes" && hasValue && parseList(argv[i + 1], options.sizes)) {
+                ++i;
+            }
+            else if (arg == "--threads" && hasValue && parseList(argv[i + 1], options.threads)) {
+                ++i;
+            }
+            else if (arg == "--chunks" && hasValue && parseList(argv[i + 1], chunks) && chunks.size() == 1) {
+                options.chunks = chunks[0];
+                ++i;
+            }
+            else if (arg == "--erosion" && hasValue &&
+                (std::strcmp(argv[i + 1], "thermal") == 0 || std::strcmp(argv[i + 1], "hydraulic") == 0)) {
+                options.erosion = std::strcmp(argv[i + 1], "hydraulic") == 0 ? EROSION_HYDRAULIC : EROSION_THERMAL;
+                ++i;
+            }
+            else if (arg == "--fused") {
+                options.fused = true;
+            }
+            else if (arg == "--json") {
+                options.json = true;
+            }
+            else {
+                std::fprintf(stderr, "bad argument: %s\n", argv[i]);
+                return false;
+            }
+        }
+        for (int size : options.sizes) {
+            if (size < 2 || (size & (size - 1)) != 0) {
+                std::fprintf(stderr, "sizes must be powers of two\n");
+                return false;
+            }
+        }
+        if (options.threads.empty()) {
+            int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+            for (int count = 1; count < cores; count *= 2) options.threads.push_back(count);
+            options.threads.push_back(cores);
+        }
+        return true;
+    }
+
+    double median(std::vector<double> samples) {
+        std::sort(samples.begin(), samples.end());
+        size_t middle = samples.size() / 2;
+        return samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) * 0.5;
+    }
+
+    void benchChunks(const Options& options, int size, int threadCount, std::vector<Result>& results) {
+        // A one-thread pool would run inline anyway; without one the fused
+        // pass also skips its band split, as in a single-threaded viewer
+        std::unique_ptr<ThreadPool> pool;
+        if (threadCount > 1) pool.reset(new ThreadPool(threadCount));
+
+        ChunkGenerator generator(size);
+        generator.setThreadPool(pool.get());
+        generator.setErosionMode(options.erosion);
+        generator.setStageFusion(options.fused);
+        generator.setStageSnapshots(false);
+        ScratchArena arena;
+        generator.generateChunk(BENCH_SEED, 0, 0, arena);
+
+        enum { DIAMOND_SQUARE, SMOOTH_PEAKS, EROSION, BIOME_VARIATION, SURFACE, MESH, CHUNK, STAGE_COUNT };
+        static const char* const STAGE_NAMES[STAGE_COUNT] = {
+            "diamondSquare", "smoothPeaks", "erosion", "biomeVariation", "surface", "mesh", "chunk"
+        };
+        std::vector<double> samples[STAGE_COUNT];
+        long long allocations = 0;
+        for (int i = 1; i <= options.chunks; ++i) {
+            long long allocationsBefore = allocationCount();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            generator.generateChunk(BENCH_SEED, i, 0, arena);
+            double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            allocations += allocationCount() - allocationsBefore;
+
+            const ChunkTimings& timings = generator.getTimings();
+            samples[DIAMOND_SQUARE].push_back(timings.diamondSquare);
+            samples[SMOOTH_PEAKS].push_back(timings.smoothPeaks);
+            samples[EROSION].push_back(timings.erosion);
+            samples[BIOME_VARIATION].push_back(timings.biomeVariation);
+            samples[SURFACE].push_back(timings.surface);
+            samples[MESH].push_back(timings.mesh);
+            samples[CHUNK].push_back(total);
+        }
+
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            // Fused, biome variation has no time of its own
+            if (stage == BIOME_VARIATION && options.fused) continue;
+            double perChunk = stage == CHUNK && allocationCountingEnabled() ?
+                static_cast<double>(allocations) / options.chunks : -1.0;
+            results.push_back({ STAGE_NAMES[stage], size, threadCount, median(samples[stage]), perChunk });
+        }
+    }
+
+    void benchClouds(const Options& options, int size, std::vector<Result>& results) {
+        CloudGenerator clouds(size, BENCH_SEED);
+        clouds.regenerateClouds(BENCH_SEED);
+        std::vector<double> samples;
+        long long allocations = 0;
+        for (int i = 1; i <= options.chunks; ++i) {
+            long long allocationsBefore = allocationCount();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            clouds.regenerateClouds(BENCH_SEED + i);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            allocations += allocationCount() - allocationsBefore;
+            samples.push_back(seconds);
+        }
+        double perChunk = allocationCountingEnabled() ? static_cast<double>(allocations) / options.chunks : -1.0;
+        results.push_back({ "clouds", size, 1, median(samples), perChunk });
+    }
+
+    void printResult(const Options& options, const Result& result) {
+        double cells = static_cast<double>(result.size + 1) * (result.size + 1);
+        double cellsPerSecond = result.seconds > 0.0 ? cells / result.seconds : 0.0;
+        const char* erosion = options.erosion == EROSION_HYDRAULIC ? "hydraulic" : "thermal";
+        const char* simd = simdLevelName(activeSimdLevel());
+        char allocations[32] = "";
+        if (result.allocations >= 0.0) std::snprintf(allocations, sizeof(allocations), "%.1f", result.allocations);
+
+        if (options.json) {
+            std::printf("{\"stage\":\"%s\",\"size\":%d,\"threads\":%d,\"erosion\":\"%s\",\"fused\":%s,"
+                "\"simd\":\"%s\",\"ms_per_chunk\":%.4f,\"cells_per_s\":%.0f,\"allocations_per_chunk\":%s}\n",
+                result.stage, result.size, result.threads, erosion, options.fused ? "true" : "false", simd,
+                result.seconds * 1000.0, cellsPerSecond, allocations[0] ? allocations : "null");
+        }
+        else {
+            std::printf("%s,%d,%d,%s,%d,%s,%.4f,%.0f,%s\n", result.stage, result.size, result.threads, erosion,
+                options.fused ? 1 : 0, simd, result.seconds * 1000.0, cellsPerSecond, allocations);
+        }
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    if (!options.json) {
+        std::printf("stage,size,threads,erosion,fused,simd,ms_per_chunk,cells_per_s,allocations_per_chunk\n");
+    }
+    for (int size : options.sizes) {
+        std::vector<Result> results;
+        benchClouds(options, size, results);
+        for (int threadCount : options.threads) benchChunks(options, size, threadCount, results);
+        for (const Result& result : results) printResult(options, result);
+    }
+    return 0;
+}
@@ -0,0 +1,347 @@
+// Headless terrain generator: builds a range of chunks in parallel and
+// writes their height and material layers to disk.
+//
+//   fractals-terrain [options]
+//     --seed N            world seed (12345)
+//     --range X0 Y0 X1 Y1 inclusive chunk range (0 0 3 3)
+//     --size N            cells per chunk side, a power of two (256)
+//     --threads N         worker threads, 0 for all cores (0)
+//     --erosion MODE      thermal or hydraulic (thermal)
+//     --format FORMAT     pgm or raw (pgm)
+//     --out DIR           output directory (terrain_out)
+//     --cache DIR         reuse and fill a chunk cache in DIR
+//     --map               bake the range as one continuous map instead
+//     --budget MB         tile memory for --map (256)
+//
+// Each chunk (x, y) writes chunk_x_y heights as 16-bit samples (big-endian
+// P5 PGM, or little-endian .r16 raw) and chunk_x_y_material as one byte per
+// cell holding the TerrainMaterial class.
+//
+// With --map the range is baked out of core (MapBaker.h) into map.tiles,
+// then exported the same way as map and map_material. Memory stays near
+// the budget for any map size, e.g. --range 0 0 127 127 for 32k x 32k.
+// Only thermal erosion is supported there.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ChunkCache.h"
+#include "ChunkGenerator.h"
+#include "MapBaker.h"
+#include "MapExport.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "TiledHeightfield.h"
+
+namespace {
+    struct Options {
+        unsigned int seed = 12345;
+        int x0 = 0, y0 = 0, x1 = 3, y1 = 3;
+        int size = 256;
+        int threads = 0;
+        ErosionMode erosion = EROSION_THERMAL;
+        bool raw = false;
+        std::string out = "terrain_out";
+        std::string cache;
+        bool map = false;
+        int budgetMegabytes = 256;
+    };
+
+    // One per thread: a generator and its arena are never shared
+    struct Worker {
+        std::unique_ptr<ChunkGenerator> generator;
+        ScratchArena arena;
+        ChunkTimings totals;
+        int generated = 0;
+        int loaded = 0;
+        bool failed = false;
+    };
+
+    void usage() {
+        std::fprintf(stderr,
+            "usage: fractals-terrain [--seed N] [--range X0 Y0 X1 Y1] [--size N] [--threads N]\n"
+            "                        [--erosion thermal|hydraulic] [--format pgm|raw] [--out DIR]\n"
+            "                        [--cache DIR] [--map] [--budget MB]\n");
+    }
+
+    bool parseInt(const char* text, int& value) {
+        char* end;
+        long parsed = std::strtol(text, &end, 10);
+        if (*text == '\0' || *end != '\0') return false;
+        value = static_cast<int>(parsed);
+        return true;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            int remaining = argc - i - 1;
+            int value;
+            if (arg == "--seed" && remaining >= 1 && parseInt(argv[i + 1], value)) {
+                options.seed = static_cast<unsigned int>(value);
+                i += 1;
+            }
+            else if (arg == "--range" && remaining >= 4 && parseInt(argv[i + 1], options.x0) &&
+                parseInt(argv[i + 2], options.y0) && parseInt(argv[i + 3], options.x1) &&
+                parseInt(argv[i + 4], options.y1)) {
+                i += 4;
+            }
+            else if (arg == "--size" && remaining >= 1 && parseInt(argv[i + 1], options.size)) {
+                i += 1;
+            }
+            else if (arg == "--threads" && remaining >= 1 && parseInt(argv[i + 1], options.threads)) {
+                i += 1;
+            }
+            else if (arg == "--erosion" && remaining >= 1 &&
+                (std::strcmp(argv[i + 1], "thermal") == 0 || std::strcmp(argv[i + 1], "hydraulic") == 0)) {
+                options.erosion = std::strcmp(argv[i + 1], "hydraulic") == 0 ? EROSION_HYDRAULIC : EROSION_THERMAL;
+                i += 1;
+            }
+            else if (arg == "--format" && remaining >= 1 &&
+                (std::strcmp(argv[i + 1], "pgm") == 0 || std::strcmp(argv[i + 1], "raw") == 0)) {
+                options.raw = std::strcmp(argv[i + 1], "raw") == 0;
+                i += 1;
+            }
+            else if (arg == "--out" && remaining >= 1) {
+                options.out = argv[++i];
+            }
+            else if (arg == "--cache" && remaining >= 1) {
+                options.cache = argv[++i];
+            }
+            else if (arg == "--map") {
+                options.map = true;
+            }
+            else if (arg == "--budget" && remaining >= 1 && parseInt(argv[i + 1], options.budgetMegabytes) &&
+                options.budgetMegabytes > 0) {
+                i += 1;
+            }
+            else {
+                std::fprintf(stderr, "bad argument: %s\n", argv[i]);
+                return false;
+            }
+        }
+        if (options.size < 2 || (options.size & (options.size - 1)) != 0) {
+            std::fprintf(stderr, "--size must be a power of two\n");
+            return false;
+        }
+        if (options.x1 < options.x0 || options.y1 < options.y0) {
+            std::fprintf(stderr, "--range is empty\n");
+            return false;
+        }
+        if (options.map && (options.erosion == EROSION_HYDRAULIC || !options.cache.empty())) {
+            std::fprintf(stderr, "--map supports neither hydraulic erosion nor --cache\n");
+            return false;
+        }
+        return true;
+    }
+
+    bool writeFile(const std::string& path, const char* header, const std::vector<uint8_t>& payload) {
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        size_t headerBytes = std::strlen(header);
+        bool written = std::fwrite(header, 1, headerBytes, file) == headerBytes &&
+            std::fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+        return std::fclose(file) == 0 && written;
+    }
+
+    // Heights are normalized to [0, 1]; stored as 0..65535
+    bool writeHeights(const std::string& base, const Heightfield& heights, bool raw, std::vector<uint8_t>& buffer) {
+        int rows = heights.rows();
+        int cols = heights.cols();
+        buffer.resize(static_cast<size_t>(rows) * cols * 2);
+        // Image rows run along y, so the first file row is the x = 0 .. rows-1 line at y = 0
+        uint8_t* out = buffer.data();
+        for (int y = 0; y < cols; ++y) {
+            for (int x = 0; x < rows; ++x) {
+                float h = std::min(1.0f, std::max(0.0f, heights(x, y)));
+                uint16_t sample = static_cast<uint16_t>(std::lround(h * 65535.0f));
+                // PGM is big-endian; raw follows the usual little-endian .r16 layout
+                out[raw ? 0 : 1] = static_cast<uint8_t>(sample & 0xff);
+                out[raw ? 1 : 0] = static_cast<uint8_t>(sample >> 8);
+                out += 2;
+            }
+        }
+        if (raw) return writeFile(base + ".r16", "", buffer);
+        char header[64];
+        std::snprintf(header, sizeof(header), "P5\n%d %d\n65535\n", rows, cols);
+        return writeFile(base + ".pgm", header, buffer);
+    }
+
+    bool writeMaterials(const std::string& base, const MaterialLayer& materials, bool raw, std::vector<uint8_t>& buffer) {
+        int rows = materials.rows();
+        int cols = materials.cols();
+        buffer.resize(static_cast<size_t>(rows) * cols);
+        for (int y = 0; y < cols; ++y) {
+            for (int x = 0; x < rows; ++x) buffer[static_cast<size_t>(y) * rows + x] = materials(x, y);
+        }
+        if (raw) return writeFile(base + "_material.raw", "", buffer);
+        char header[64];
+        std::snprintf(header, sizeof(header), "P5\n%d %d\n%d\n", rows, cols, MATERIAL_COUNT - 1);
+        return writeFile(base + "_material.pgm", header, buffer);
+    }
+
+    int bakeMap(const Options& options, ThreadPool& pool) {
+        MapBakeSettings settings;
+        settings.worldSeed = options.seed;
+        settings.chunkX = options.x0;
+        settings.chunkY = options.y0;
+        settings.chunksX = options.x1 - options.x0 + 1;
+        settings.chunksY = options.y1 - options.y0 + 1;
+        settings.chunkSize = options.size;
+        int threadCount = pool.threadCount();
+        MapBaker baker(settings, threadCount > 1 ? &pool : nullptr);
+
+        // Half the budget per layer, but never less than a tile per thread
+        size_t tileBytes = static_cast<size_t>(options.size) * options.size * sizeof(float);
+        size_t slotBytes = (tileBytes + TiledHeightfield::SLOT_ALIGNMENT - 1) / TiledHeightfield::SLOT_ALIGNMENT *
+            TiledHeightfield::SLOT_ALIGNMENT;
+        size_t budget = std::max((static_cast<size_t>(options.budgetMegabytes) << 20) / 2, slotBytes * threadCount);
+
+        std::string basePath = (std::filesystem::path(options.out) / "map_base.tiles").string();
+        std::string mapPath = (std::filesystem::path(options.out) / "map.tiles").string();
+        TiledHeightfield base;
+        TiledHeightfield map;
+        if (!base.create(basePath, baker.rows(), baker.cols(), options.size, budget) ||
+            !map.create(mapPath, baker.rows(), baker.cols(), options.size, budget)) {
+            std::fprintf(stderr, "cannot create %s\n", mapPath.c_str());
+            return 1;
+        }
+        std::printf("%d x %d map in %d tiles of %d^2, %d threads, %zu tiles mapped per layer, %s\n",
+            baker.rows(), baker.cols(), map.tileCount(), options.size, threadCount, map.tileBudget(),
+            simdLevelName(activeSimdLevel()));
+
+        bool baked = baker.bake(base, map);
+        base.close();
+        std::error_code error;
+        std::filesystem::remove(basePath, error);
+        if (!baked) {
+            std::fprintf(stderr, "cannot map tiles of %s\n", mapPath.c_str());
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::string exportBase = (std::filesystem::path(options.out) / "map").string();
+        bool exported = exportMap(exportBase, map, options.raw);
+        double exportSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!exported) {
+            std::fprintf(stderr, "cannot write %s\n", exportBase.c_str());
+            return 1;
+        }
+
+        const MapBakeTimings& timings = baker.getTimings();
+        double cells = static_cast<double>(baker.rows()) * baker.cols();
+        std::printf("  diamond-square %8.3f s\n", timings.base);
+        std::printf("  finish         %8.3f s (halo %d)\n", timings.finish, MapBaker::haloCells(settings.erosion));
+        std::printf("  export         %8.3f s\n", exportSeconds);
+        std::printf("%.2f Mcells/s\n", cells / (timings.base + timings.finish) * 1e-6);
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.out, error);
+    if (error) {
+        std::fprintf(stderr, "cannot create %s: %s\n", options.out.c_str(), error.message().c_str());
+        return 1;
+    }
+
+    std::unique_ptr<ChunkCache> cache;
+    if (!options.cache.empty()) {
+        ChunkCacheSettings cacheSettings;
+        cacheSettings.directory = options.cache;
+        cache.reset(new ChunkCache(cacheSettings));
+    }
+
+    ThreadPool pool(options.threads);
+    if (options.map) return bakeMap(options, pool);
+
+    // Parallelism is across chunks; each generator runs its own stages inline
+    int threadCount = pool.threadCount();
+    std::vector<Worker> workers(threadCount);
+    for (Worker& worker : workers) {
+        worker.generator.reset(new ChunkGenerator(options.size));
+        worker.generator->setErosionMode(options.erosion);
+        worker.generator->setMeshBuilding(false);
+        worker.generator->setStageSnapshots(false);
+    }
+
+    int columns = options.x1 - options.x0 + 1;
+    int chunkCount = columns * (options.y1 - options.y0 + 1);
+    std::atomic<int> nextChunk(0);
+    std::printf("%d chunks of %d^2, %d threads, %s erosion, %s\n", chunkCount, options.size, threadCount,
+        options.erosion == EROSION_HYDRAULIC ? "hydraulic" : "thermal", simdLevelName(activeSimdLevel()));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.parallelFor(threadCount, [&](int index) {
+        Worker& worker = workers[index];
+        ChunkGenerator& generator = *worker.generator;
+        std::vector<uint8_t> buffer;
+        for (int i = nextChunk++; i < chunkCount; i = nextChunk++) {
+            int x = options.x0 + i % columns;
+            int y = options.y0 + i / columns;
+            if (cache && generator.loadChunk(*cache, options.seed, x, y, worker.arena)) {
+                ++worker.loaded;
+            }
+            else {
+                generator.generateChunk(options.seed, x, y, worker.arena);
+                if (cache) generator.storeChunk(*cache, worker.arena);
+                const ChunkTimings& timings = generator.getTimings();
+                worker.totals.diamondSquare += timings.diamondSquare;
+                worker.totals.smoothPeaks += timings.smoothPeaks;
+                worker.totals.erosion += timings.erosion;
+                worker.totals.surface += timings.surface;
+                ++worker.generated;
+            }
+
+            std::string base = (std::filesystem::path(options.out) /
+                ("chunk_" + std::to_string(x) + "_" + std::to_string(y))).string();
+            if (!writeHeights(base, generator.getHeights(), options.raw, buffer) ||
+                !writeMaterials(base, generator.getMaterials(), options.raw, buffer)) {
+                std::fprintf(stderr, "cannot write %s\n", base.c_str());
+                worker.failed = true;
+            }
+        }
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ChunkTimings totals;
+    int generated = 0;
+    int loaded = 0;
+    bool failed = false;
+    for (const Worker& worker : workers) {
+        totals.diamondSquare += worker.totals.diamondSquare;
+        totals.smoothPeaks += worker.totals.smoothPeaks;
+        totals.erosion += worker.totals.erosion;
+        totals.surface += worker.totals.surface;
+        generated += worker.generated;
+        loaded += worker.loaded;
+        failed = failed || worker.failed;
+    }
+
+    // Stage times are summed over threads, so they can exceed the wall time
+    double perChunk = generated > 0 ? 1000.0 / generated : 0.0;
+    std::printf("generated %d, loaded from cache %d\n", generated, loaded);
+    std::printf("  diamond-square %8.1f ms total %7.2f ms/chunk\n", totals.diamondSquare * 1000.0, totals.diamondSquare * perChunk);
+    std::printf("  smooth peaks   %8.1f ms total %7.2f ms/chunk\n", totals.smoothPeaks * 1000.0, totals.smoothPeaks * perChunk);
+    std::printf("  erosion        %8.1f ms total %7.2f ms/chunk\n", totals.erosion * 1000.0, totals.erosion * perChunk);
+    std::printf("  surface        %8.1f ms total %7.2f ms/chunk\n", totals.surface * 1000.0, totals.surface * perChunk);
+    std::printf("wall %.3f s, %.2f chunks/s\n", wall, chunkCount / wall);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Frustum.h"
+#include "Heightfield.h"
+
+/*
+Continuous distance-based LOD over a chunk's heightfield (CDLOD-style).
+
+Level L samples the chunk every 2^L cells. Each level is split into square
+patches of LOD_PATCH_CELLS x LOD_PATCH_CELLS cells, which are the quadtree
+nodes: the root is the whole chunk at the coarsest level and every node has
+four children one level finer.
+
+A node at level L is drawn when the camera is at least range(L - 1) away
+from it in the ground plane, otherwise it is split. Ranges double per level,
+and the base range is large compared to a node (see LodSettings), so drawn
+neighbors never differ by more than one level.
+
+Every vertex also stores zMorph, the height the next coarser level has at the
+same position. The vertex shader blends towards it over the last part of the
+level's range, so a node reaches the coarse shape exactly where its coarser
+neighbor begins. That removes popping, and leaves no cracks at LOD or chunk
+boundaries: border vertices only ever interpolate along the shared edge.
+
+Each node also keeps the height range of the full-resolution cells under it.
+Morphed heights are averages of those cells, so the range bounds whatever is
+drawn for the node at any distance, and selection uses it to skip nodes
+outside the view frustum.
+*/
+
+const int LOD_PATCH_CELLS = 16;
+
+// color.rgb is the palette color for fixed-function drawing; color.a holds the
+// material ID, which the shader path resolves through the palette texture.
+struct LodVertex {
+    float x, y, z;
+    float zMorph;
+    uint8_t color[4];
+};
+
+struct LodBounds {
+    float minZ;
+    float maxZ;
+};
+
+struct LodLevel {
+    int stride = 1;  // Grid spacing in cells
+    int side = 0;    // Vertices per side; vertex (i, j) is stored at i * side + j
+    std::vector<LodVertex> vertices;
+    std::vector<LodBounds> patchBounds;  // Patch (px, py) is stored at px * patchesPerSide + py
+};
+
+struct LodNode {
+    int level;
+    int patchX;
+    int patchY;
+};
+
+struct LodSettings {
+    float baseRange = 256.0f;       // Distance at which level 0 hands over to level 1
+    float morphStartRatio = 0.7f;   // Morph runs over [ratio * range, range]
+
+    float range(int level) const { return baseRange * static_cast<float>(1 << level); }
+    float morphStart(int level) const { return range(level) * morphStartRatio; }
+    float morphEnd(int level) const { return range(level); }
+
+    // Smallest base range that keeps neighbors within one level of each other
+    // for a given morph ratio: the morph window of level L + 1 must lie beyond
+    // range(L) plus the diagonal of a level L + 1 node.
+    static float minimumBaseRange(float morphRatio) {
+        float parentDiagonal = std::sqrt(2.0f) * 2.0f * LOD_PATCH_CELLS;
+        return parentDiagonal / (2.0f * morphRatio - 1.0f);
+    }
+
+    // Level 0 hands over where one grid cell projects to pixelError pixels
+    static LodSettings fromScreenError(float viewportHeight, float fovYDegrees, float pixelError) {
+        const float degreesToRadians = 3.14159265358979323846f / 180.0f;
+        float projectionScale = viewportHeight / (2.0f * std::tan(fovYDegrees * 0.5f * degreesToRadians));
+
+        LodSettings settings;
+        settings.baseRange = std::max(projectionScale / pixelError,
+            minimumBaseRange(settings.morphStartRatio));
+        return settings;
+    }
+};
+
+class ChunkLod {
+private:
+    int chunkSize;
+    std::vector<LodLevel> levels;
+
+    static float distanceToBox(float px, float py, float minX, float minY, float maxX, float maxY) {
+        float dx = std::max(std::max(minX - px, 0.0f), px - maxX);
+        float dy = std::max(std::max(minY - py, 0.0f), py - maxY);
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    // Height the coarser level interpolates at (i, j) of this level. The coarse
+    // cell is split along the same diagonal as the index buffer uses.
+    static float coarseHeight(const LodLevel& level, int i, int j) {
+        auto z = [&](int a, int b) { return level.vertices[static_cast<size_t>(a) * level.side + b].z; };
+        bool oddI = (i & 1) != 0;
+        bool oddJ = (j & 1) != 0;
+        if (oddI && oddJ) return 0.5f * (z(i + 1, j - 1) + z(i - 1, j + 1));
+        if (oddI) return 0.5f * (z(i - 1, j) + z(i + 1, j));
+        if (oddJ) return 0.5f * (z(i, j - 1) + z(i, j + 1));
+        return z(i, j);
+    }
+
+    // Fully visible nodes pass INSIDE down so their children skip the test
+    void selectNode(int level, int patchX, int patchY, float cameraX, float cameraY,
+        const LodSettings& settings, const Frustum& frustum, Frustum::Result parentVisibility,
+        std::vector<LodNode>& selected, int& culled) const {
+        float nodeSize = static_cast<float>(LOD_PATCH_CELLS << level);
+        float minX = patchX * nodeSize;
+        float minY = patchY * nodeSize;
+
+        Frustum::Result visibility = parentVisibility;
+        if (visibility != Frustum::INSIDE) {
+            const LodBounds& bounds = nodeBounds(level, patchX, patchY);
+            visibility = frustum.testBox(minX, minY, bounds.minZ, minX + nodeSize, minY + nodeSize, bounds.maxZ);
+            if (visibility == Frustum::OUTSIDE) {
+                ++culled;
+                return;
+            }
+        }
+
+        float distance = distanceToBox(cameraX, cameraY, minX, minY, minX + nodeSize, minY + nodeSize);
+        if (level == 0 || distance >= settings.range(level - 1)) {
+            selected.push_back({ level, patchX, patchY });
+            return;
+        }
+        for (int child = 0; child < 4; ++child) {
+            selectNode(level - 1, patchX * 2 + (child >> 1), patchY * 2 + (child & 1),
+                cameraX, cameraY, settings, frustum, visibility, selected, culled);
+        }
+    }
+
+    void buildBounds(ConstHeightfieldView displayHeights) {
+        for (int l = 0; l < levelCount(); ++l) {
+            int patches = patchesPerSide(chunkSize, l);
+            levels[l].patchBounds.resize(static_cast<size_t>(patches) * patches);
+        }
+
+        // Level 0 from the heights, coarser levels as the union of their children
+        LodLevel& finest = levels[0];
+        int patches = patchesPerSide(chunkSize, 0);
+        for (int px = 0; px < patches; ++px) {
+            for (int py = 0; py < patches; ++py) {
+                LodBounds bounds = { displayHeights(px * LOD_PATCH_CELLS, py * LOD_PATCH_CELLS),
+                                     displayHeights(px * LOD_PATCH_CELLS, py * LOD_PATCH_CELLS) };
+                for (int x = px * LOD_PATCH_CELLS; x <= (px + 1) * LOD_PATCH_CELLS; ++x) {
+                    const float* heights = displayHeights.row(x);
+                    for (int y = py * LOD_PATCH_CELLS; y <= (py + 1) * LOD_PATCH_CELLS; ++y) {
+                        bounds.minZ = std::min(bounds.minZ, heights[y]);
+                        bounds.maxZ = std::max(bounds.maxZ, heights[y]);
+                    }
+                }
+                finest.patchBounds[static_cast<size_t>(px) * patches + py] = bounds;
+            }
+        }
+
+        for (int l = 1; l < levelCount(); ++l) {
+            int parentPatches = patchesPerSide(chunkSize, l);
+            for (int px = 0; px < parentPatches; ++px) {
+                for (int py = 0; py < parentPatches; ++py) {
+                    LodBounds bounds = nodeBounds(l - 1, px * 2, py * 2);
+                    for (int child = 1; child < 4; ++child) {
+                        const LodBounds& childBounds = nodeBounds(l - 1, px * 2 + (child >> 1), py * 2 + (child & 1));
+                        bounds.minZ = std::min(bounds.minZ, childBounds.minZ);
+                        bounds.maxZ = std::max(bounds.maxZ, childBounds.maxZ);
+                    }
+                    levels[l].patchBounds[static_cast<size_t>(px) * parentPatches + py] = bounds;
+                }
+            }
+        }
+    }
+
+public:
+    ChunkLod() : chunkSize(0) {}
+
+    // displayHeights and materials are (chunkSize + 1)^2 grids; chunkSize must
+    // be a power of two no smaller than LOD_PATCH_CELLS.
+    void build(ConstHeightfieldView displayHeights, GridView<const uint8_t> materials,
+        const uint8_t (*packedPalette)[4]) {
+        chunkSize = displayHeights.rows() - 1;
+        int levelCount = 1;
+        while ((LOD_PATCH_CELLS << levelCount) <= chunkSize) ++levelCount;
+        levels.resize(levelCount);
+
+        for (int l = 0; l < levelCount; ++l) {
+            LodLevel& level = levels[l];
+            level.stride = 1 << l;
+            level.side = chunkSize / level.stride + 1;
+            level.vertices.resize(static_cast<size_t>(level.side) * level.side);
+
+            LodVertex* vertex = level.vertices.data();
+            for (int i = 0; i < level.side; ++i) {
+                int x = i * level.stride;
+                const float* heights = displayHeights.row(x);
+                const uint8_t* materialRow = materials.row(x);
+                for (int j = 0; j < level.side; ++j, ++vertex) {
+                    int y = j * level.stride;
+                    uint8_t material = materialRow[y];
+                    vertex->x = static_cast<float>(x);
+                    vertex->y = static_cast<float>(y);
+                    vertex->z = heights[y];
+                    vertex->color[0] = packedPalette[material][0];
+                    vertex->color[1] = packedPalette[material][1];
+                    vertex->color[2] = packedPalette[material][2];
+                    vertex->color[3] = material;
+                }
+            }
+        }
+
+        for (int l = 0; l < levelCount; ++l) {
+            LodLevel& level = levels[l];
+            bool coarsest = l == levelCount - 1;
+            for (int i = 0; i < level.side; ++i) {
+                for (int j = 0; j < level.side; ++j) {
+                    LodVertex& vertex = level.vertices[static_cast<size_t>(i) * level.side + j];
+                    vertex.zMorph = coarsest ? vertex.z : coarseHeight(level, i, j);
+                }
+            }
+        }
+
+        buildBounds(displayHeights);
+    }
+
+    // Nodes to draw for a camera at chunk-local ground position (cameraX, cameraY).
+    // frustum must be in chunk-local coordinates. Returns the number of nodes
+    // skipped because they were outside it.
+    int selectNodes(float cameraX, float cameraY, const LodSettings& settings, const Frustum& frustum,
+        std::vector<LodNode>& selected) const {
+        int culled = 0;
+        if (levels.empty()) return culled;
+        selectNode(levelCount() - 1, 0, 0, cameraX, cameraY, settings, frustum, Frustum::INTERSECTS,
+            selected, culled);
+        return culled;
+    }
+
+    const LodBounds& nodeBounds(int level, int patchX, int patchY) const {
+        return levels[level].patchBounds[static_cast<size_t>(patchX) * patchesPerSide(chunkSize, level) + patchY];
+    }
+
+    // Height range of the whole chunk
+    const LodBounds& chunkBounds() const { return nodeBounds(levelCount() - 1, 0, 0); }
+
+    int levelCount() const { return static_cast<int>(levels.size()); }
+    const LodLevel& level(int l) const { return levels[l]; }
+    int getChunkSize() const { return chunkSize; }
+
+    static int patchesPerSide(int chunkSize, int level) {
+        return chunkSize / (LOD_PATCH_CELLS << level);
+    }
+
+    static int indicesPerPatch() { return LOD_PATCH_CELLS * LOD_PATCH_CELLS * 6; }
+
+    // Index list for one level, patch by patch, so patch (px, py) is the
+    // contiguous range starting at (px * patchesPerSide + py) * indicesPerPatch().
+    static void buildPatchIndices(int chunkSize, int level, std::vector<uint32_t>& indices) {
+        int side = chunkSize / (1 << level) + 1;
+        int patches = patchesPerSide(chunkSize, level);
+        indices.clear();
+        indices.reserve(static_cast<size_t>(patches) * patches * indicesPerPatch());
+
+        for (int px = 0; px < patches; ++px) {
+            for (int py = 0; py < patches; ++py) {
+                for (int i = px * LOD_PATCH_CELLS; i < (px + 1) * LOD_PATCH_CELLS; ++i) {
+                    for (int j = py * LOD_PATCH_CELLS; j < (py + 1) * LOD_PATCH_CELLS; ++j) {
+                        uint32_t v00 = i * side + j;
+                        uint32_t v10 = (i + 1) * side + j;
+                        uint32_t v01 = v00 + 1;
+                        uint32_t v11 = v10 + 1;
+                        indices.insert(indices.end(), { v00, v10, v01, v10, v11, v01 });
+                    }
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size worker pool.
+//
+// parallelFor is the main entry point: the calling thread takes part in the
+// loop, so it is safe to call from inside a pool task (nested loops never wait
+// on a worker that is itself blocked). A pool created with one thread has no
+// workers at all and runs everything inline on the caller.
+//
+// Once the queue has grown to its working size, neither enqueue (with a
+// small, trivially copyable callable such as a lambda capturing a few
+// pointers) nor parallelFor allocates.
+class ThreadPool {
+private:
+    struct Task {
+        std::function<void()> function;
+        const void* owner = nullptr;             // parallelFor loop the task helps, if any
+        std::atomic<int>* running = nullptr;     // Counts the owner's helpers that have started
+    };
+
+    struct WorkerIdentity {
+        const ThreadPool* pool = nullptr;
+        int index = 0;
+    };
+
+    std::vector<std::thread> workers;
+    // Ring buffer of pending tasks; grows when full and never shrinks
+    std::vector<Task> queue;
+    size_t queueHead;
+    size_t queueCount;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping;
+
+    static WorkerIdentity& currentWorker() {
+        thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+    // Called with queueMutex held
+    void push(Task&& task) {
+        if (queueCount == queue.size()) {
+            std::vector<Task> grown(std::max<size_t>(16, queue.size() * 2));
+            for (size_t i = 0; i < queueCount; ++i) {
+                grown[i] = std::move(queue[(queueHead + i) % queue.size()]);
+            }
+            queue.swap(grown);
+            queueHead = 0;
+        }
+        queue[(queueHead + queueCount) % queue.size()] = std::move(task);
+        ++queueCount;
+    }
+
+    void workerLoop(int index) {
+        currentWorker() = { this, index };
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || queueCount > 0; });
+                if (stopping && queueCount == 0) return;
+                task = std::move(queue[queueHead]);
+                queue[queueHead].function = nullptr;
+                queueHead = (queueHead + 1) % queue.size();
+                --queueCount;
+                // Counted under the lock, so a loop cancelling its helpers
+                // knows which ones it still has to wait for
+                if (task.running) ++*task.running;
+            }
+            if (!task.function) continue;  // Cancelled
+            task.function();
+            if (task.running) --*task.running;
+        }
+    }
+
+    // Drop owner's helper tasks that no worker has picked up yet
+    void cancel(const void* owner) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (size_t i = 0; i < queueCount; ++i) {
+            Task& task = queue[(queueHead + i) % queue.size()];
+            if (task.owner != owner) continue;
+            task.function = nullptr;
+            task.owner = nullptr;
+            task.running = nullptr;
+        }
+    }
+
+public:
+    // threadCount counts the calling thread; 0 picks the hardware concurrency.
+    explicit ThreadPool(int threadCount = 0) : queueHead(0), queueCount(0), stopping(false) {
+        if (threadCount <= 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (int i = 1; i < threadCount; ++i) {
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    int threadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+    // 1 to threadCount() - 1 on this pool's workers, 0 on any other thread.
+    // Lets callers keep per-thread scratch memory indexed by thread.
+    int currentWorkerIndex() const {
+        const WorkerIdentity& identity = currentWorker();
+        return identity.pool == this ? identity.index : 0;
+    }
+
+    // Fire-and-forget. Without workers the task runs immediately on the caller.
+    void enqueue(std::function<void()> task) {
+        if (workers.empty()) {
+            task();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            push({ std::move(task), nullptr, nullptr });
+        }
+        queueCondition.notify_one();
+    }
+
+    // Run body(i) for every i in [0, count). Indices are handed out dynamically,
+    // so callers must not depend on which thread runs which index.
+    template <typename Body>
+    void parallelFor(int count, const Body& body) {
+        if (count <= 0) return;
+
+        int helpers = std::min(static_cast<int>(workers.size()), count - 1);
+        if (helpers == 0) {
+            for (int i = 0; i < count; ++i) body(i);
+            return;
+        }
+
+        // Lives on this stack frame. Helpers still queued when the loop is
+        // done are cancelled, and the ones already running are waited for,
+        // so nothing touches it after we return.
+        struct LoopState {
+            std::atomic<int> next{ 0 };
+            std::atomic<int> completed{ 0 };
+            std::atomic<int> running{ 0 };
+            int count = 0;
+            const Body* body = nullptr;
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+
+            void run() {
+                int finished = 0;
+                for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+                    (*body)(i);
+                    ++finished;
+                }
+                if (finished && completed.fetch_add(finished) + finished == count) {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    doneCondition.notify_all();
+                }
+            }
+        };
+
+        LoopState state;
+        state.count = count;
+        state.body = &body;
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            LoopState* statePointer = &state;
+            for (int i = 0; i < helpers; ++i) {
+                push({ [statePointer] { statePointer->run(); }, &state, &state.running });
+            }
+        }
+        queueCondition.notify_all();
+        state.run();
+
+        {
+            std::unique_lock<std::mutex> lock(state.doneMutex);
+            state.doneCondition.wait(lock, [&] { return state.completed.load() == count; });
+        }
+        cancel(&state);
+        // Started helpers have no indices left and are on their way out
+        while (state.running.load() != 0) std::this_thread::yield();
+    }
+};
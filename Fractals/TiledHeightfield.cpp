@@ -0,0 +1,244 @@
+#include "TiledHeightfield.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const char MAP_MAGIC[4] = { 'F', 'M', 'A', 'P' };
+    // Bump when the layout changes
+    const uint32_t MAP_FORMAT_VERSION = 1;
+
+    // Little-endian; the first slot of the file holds it, tiles follow
+    struct MapHeader {
+        char magic[4];
+        uint32_t version;
+        int32_t rows;
+        int32_t cols;
+        int32_t tileSize;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(MapHeader) == 24, "MapHeader must have no padding");
+
+    // Bits of x in the odd positions, y in the even ones
+    uint64_t mortonCode(uint32_t x, uint32_t y) {
+        uint64_t code = 0;
+        for (int bit = 0; bit < 32; ++bit) {
+            code |= static_cast<uint64_t>((y >> bit) & 1) << (2 * bit);
+            code |= static_cast<uint64_t>((x >> bit) & 1) << (2 * bit + 1);
+        }
+        return code;
+    }
+
+    uint64_t fileBytesFor(int tileCount, size_t slotBytes) {
+        return static_cast<uint64_t>(tileCount + 1) * slotBytes;
+    }
+}
+
+TiledHeightfield::TiledHeightfield()
+    : numRows(0), numCols(0), tileSide(0), tilesX(0), tilesY(0), slotBytes(0), budgetTiles(0), useCounter(0),
+#if defined(_WIN32)
+    fileHandle(nullptr), mappingHandle(nullptr)
+#else
+    fileDescriptor(-1)
+#endif
+{}
+
+void TiledHeightfield::setLayout(int rows, int cols, int tileSize, size_t budgetBytes) {
+    numRows = rows;
+    numCols = cols;
+    tileSide = tileSize;
+    tilesX = (rows + tileSize - 1) / tileSize;
+    tilesY = (cols + tileSize - 1) / tileSize;
+    size_t tileBytes = static_cast<size_t>(tileSize) * tileSize * sizeof(float);
+    slotBytes = (tileBytes + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+    budgetTiles = std::max<size_t>(1, budgetBytes / slotBytes);
+
+    int count = tileCount();
+    tiles.assign(count, Tile{ nullptr, 0, 0 });
+    tileOfSlot.resize(count);
+    for (int i = 0; i < count; ++i) tileOfSlot[i] = i;
+    std::sort(tileOfSlot.begin(), tileOfSlot.end(), [this](int a, int b) {
+        return mortonCode(a / tilesY, a % tilesY) < mortonCode(b / tilesY, b % tilesY);
+    });
+    slotOfTile.resize(count);
+    for (int slot = 0; slot < count; ++slot) slotOfTile[tileOfSlot[slot]] = slot;
+    mapped.clear();
+    mapped.reserve(std::min<size_t>(budgetTiles, count));
+}
+
+bool TiledHeightfield::create(const std::string& path, int rows, int cols, int tileSize, size_t budgetBytes) {
+    close();
+    if (rows <= 0 || cols <= 0 || tileSize <= 0 || (tileSize & (tileSize - 1)) != 0) return false;
+    setLayout(rows, cols, tileSize, budgetBytes);
+    if (!openFile(path, true, fileBytesFor(tileCount(), slotBytes))) {
+        close();
+        return false;
+    }
+
+    MapHeader header;
+    std::memcpy(header.magic, MAP_MAGIC, sizeof(header.magic));
+    header.version = MAP_FORMAT_VERSION;
+    header.rows = rows;
+    header.cols = cols;
+    header.tileSize = tileSize;
+    header.reserved = 0;
+    // Slot -1 is the header's
+    float* first = mapSlot(-1);
+    if (!first) {
+        close();
+        return false;
+    }
+    std::memcpy(first, &header, sizeof(header));
+#if defined(_WIN32)
+    UnmapViewOfFile(first);
+#else
+    munmap(first, slotBytes);
+#endif
+    return true;
+}
+
+bool TiledHeightfield::open(const std::string& path, size_t budgetBytes) {
+    close();
+    MapHeader header;
+    {
+        // Read just the header first, to learn the layout
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        bool read = std::fread(&header, sizeof(header), 1, file) == 1;
+        std::fclose(file);
+        if (!read || std::memcmp(header.magic, MAP_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MAP_FORMAT_VERSION || header.rows <= 0 || header.cols <= 0 ||
+            header.tileSize <= 0 || (header.tileSize & (header.tileSize - 1)) != 0) {
+            return false;
+        }
+    }
+    setLayout(header.rows, header.cols, header.tileSize, budgetBytes);
+    if (!openFile(path, false, fileBytesFor(tileCount(), slotBytes))) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+HeightfieldView TiledHeightfield::acquire(int tileX, int tileY) {
+    int index = tileX * tilesY + tileY;
+    std::unique_lock<std::mutex> lock(tileMutex);
+    Tile& tile = tiles[index];
+    while (!tile.base) {
+        if (mapped.size() < budgetTiles) {
+            tile.base = mapSlot(slotOfTile[index]);
+            // Null when out of address space, or the file has gone
+            if (tile.base) mapped.push_back(index);
+            break;
+        }
+        // Evict the least recently used unpinned tile, or wait for one
+        int oldest = -1;
+        for (int candidate : mapped) {
+            if (tiles[candidate].pins == 0 && (oldest < 0 || tiles[candidate].lastUse < tiles[oldest].lastUse)) {
+                oldest = candidate;
+            }
+        }
+        if (oldest >= 0) unmapTile(oldest);
+        else tileReleased.wait(lock);
+    }
+    // Pinned even on failure, so release stays balanced
+    ++tile.pins;
+    tile.lastUse = ++useCounter;
+    if (!tile.base) return HeightfieldView();
+    int rows = std::min(tileSide, numRows - tileX * tileSide);
+    int cols = std::min(tileSide, numCols - tileY * tileSide);
+    return HeightfieldView(tile.base, rows, cols, tileSide);
+}
+
+void TiledHeightfield::release(int tileX, int tileY) {
+    {
+        std::lock_guard<std::mutex> lock(tileMutex);
+        --tiles[tileX * tilesY + tileY].pins;
+    }
+    tileReleased.notify_one();
+}
+
+void TiledHeightfield::unmapTile(int index) {
+    Tile& tile = tiles[index];
+#if defined(_WIN32)
+    UnmapViewOfFile(tile.base);
+#else
+    munmap(tile.base, slotBytes);
+#endif
+    tile.base = nullptr;
+    mapped.erase(std::find(mapped.begin(), mapped.end(), index));
+}
+
+#if defined(_WIN32)
+
+bool TiledHeightfield::openFile(const std::string& path, bool create, uint64_t fileBytes) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (create) {
+        size.QuadPart = static_cast<LONGLONG>(fileBytes);
+        if (!SetFilePointerEx(file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) return false;
+    }
+    else if (!GetFileSizeEx(file, &size) || static_cast<uint64_t>(size.QuadPart) < fileBytes) {
+        return false;
+    }
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(fileBytes >> 32), static_cast<DWORD>(fileBytes), nullptr);
+    return mappingHandle != nullptr;
+}
+
+float* TiledHeightfield::mapSlot(int slot) {
+    uint64_t offset = static_cast<uint64_t>(slot + 1) * slotBytes;
+    void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ | FILE_MAP_WRITE,
+        static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), slotBytes);
+    return static_cast<float*>(view);
+}
+
+void TiledHeightfield::close() {
+    while (!mapped.empty()) unmapTile(mapped.back());
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    tiles.clear();
+}
+
+#else
+
+bool TiledHeightfield::openFile(const std::string& path, bool create, uint64_t fileBytes) {
+    fileDescriptor = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fileDescriptor < 0) return false;
+    if (create) return ftruncate(fileDescriptor, static_cast<off_t>(fileBytes)) == 0;
+    struct stat info;
+    return fstat(fileDescriptor, &info) == 0 && static_cast<uint64_t>(info.st_size) >= fileBytes;
+}
+
+float* TiledHeightfield::mapSlot(int slot) {
+    off_t offset = static_cast<off_t>(slot + 1) * static_cast<off_t>(slotBytes);
+    void* view = mmap(nullptr, slotBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, offset);
+    return view == MAP_FAILED ? nullptr : static_cast<float*>(view);
+}
+
+void TiledHeightfield::close() {
+    while (!mapped.empty()) unmapTile(mapped.back());
+    if (fileDescriptor >= 0) ::close(fileDescriptor);
+    fileDescriptor = -1;
+    tiles.clear();
+}
+
+#endif
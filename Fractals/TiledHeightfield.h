@@ -0,0 +1,126 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Heightfield.h"
+
+/*
+Heightfield kept in a file as square tiles, for maps far larger than
+memory (offline bakes of 32k x 32k and up).
+
+Tiles are stored in Morton (Z) order of their tile coordinates, so tiles
+close together on the map are close together in the file, and each one is
+mapped on its own while it is in use. Callers pin a tile with acquire and
+unpin it with release. Unpinned tiles stay mapped until the budget is
+reached; then the least recently used one is unmapped and its pages are
+left to the OS page cache. Resident memory for the map stays around the
+budget whatever the map size.
+
+Within a tile, rows are indexed by x and contiguous in y as in Grid, with a
+stride of tileSize. Tiles on the far edges are stored whole; the cells past
+the map's rows and columns are unused. Acquire and release are thread-safe.
+*/
+class TiledHeightfield {
+public:
+    // Tiles start on multiples of this in the file, the coarsest offset
+    // granularity a mapping needs (64 KiB on Windows)
+    static constexpr size_t SLOT_ALIGNMENT = 64 << 10;
+
+private:
+    struct Tile {
+        float* base;  // Null while unmapped
+        int pins;
+        uint64_t lastUse;
+    };
+
+    int numRows;
+    int numCols;
+    int tileSide;
+    int tilesX;  // Tiles along x (rows)
+    int tilesY;
+    size_t slotBytes;
+    size_t budgetTiles;
+    std::vector<Tile> tiles;        // By tileX * tilesY + tileY
+    std::vector<int> slotOfTile;    // Position in the file, in slots after the header
+    std::vector<int> tileOfSlot;
+    std::vector<int> mapped;        // Indices of mapped tiles
+    uint64_t useCounter;
+    std::mutex tileMutex;
+    std::condition_variable tileReleased;
+#if defined(_WIN32)
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+
+    void setLayout(int rows, int cols, int tileSize, size_t budgetBytes);
+    bool openFile(const std::string& path, bool create, uint64_t fileBytes);
+    // Called with tileMutex held
+    float* mapSlot(int slot);
+    void unmapTile(int index);
+
+public:
+    TiledHeightfield();
+    ~TiledHeightfield() { close(); }
+
+    TiledHeightfield(const TiledHeightfield&) = delete;
+    TiledHeightfield& operator=(const TiledHeightfield&) = delete;
+
+    // Create (or replace) path as a rows x cols map of zeros. tileSize must
+    // be a power of two. budgetBytes caps the mapped tiles, at least one.
+    bool create(const std::string& path, int rows, int cols, int tileSize, size_t budgetBytes);
+    // Open a map written by create, for reading and writing. False if the
+    // file is missing, truncated or not a map.
+    bool open(const std::string& path, size_t budgetBytes);
+    // Unmap every tile and close the file. Tiles must not be pinned.
+    void close();
+
+    bool isOpen() const { return !tiles.empty(); }
+    int rows() const { return numRows; }
+    int cols() const { return numCols; }
+    int tileSize() const { return tileSide; }
+    int tileRows() const { return tilesX; }
+    int tileCols() const { return tilesY; }
+    int tileCount() const { return tilesX * tilesY; }
+    // Most tiles mapped at once
+    size_t tileBudget() const { return budgetTiles; }
+
+    // Tile stored at position slot of the file, for sweeps in file order
+    void tileAtSlot(int slot, int& tileX, int& tileY) const {
+        int index = tileOfSlot[slot];
+        tileX = index / tilesY;
+        tileY = index % tilesY;
+    }
+
+    // Map tile (tileX, tileY) and keep it mapped until the matching release.
+    // The view covers only the tile's cells inside the map. Blocks while
+    // every tile the budget allows is pinned. Empty if the tile can't be
+    // mapped; it still has to be released.
+    HeightfieldView acquire(int tileX, int tileY);
+    void release(int tileX, int tileY);
+};
+
+// Pins a tile for the lifetime of the lock
+class TileLock {
+private:
+    TiledHeightfield& map;
+    int tileX;
+    int tileY;
+    HeightfieldView tileView;
+
+public:
+    TileLock(TiledHeightfield& target, int x, int y)
+        : map(target), tileX(x), tileY(y), tileView(target.acquire(x, y)) {}
+    ~TileLock() { map.release(tileX, tileY); }
+
+    TileLock(const TileLock&) = delete;
+    TileLock& operator=(const TileLock&) = delete;
+
+    const HeightfieldView& view() const { return tileView; }
+};
@@ -0,0 +1,174 @@
+// Steady-state streaming must not touch the heap. A ring of chunk slots is
+// moved across the world the way TerrainManager moves it: chunks leaving
+// the ring are evicted by regenerating their slot in place, on a pool with
+// per-thread scratch arenas. After a warm-up, further moves must make zero
+// allocations. Built with FRACTALS_COUNT_ALLOCATIONS.
+//
+// With a chunk cache, as the viewer runs, slots are loaded from the cache
+// when their chunk is there and stored to it otherwise, and a snapshot cache
+// keeps the stage snapshots of retuned chunks. Warm-up and measured moves
+// each end with a parameter change that regenerates the whole ring in place.
+// The caps are small, so the warm-up already fills both caches and the
+// measured moves load and store and evict tiles.
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "ChunkCache.h"
+#include "ChunkGenerator.h"
+#include "CloudGenerator.h"
+#include "Hash.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+
+namespace {
+    const unsigned int WORLD_SEED = 12345;
+    const int CHUNK_SIZE = 128;
+    const int RING_RADIUS = 1;
+    const int RING_SIDE = 2 * RING_RADIUS + 1;
+    const int THREADS = 3;
+    const int WARMUP_MOVES = 3;
+    const int MEASURED_MOVES = 6;
+    const char* const CACHE_DIRECTORY = "allocation_test_cache";
+    const char* const SNAPSHOT_DIRECTORY = "allocation_test_cache/stages";
+    // About a dozen compressed 128 tiles: the ring and a few columns behind it
+    const long long CACHE_BYTES = 640LL << 10;
+
+    // Ring centers, back and forth so that moves both revisit chunks and
+    // reach new ones
+    const int PATH[WARMUP_MOVES + MEASURED_MOVES] = { 0, 1, 2, 3, 1, 4, 5, 4, 3 };
+
+    struct ChunkSlot {
+        int chunkX = 0;
+        int chunkY = 0;
+        bool loaded = false;
+        ChunkGenerator terrain;
+        CloudGenerator clouds;
+
+        ChunkSlot() : terrain(CHUNK_SIZE), clouds(CHUNK_SIZE) {}
+    };
+
+    class ChunkRing {
+    private:
+        ThreadPool pool;
+        ChunkCache* cache;
+        std::vector<ScratchArena> arenas;
+        std::vector<std::unique_ptr<ChunkSlot>> slots;
+        std::vector<ChunkSlot*> stale;
+
+        static int wrap(int value) {
+            int r = value % RING_SIDE;
+            return r < 0 ? r + RING_SIDE : r;
+        }
+
+        // Load or generate every stale slot, as TerrainManager does
+        void regenerateStale(bool clouds) {
+            pool.parallelFor(static_cast<int>(stale.size()), [this, clouds](int index) {
+                ChunkSlot& slot = *stale[index];
+                ScratchArena& arena = arenas[pool.currentWorkerIndex()];
+                if (!cache || !slot.terrain.loadChunk(*cache, WORLD_SEED, slot.chunkX, slot.chunkY, arena)) {
+                    slot.terrain.generateChunk(WORLD_SEED, slot.chunkX, slot.chunkY, arena);
+                    if (cache) slot.terrain.storeChunk(*cache, arena);
+                }
+                if (clouds) slot.clouds.regenerateClouds(hashCoords(WORLD_SEED, slot.chunkX, slot.chunkY));
+            });
+        }
+
+    public:
+        ChunkRing(ErosionMode mode, ChunkCache* chunkCache, ChunkCache* snapshotCache)
+            : pool(THREADS), cache(chunkCache), arenas(pool.threadCount()) {
+            HydraulicErosionSettings hydraulic;
+            hydraulic.droplets = 20000;
+            for (int i = 0; i < RING_SIDE * RING_SIDE; ++i) {
+                slots.emplace_back(new ChunkSlot());
+                slots.back()->terrain.setThreadPool(&pool);
+                slots.back()->terrain.setErosionMode(mode);
+                slots.back()->terrain.setHydraulicErosionSettings(hydraulic);
+                slots.back()->terrain.setSnapshotCache(snapshotCache);
+            }
+            stale.reserve(slots.size());
+            // Every arena sees a chunk, whichever threads the moves land on
+            for (ScratchArena& arena : arenas) {
+                slots[0]->terrain.generateChunk(WORLD_SEED, -100, 0, arena);
+                if (cache) slots[0]->terrain.storeChunk(*cache, arena);
+            }
+        }
+
+        // Regenerate every slot whose chunk left the ring around (centerX, 0)
+        void moveTo(int centerX) {
+            stale.clear();
+            for (int cx = centerX - RING_RADIUS; cx <= centerX + RING_RADIUS; ++cx) {
+                for (int cy = -RING_RADIUS; cy <= RING_RADIUS; ++cy) {
+                    ChunkSlot& slot = *slots[wrap(cx) * RING_SIDE + wrap(cy)];
+                    if (slot.loaded && slot.chunkX == cx && slot.chunkY == cy) continue;
+                    slot.chunkX = cx;
+                    slot.chunkY = cy;
+                    slot.loaded = true;
+                    stale.push_back(&slot);
+                }
+            }
+            regenerateStale(true);
+        }
+
+        // Regenerate every slot in place with erosionIterations, as after a
+        // parameter change
+        void retune(int erosionIterations) {
+            ErosionSettings erosion;
+            erosion.iterations = erosionIterations;
+            stale.clear();
+            for (std::unique_ptr<ChunkSlot>& slot : slots) {
+                slot->terrain.setErosionSettings(erosion);
+                if (slot->loaded) stale.push_back(slot.get());
+            }
+            regenerateStale(false);
+        }
+    };
+
+    void checkMode(ErosionMode mode, const char* name, ChunkCache* cache, ChunkCache* snapshotCache) {
+        ChunkRing ring(mode, cache, snapshotCache);
+        for (int move = 0; move < WARMUP_MOVES; ++move) ring.moveTo(PATH[move]);
+        if (snapshotCache) ring.retune(14);
+        long long before = allocationCount();
+        long long hitsBefore = cache ? cache->hits() : 0;
+        long long missesBefore = cache ? cache->misses() : 0;
+        long long snapshotBytesBefore = snapshotCache ? snapshotCache->sizeBytes() : 0;
+        for (int move = WARMUP_MOVES; move < WARMUP_MOVES + MEASURED_MOVES; ++move) ring.moveTo(PATH[move]);
+        if (snapshotCache) ring.retune(10);
+        long long allocations = allocationCount() - before;
+        expect(allocations == 0, "%s: %lld allocations over %d ring moves after warm-up", name, allocations,
+            MEASURED_MOVES);
+        if (cache) {
+            expect(cache->hits() > hitsBefore && cache->misses() > missesBefore,
+                "%s: the measured moves didn't both load and store", name);
+            expect(cache->sizeBytes() <= CACHE_BYTES, "%s: cache over its cap", name);
+        }
+        if (snapshotCache) {
+            expect(snapshotBytesBefore > 0, "%s: retuning stored no stage snapshots", name);
+            expect(snapshotCache->sizeBytes() <= CACHE_BYTES, "%s: snapshot cache over its cap", name);
+        }
+    }
+}
+
+int main() {
+    if (!expect(allocationCountingEnabled(), "built without FRACTALS_COUNT_ALLOCATIONS")) {
+        return testResult("AllocationTest");
+    }
+    checkMode(EROSION_THERMAL, "thermal", nullptr, nullptr);
+    checkMode(EROSION_HYDRAULIC, "hydraulic", nullptr, nullptr);
+
+    std::filesystem::remove_all(CACHE_DIRECTORY);
+    {
+        ChunkCacheSettings settings;
+        settings.directory = CACHE_DIRECTORY;
+        settings.maxBytes = CACHE_BYTES;
+        ChunkCache cache(settings);
+        ChunkCacheSettings snapshotSettings = settings;
+        snapshotSettings.directory = SNAPSHOT_DIRECTORY;
+        ChunkCache snapshotCache(snapshotSettings);
+        checkMode(EROSION_THERMAL, "thermal with caches", &cache, &snapshotCache);
+    }
+    std::filesystem::remove_all(CACHE_DIRECTORY);
+    return testResult("AllocationTest");
+}
@@ -0,0 +1,189 @@
+// Chunk cache tiles must come back exactly as stored, compressed or raw,
+// including the float bit patterns terrain never produces. A tile that is
+// truncated or was stored for another seed, position, shape or parameter set
+// must miss, and the size cap must hold across evictions and restarts.
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "ChunkCache.h"
+#include "ChunkGenerator.h"
+#include "TestSupport.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char* const CACHE_DIRECTORY = "chunk_cache_test";
+    const unsigned int WORLD_SEED = 12345;
+    const int CHUNK_SIZE = 128;
+    const int WIDTH = CHUNK_SIZE + 1;
+
+    // Random bits in every cell, and the extremes of the delta coding in
+    // the first row: sign flips, infinities, NaNs, denormals and zeros
+    Heightfield arbitraryBits() {
+        Heightfield heights(WIDTH, WIDTH);
+        std::mt19937 random(99);
+        for (int x = 0; x < WIDTH; ++x) {
+            for (int y = 0; y < WIDTH; ++y) {
+                uint32_t bits = random();
+                std::memcpy(&heights.row(x)[y], &bits, sizeof(bits));
+            }
+        }
+        const float special[] = { 0.0f, -0.0f, std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN(),
+            std::numeric_limits<float>::denorm_min(), -std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max(), 1.0f, -1.0f };
+        for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); ++i) heights.row(0)[i] = special[i];
+        return heights;
+    }
+
+    // The one tile in the cache directory
+    fs::path onlyTile() {
+        fs::path found;
+        for (const fs::directory_entry& entry : fs::directory_iterator(CACHE_DIRECTORY)) {
+            if (entry.path().extension() == ".chunk") found = entry.path();
+        }
+        return found;
+    }
+
+    void checkRoundTrip(bool compress) {
+        const char* mode = compress ? "compressed" : "raw";
+        fs::remove_all(CACHE_DIRECTORY);
+        ChunkCacheSettings settings;
+        settings.directory = CACHE_DIRECTORY;
+        settings.compress = compress;
+        ChunkCache cache(settings);
+        std::vector<uint8_t> payload;
+
+        ChunkGenerator generator(CHUNK_SIZE);
+        generator.setMeshBuilding(false);
+        generator.generateChunk(WORLD_SEED, 3, -2);
+        ChunkCacheKey key = generator.cacheKey(WORLD_SEED, 3, -2);
+        cache.store(key, generator.getHeights(), payload);
+        Heightfield loaded(WIDTH, WIDTH);
+        expect(cache.load(key, loaded) && identical(loaded, generator.getHeights()),
+            "%s: terrain didn't load back bit for bit", mode);
+
+        ChunkCacheKey bitsKey = { 42, WORLD_SEED, 100, 100 };
+        Heightfield bits = arbitraryBits();
+        cache.store(bitsKey, bits, payload);
+        Heightfield loadedBits(WIDTH, WIDTH);
+        expect(cache.load(bitsKey, loadedBits) && identical(loadedBits, bits),
+            "%s: arbitrary bits didn't load back bit for bit", mode);
+
+        // Restored by a generator, as the viewer does
+        ChunkGenerator restored(CHUNK_SIZE);
+        restored.setMeshBuilding(false);
+        ScratchArena arena;
+        expect(restored.loadChunk(cache, WORLD_SEED, 3, -2, arena) &&
+            identical(restored.getHeights(), generator.getHeights()) &&
+            identical(restored.getMaterials(), generator.getMaterials()),
+            "%s: loadChunk differs from the generated chunk", mode);
+        expect(cache.hits() == 3 && cache.misses() == 0, "%s: %lld hits and %lld misses, expected 3 and 0", mode,
+            cache.hits(), cache.misses());
+    }
+
+    void checkMisses() {
+        fs::remove_all(CACHE_DIRECTORY);
+        ChunkCacheSettings settings;
+        settings.directory = CACHE_DIRECTORY;
+        ChunkCache cache(settings);
+        std::vector<uint8_t> payload;
+
+        ChunkGenerator generator(CHUNK_SIZE);
+        generator.setMeshBuilding(false);
+        generator.generateChunk(WORLD_SEED, 0, 0);
+        ChunkCacheKey key = generator.cacheKey(WORLD_SEED, 0, 0);
+        cache.store(key, generator.getHeights(), payload);
+        Heightfield loaded(WIDTH, WIDTH);
+
+        ChunkCacheKey otherSeed = generator.cacheKey(WORLD_SEED + 1, 0, 0);
+        expect(!cache.load(otherSeed, loaded), "a tile loaded for another seed");
+        ChunkCacheKey otherChunk = generator.cacheKey(WORLD_SEED, 0, 1);
+        expect(!cache.load(otherChunk, loaded), "a tile loaded for another chunk");
+        ChunkGenerator rougher(CHUNK_SIZE);
+        rougher.setRoughness(0.9f);
+        ChunkCacheKey otherParameters = rougher.cacheKey(WORLD_SEED, 0, 0);
+        expect(otherParameters.parameters != key.parameters, "roughness doesn't change parametersHash");
+        expect(!cache.load(otherParameters, loaded), "a tile loaded for other parameters");
+        Heightfield otherShape(WIDTH - 1, WIDTH - 1);
+        expect(!cache.load(key, otherShape), "a tile loaded into a grid of another shape");
+        expect(cache.load(key, loaded), "the tile itself missed");
+
+        // Cut off inside the payload, then inside the header
+        fs::path tile = onlyTile();
+        uintmax_t size = fs::file_size(tile);
+        fs::resize_file(tile, size - 1);
+        expect(!cache.load(key, loaded), "a tile one byte short loaded");
+        fs::resize_file(tile, 20);
+        expect(!cache.load(key, loaded), "a tile cut off in its header loaded");
+        fs::resize_file(tile, 0);
+        expect(!cache.load(key, loaded), "an empty tile loaded");
+
+        // Trailing bytes break the payload size in the header
+        cache.store(key, generator.getHeights(), payload);
+        fs::resize_file(onlyTile(), size + 8);
+        expect(!cache.load(key, loaded), "a tile with trailing bytes loaded");
+        expect(cache.hits() == 1 && cache.misses() == 8, "%lld hits and %lld misses, expected 1 and 8",
+            cache.hits(), cache.misses());
+    }
+
+    long long bytesOnDisk() {
+        long long bytes = 0;
+        for (const fs::directory_entry& entry : fs::directory_iterator(CACHE_DIRECTORY)) {
+            bytes += static_cast<long long>(entry.file_size());
+        }
+        return bytes;
+    }
+
+    void checkEviction() {
+        fs::remove_all(CACHE_DIRECTORY);
+        ChunkCacheSettings settings;
+        settings.directory = CACHE_DIRECTORY;
+        settings.compress = false;
+        // Raw tiles are all the same size; room for five
+        long long tileBytes = 48 + static_cast<long long>(WIDTH) * WIDTH * sizeof(float);
+        settings.maxBytes = tileBytes * 5 + tileBytes / 2;
+        std::vector<uint8_t> payload;
+        Heightfield heights = arbitraryBits();
+        Heightfield loaded(WIDTH, WIDTH);
+        {
+            ChunkCache cache(settings);
+            for (int chunk = 0; chunk < 12; ++chunk) {
+                cache.store({ 1, WORLD_SEED, chunk, 0 }, heights, payload);
+                // Keep chunk 0 the most recently used
+                if (chunk > 0) cache.load({ 1, WORLD_SEED, 0, 0 }, loaded);
+                expect(cache.sizeBytes() <= settings.maxBytes, "over the cap after storing chunk %d", chunk);
+            }
+            expect(cache.sizeBytes() == tileBytes * 5, "%lld bytes cached, expected five tiles",
+                cache.sizeBytes());
+            expect(bytesOnDisk() == cache.sizeBytes(), "%lld bytes on disk but %lld counted", bytesOnDisk(),
+                cache.sizeBytes());
+            expect(cache.load({ 1, WORLD_SEED, 0, 0 }, loaded), "the most recently used tile was evicted");
+            expect(!cache.load({ 1, WORLD_SEED, 1, 0 }, loaded), "the least recently used tile survived");
+            expect(cache.load({ 1, WORLD_SEED, 11, 0 }, loaded), "the newest tile was evicted");
+        }
+
+        // A new run indexes the same tiles and keeps the cap
+        ChunkCache reopened(settings);
+        expect(reopened.sizeBytes() == tileBytes * 5, "reopened with %lld bytes, expected five tiles",
+            reopened.sizeBytes());
+        for (int chunk = 12; chunk < 16; ++chunk) reopened.store({ 1, WORLD_SEED, chunk, 0 }, heights, payload);
+        expect(reopened.sizeBytes() <= settings.maxBytes && bytesOnDisk() == reopened.sizeBytes(),
+            "reopened cache at %lld bytes, %lld on disk", reopened.sizeBytes(), bytesOnDisk());
+        expect(reopened.load({ 1, WORLD_SEED, 15, 0 }, loaded), "the newest tile after reopening was evicted");
+    }
+}
+
+int main() {
+    checkRoundTrip(true);
+    checkRoundTrip(false);
+    checkMisses();
+    checkEviction();
+    fs::remove_all(CACHE_DIRECTORY);
+    return testResult("ChunkCacheTest");
+}
@@ -0,0 +1,279 @@
+// An out-of-core bake must equal the same stages run over the whole map in
+// memory: a 3x3-chunk map is baked with a budget of a few tiles, serially
+// and on pools of 1 and 3 threads, and compared bit for bit. Also covers
+// the tiled storage under it (tiles surviving eviction, acquire blocking
+// while every mapped tile is pinned, reopening) and exportMap writing the
+// tiles cell for cell.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChunkGenerator.h"
+#include "MapBaker.h"
+#include "MapExport.h"
+#include "StagePipeline.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include "TiledHeightfield.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char* const TEST_DIRECTORY = "map_bake_test";
+    const int CHUNK_SIZE = 64;
+    const int BUDGET_TILES = 3;
+
+    std::string testPath(const char* name) {
+        return (fs::path(TEST_DIRECTORY) / name).string();
+    }
+
+    size_t slotBytes(int tileSize) {
+        size_t tileBytes = static_cast<size_t>(tileSize) * tileSize * sizeof(float);
+        return (tileBytes + TiledHeightfield::SLOT_ALIGNMENT - 1) / TiledHeightfield::SLOT_ALIGNMENT *
+            TiledHeightfield::SLOT_ALIGNMENT;
+    }
+
+    MapBakeSettings bakeSettings() {
+        MapBakeSettings settings;
+        settings.worldSeed = 777;
+        settings.chunkX = -1;
+        settings.chunkY = 2;
+        settings.chunksX = 3;
+        settings.chunksY = 3;
+        settings.chunkSize = CHUNK_SIZE;
+        settings.erosion.iterations = 6;
+        return settings;
+    }
+
+    // The bake's definition: diamond-square per chunk, then the later
+    // stages over the whole map at once
+    void bakeInMemory(const MapBakeSettings& settings, Heightfield& base, Heightfield& result) {
+        int size = settings.chunkSize;
+        base.resize(settings.chunksX * size, settings.chunksY * size);
+        ChunkGenerator generator(size);
+        generator.setMeshBuilding(false);
+        ScratchArena arena;
+        for (int cx = 0; cx < settings.chunksX; ++cx) {
+            for (int cy = 0; cy < settings.chunksY; ++cy) {
+                generator.generateBaseHeights(settings.worldSeed, settings.chunkX + cx, settings.chunkY + cy, arena);
+                const Heightfield& chunk = generator.getHeights();
+                for (int x = 0; x < size; ++x) {
+                    std::copy(chunk.row(x), chunk.row(x) + size, base.row(cx * size + x) + cy * size);
+                }
+            }
+        }
+
+        result = base;
+        Heightfield scratch;
+        std::vector<float> stageRows;
+        ErosionSettings erosion = settings.erosion;
+        erosion.minMovement = 0.0f;
+        ThermalErosion thermal;
+        GradientNoise variationNoise(ChunkGenerator::variationSeed(settings.worldSeed));
+        runStaged(result, scratch, stageRows, RowChain<>(), SmoothPeaksStage(), RowChain<>());
+        thermal.run(result, scratch, erosion, nullptr);
+        auto pre = makeRowChain(BiomeVariationStage(variationNoise, settings.chunkX * size, settings.chunkY * size,
+            settings.biome));
+        runStaged(result, scratch, stageRows, pre, SmoothPeaksStage(), RowChain<>());
+    }
+
+    // Every cell of map against expected
+    bool matches(TiledHeightfield& map, const Heightfield& expected) {
+        if (map.rows() != expected.rows() || map.cols() != expected.cols()) return false;
+        int side = map.tileSize();
+        for (int tileX = 0; tileX < map.tileRows(); ++tileX) {
+            for (int tileY = 0; tileY < map.tileCols(); ++tileY) {
+                TileLock tile(map, tileX, tileY);
+                const HeightfieldView& view = tile.view();
+                if (view.empty()) return false;
+                for (int x = 0; x < view.rows(); ++x) {
+                    if (std::memcmp(view.row(x), expected.row(tileX * side + x) + tileY * side,
+                            view.cols() * sizeof(float)) != 0) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    void checkBake(const Heightfield& expectedBase, const Heightfield& expected) {
+        MapBakeSettings settings = bakeSettings();
+        for (int threads : { 0, 1, 3 }) {
+            std::unique_ptr<ThreadPool> pool;
+            if (threads > 0) pool.reset(new ThreadPool(threads));
+            MapBaker baker(settings, pool.get());
+            TiledHeightfield base;
+            TiledHeightfield map;
+            size_t budget = slotBytes(CHUNK_SIZE) * BUDGET_TILES;
+            if (!expect(base.create(testPath("base.tiles"), baker.rows(), baker.cols(), CHUNK_SIZE, budget) &&
+                    map.create(testPath("map.tiles"), baker.rows(), baker.cols(), CHUNK_SIZE, budget),
+                    "%d threads: cannot create the tile files", threads)) {
+                continue;
+            }
+            expect(map.tileBudget() == BUDGET_TILES && map.tileCount() > BUDGET_TILES,
+                "%d threads: %zu of %d tiles mapped at once, expected %d", threads, map.tileBudget(),
+                map.tileCount(), BUDGET_TILES);
+            expect(baker.bake(base, map), "%d threads: bake failed", threads);
+            expect(matches(base, expectedBase), "%d threads: base differs from diamond-square in memory", threads);
+            expect(matches(map, expected), "%d threads: map differs from the stages run in memory", threads);
+        }
+    }
+
+    // A distinct value per cell, so misplaced rows or tiles show up
+    float cellValue(int x, int y) {
+        return static_cast<float>(x) * 1000.0f + static_cast<float>(y) + 0.25f;
+    }
+
+    void checkTiles() {
+        const int rows = 200;  // Edge tiles are partial
+        const int cols = 150;
+        const int side = 64;
+        size_t budget = slotBytes(side) * 2;
+        std::string path = testPath("tiles.tiles");
+        {
+            TiledHeightfield map;
+            if (!expect(map.create(path, rows, cols, side, budget), "cannot create %s", path.c_str())) return;
+            expect(map.tileRows() == 4 && map.tileCols() == 3 && map.tileBudget() == 2, "wrong tile layout");
+
+            // Every tile written with only two mapped at once, so most are
+            // evicted and mapped again before the check
+            for (int tileX = 0; tileX < map.tileRows(); ++tileX) {
+                for (int tileY = 0; tileY < map.tileCols(); ++tileY) {
+                    TileLock tile(map, tileX, tileY);
+                    const HeightfieldView& view = tile.view();
+                    expect(view.rows() == std::min(side, rows - tileX * side) &&
+                        view.cols() == std::min(side, cols - tileY * side), "tile (%d, %d) has the wrong shape",
+                        tileX, tileY);
+                    for (int x = 0; x < view.rows(); ++x) {
+                        for (int y = 0; y < view.cols(); ++y) view(x, y) = cellValue(tileX * side + x, tileY * side + y);
+                    }
+                }
+            }
+            Heightfield expected(rows, cols);
+            for (int x = 0; x < rows; ++x) {
+                for (int y = 0; y < cols; ++y) expected(x, y) = cellValue(x, y);
+            }
+            expect(matches(map, expected), "cells changed after their tiles were evicted");
+
+            // With both mapped tiles pinned, a third acquire waits for a release
+            std::atomic<bool> acquired(false);
+            {
+                TileLock first(map, 0, 0);
+                std::unique_ptr<TileLock> second(new TileLock(map, 1, 1));
+                std::thread waiter([&] {
+                    TileLock third(map, 2, 2);
+                    acquired = true;
+                    expect(!third.view().empty() && third.view()(0, 0) == cellValue(2 * side, 2 * side),
+                        "the tile acquired after waiting is wrong");
+                });
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                expect(!acquired, "acquire didn't wait while every mapped tile was pinned");
+                second.reset();
+                waiter.join();
+                expect(acquired, "acquire didn't proceed after a release");
+            }
+        }
+
+        // The file holds the map on its own
+        TiledHeightfield reopened;
+        if (expect(reopened.open(path, budget), "cannot reopen %s", path.c_str())) {
+            Heightfield expected(rows, cols);
+            for (int x = 0; x < rows; ++x) {
+                for (int y = 0; y < cols; ++y) expected(x, y) = cellValue(x, y);
+            }
+            expect(reopened.rows() == rows && reopened.cols() == cols && matches(reopened, expected),
+                "the reopened map differs");
+            reopened.close();
+        }
+        fs::resize_file(path, fs::file_size(path) - 1);
+        expect(!reopened.open(path, budget), "a truncated map opened");
+    }
+
+    std::vector<uint8_t> readFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // Both layers of exportMap against the map's cells, read back from disk
+    void checkExport(const Heightfield& expected) {
+        int rows = expected.rows();
+        int cols = expected.cols();
+        TiledHeightfield map;
+        if (!expect(map.create(testPath("export.tiles"), rows, cols, CHUNK_SIZE, slotBytes(CHUNK_SIZE) * 2),
+                "cannot create the export map")) {
+            return;
+        }
+        // Out-of-range heights too, which are clamped
+        Heightfield heights = expected;
+        heights(0, 0) = -0.5f;
+        heights(rows - 1, cols - 1) = 1.5f;
+        for (int tileX = 0; tileX < map.tileRows(); ++tileX) {
+            for (int tileY = 0; tileY < map.tileCols(); ++tileY) {
+                TileLock tile(map, tileX, tileY);
+                const HeightfieldView& view = tile.view();
+                for (int x = 0; x < view.rows(); ++x) {
+                    std::copy(heights.row(tileX * CHUNK_SIZE + x) + tileY * CHUNK_SIZE,
+                        heights.row(tileX * CHUNK_SIZE + x) + tileY * CHUNK_SIZE + view.cols(), view.row(x));
+                }
+            }
+        }
+
+        for (bool raw : { false, true }) {
+            const char* format = raw ? "raw" : "pgm";
+            std::string base = testPath("export");
+            if (!expect(exportMap(base, map, raw), "%s: export failed", format)) continue;
+            std::vector<uint8_t> heightFile = readFile(base + (raw ? ".r16" : ".pgm"));
+            std::vector<uint8_t> materialFile = readFile(base + (raw ? "_material.raw" : "_material.pgm"));
+            std::string heightHeader = raw ? "" : "P5\n" + std::to_string(rows) + " " + std::to_string(cols) +
+                "\n65535\n";
+            std::string materialHeader = raw ? "" : "P5\n" + std::to_string(rows) + " " + std::to_string(cols) +
+                "\n" + std::to_string(MATERIAL_COUNT - 1) + "\n";
+            size_t cells = static_cast<size_t>(rows) * cols;
+            if (!expect(heightFile.size() == heightHeader.size() + cells * 2 &&
+                    materialFile.size() == materialHeader.size() + cells, "%s: files have the wrong size", format) ||
+                !expect(std::equal(heightHeader.begin(), heightHeader.end(), heightFile.begin()) &&
+                    std::equal(materialHeader.begin(), materialHeader.end(), materialFile.begin()),
+                    "%s: wrong headers", format)) {
+                continue;
+            }
+
+            int wrong = 0;
+            for (int y = 0; y < cols; ++y) {
+                for (int x = 0; x < rows; ++x) {
+                    size_t cell = static_cast<size_t>(y) * rows + x;
+                    const uint8_t* sample = heightFile.data() + heightHeader.size() + cell * 2;
+                    int value = raw ? sample[0] | sample[1] << 8 : sample[0] << 8 | sample[1];
+                    float h = std::min(1.0f, std::max(0.0f, heights(x, y)));
+                    bool same = value == std::lround(h * 65535.0f) &&
+                        materialFile[materialHeader.size() + cell] == classifyMaterial(heights(x, y));
+                    if (!same && wrong++ == 0) expect(false, "%s: cell (%d, %d) exported wrong", format, x, y);
+                }
+            }
+            expect(wrong == 0, "%s: %d cells exported wrong", format, wrong);
+        }
+    }
+}
+
+int main() {
+    fs::remove_all(TEST_DIRECTORY);
+    fs::create_directories(TEST_DIRECTORY);
+    Heightfield expectedBase;
+    Heightfield expected;
+    bakeInMemory(bakeSettings(), expectedBase, expected);
+    checkBake(expectedBase, expected);
+    checkTiles();
+    checkExport(expected);
+    fs::remove_all(TEST_DIRECTORY);
+    return testResult("MapBakeTest");
+}
@@ -0,0 +1,116 @@
+// The pyramid ray cast must find the same hits as the reference cell march:
+// hit or miss, t and cell, for random rays at a generated chunk's display
+// heights. Rays come from above, from below the surface, from outside the
+// chunk, and parallel to each axis.
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "ChunkGenerator.h"
+#include "HeightPyramid.h"
+#include "TestSupport.h"
+
+namespace {
+    const int CHUNK_SIZE = 128;
+    const int RAYS_PER_KIND = 4000;
+
+    struct RayCounts {
+        int hits = 0;
+        int misses = 0;
+        int mismatches = 0;
+    };
+
+    void compare(const HeightPyramid& pyramid, const HeightRay& ray, const char* kind, RayCounts& counts) {
+        HeightRayHit fast;
+        HeightRayHit reference;
+        bool fastFound = pyramid.intersect(ray, fast);
+        bool referenceFound = pyramid.intersectMarching(ray, reference);
+        bool same = fastFound == referenceFound && (!fastFound ||
+            (fast.t == reference.t && fast.cellX == reference.cellX && fast.cellY == reference.cellY));
+        if (!same && counts.mismatches++ < 5) {
+            expect(false, "%s ray (%g, %g, %g) + t (%g, %g, %g), maxT %g: pyramid %s t %g cell (%d, %d), "
+                "march %s t %g cell (%d, %d)", kind, ray.originX, ray.originY, ray.originZ, ray.dirX, ray.dirY,
+                ray.dirZ, ray.maxT, fastFound ? "hit" : "miss", fastFound ? fast.t : 0.0f,
+                fastFound ? fast.cellX : -1, fastFound ? fast.cellY : -1, referenceFound ? "hit" : "miss",
+                referenceFound ? reference.t : 0.0f, referenceFound ? reference.cellX : -1,
+                referenceFound ? reference.cellY : -1);
+        }
+        if (referenceFound) ++counts.hits;
+        else ++counts.misses;
+    }
+
+    void report(const char* kind, const RayCounts& counts) {
+        expect(counts.mismatches == 0, "%s: %d of %d rays differ", kind, counts.mismatches,
+            counts.hits + counts.misses);
+        // Both outcomes, or the rays don't test much
+        expect(counts.hits > 0 && counts.misses > 0, "%s: %d hits and %d misses", kind, counts.hits,
+            counts.misses);
+    }
+}
+
+int main() {
+    ChunkGenerator generator(CHUNK_SIZE);
+    generator.generateChunk(12345, 2, -1);
+    const HeightPyramid& pyramid = generator.getPyramid();
+    const Heightfield& heights = generator.getDisplayHeights();
+    float low = heights(0, 0);
+    float high = low;
+    for (int x = 0; x < heights.rows(); ++x) {
+        for (int y = 0; y < heights.cols(); ++y) {
+            low = std::min(low, heights(x, y));
+            high = std::max(high, heights(x, y));
+        }
+    }
+
+    std::mt19937 random(2024);
+    const float side = static_cast<float>(CHUNK_SIZE);
+    std::uniform_real_distribution<float> across(-0.25f * side, 1.25f * side);
+    std::uniform_real_distribution<float> inside(0.0f, side);
+    std::uniform_real_distribution<float> heightRange(low, high);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> reach(10.0f, 400.0f);
+
+    // From above the highest point, looking down at a slant
+    RayCounts above;
+    for (int i = 0; i < RAYS_PER_KIND; ++i) {
+        HeightRay ray = { across(random), across(random), high + 5.0f + reach(random) * 0.1f,
+            unit(random), unit(random), -0.05f - 0.5f * std::abs(unit(random)), reach(random) };
+        compare(pyramid, ray, "above", above);
+    }
+    report("above", above);
+
+    // From under the surface: camera below the terrain, or leaving a hill
+    RayCounts below;
+    for (int i = 0; i < RAYS_PER_KIND; ++i) {
+        float x = inside(random);
+        float y = inside(random);
+        int cellX = std::min(static_cast<int>(x), CHUNK_SIZE - 1);
+        int cellY = std::min(static_cast<int>(y), CHUNK_SIZE - 1);
+        float floor = std::min(std::min(heights(cellX, cellY), heights(cellX + 1, cellY)),
+            std::min(heights(cellX, cellY + 1), heights(cellX + 1, cellY + 1)));
+        HeightRay ray = { x, y, floor - 0.1f - 5.0f * std::abs(unit(random)),
+            unit(random), unit(random), unit(random), reach(random) };
+        compare(pyramid, ray, "below", below);
+    }
+    report("below", below);
+
+    // Parallel to x or y, level or sloped, and straight up or down
+    RayCounts parallel;
+    for (int i = 0; i < RAYS_PER_KIND; ++i) {
+        HeightRay ray = { across(random), across(random), heightRange(random), 0.0f, 0.0f, 0.0f, reach(random) };
+        switch (i % 4) {
+        case 0: ray.dirX = unit(random) < 0.0f ? -1.0f : 1.0f; ray.dirZ = 0.1f * unit(random); break;
+        case 1: ray.dirY = unit(random) < 0.0f ? -1.0f : 1.0f; ray.dirZ = 0.1f * unit(random); break;
+        case 2: ray.dirX = unit(random); ray.dirY = unit(random); break;  // Level
+        default:
+            ray.originX = inside(random);
+            ray.originY = inside(random);
+            ray.dirZ = unit(random) < 0.0f ? -1.0f : 1.0f;
+            break;
+        }
+        compare(pyramid, ray, "axis-parallel", parallel);
+    }
+    report("axis-parallel", parallel);
+    return testResult("RayCastTest");
+}
@@ -0,0 +1,174 @@
+// Every row kernel and the batched noise, run through each dispatch level
+// this CPU supports, against the bounds documented in SimdKernels.h: the
+// SSE4.1 and AVX2 paths must match the scalar path exactly, and the scalar
+// approximations must stay within their error of the C library.
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Noise.h"
+#include "SimdKernels.h"
+#include "TestSupport.h"
+
+namespace {
+    // Odd, so every vector width leaves a tail
+    const int COUNT = 1027;
+
+    // Outputs of one dispatch level
+    struct KernelOutputs {
+        std::vector<float> pow[3];
+        std::vector<float> sin;
+        std::vector<float> cos;
+        std::vector<float> stencil;
+        std::vector<float> addClamp;
+        std::vector<float> displaced;
+        std::vector<float> aliasedDisplaced;
+        std::vector<float> noise;
+        std::vector<float> noiseTile;
+    };
+
+    const float EXPONENTS[3] = { 0.5f, 0.78f, 2.0f };
+
+    struct KernelInputs {
+        std::vector<float> unit;       // (0, 1]
+        std::vector<float> angles;     // |x| <= 1e4
+        std::vector<float> rows[3];    // Stencil rows, with a cell either side
+        std::vector<float> columnTerms;
+
+        KernelInputs() {
+            std::mt19937 random(1234);
+            std::uniform_real_distribution<float> unitDist(1e-6f, 1.0f);
+            std::uniform_real_distribution<float> angleDist(-1e4f, 1e4f);
+            std::uniform_real_distribution<float> termDist(-0.3f, 0.3f);
+            for (int i = 0; i < COUNT; ++i) {
+                unit.push_back(unitDist(random));
+                angles.push_back(angleDist(random));
+                columnTerms.push_back(termDist(random));
+            }
+            for (std::vector<float>& row : rows) {
+                for (int i = 0; i < COUNT + 2; ++i) row.push_back(unitDist(random));
+            }
+        }
+    };
+
+    KernelOutputs runKernels(const KernelInputs& in) {
+        KernelOutputs out;
+        for (int e = 0; e < 3; ++e) {
+            out.pow[e].resize(COUNT);
+            powRow(in.unit.data(), out.pow[e].data(), COUNT, EXPONENTS[e]);
+        }
+        out.sin.resize(COUNT);
+        sinRow(in.angles.data(), out.sin.data(), COUNT);
+        out.cos.resize(COUNT);
+        cosRow(in.angles.data(), out.cos.data(), COUNT);
+        out.stencil.resize(COUNT);
+        smoothStencilPowRow(in.rows[0].data() + 1, in.rows[1].data() + 1, in.rows[2].data() + 1,
+            out.stencil.data(), COUNT, 0.78f);
+        out.addClamp = in.unit;
+        addClampRow(out.addClamp.data(), 0.05f, in.columnTerms.data(), COUNT);
+        out.displaced.resize(COUNT);
+        displacedAverageRow(in.rows[0].data(), in.rows[1].data(), in.rows[2].data(), in.unit.data(),
+            out.displaced.data(), COUNT, 0x9e3779b9u, -17, 0.4f);
+        out.aliasedDisplaced = in.unit;
+        displacedAverageRow(in.rows[0].data(), out.aliasedDisplaced.data(), in.rows[2].data(), in.unit.data(),
+            out.aliasedDisplaced.data(), COUNT, 77u, 1000, 0.4f);
+
+        GradientNoise noise(99);
+        NoiseSettings fbm;
+        fbm.frequency = 1.0f / 64.0f;
+        out.noise.resize(COUNT);
+        noise.sampleRow(-300.0f, 12.0f, COUNT, fbm, out.noise.data());
+        NoiseSettings ridged = fbm;
+        ridged.fractal = NOISE_RIDGED;
+        ridged.warp = 8.0f;
+        const int tileRows = 5;
+        out.noiseTile.resize(tileRows * COUNT);
+        noise.sampleTile(40.0f, -600.0f, tileRows, COUNT, ridged, out.noiseTile.data(), COUNT);
+        return out;
+    }
+
+    float maxDifference(const std::vector<float>& a, const std::vector<float>& b) {
+        float worst = 0.0f;
+        for (size_t i = 0; i < a.size(); ++i) worst = std::max(worst, std::fabs(a[i] - b[i]));
+        return worst;
+    }
+
+    // The level must reproduce the scalar outputs exactly
+    void compareLevel(SimdLevel level, const KernelOutputs& scalar, const KernelOutputs& out) {
+        const char* name = simdLevelName(level);
+        struct { const char* kernel; const std::vector<float>& expected; const std::vector<float>& actual; } pairs[] = {
+            { "powRow 0.5", scalar.pow[0], out.pow[0] },
+            { "powRow 0.78", scalar.pow[1], out.pow[1] },
+            { "powRow 2", scalar.pow[2], out.pow[2] },
+            { "sinRow", scalar.sin, out.sin },
+            { "cosRow", scalar.cos, out.cos },
+            { "smoothStencilPowRow", scalar.stencil, out.stencil },
+            { "addClampRow", scalar.addClamp, out.addClamp },
+            { "displacedAverageRow", scalar.displaced, out.displaced },
+            { "displacedAverageRow in place", scalar.aliasedDisplaced, out.aliasedDisplaced },
+            { "GradientNoise::sampleRow", scalar.noise, out.noise },
+            { "GradientNoise::sampleTile", scalar.noiseTile, out.noiseTile },
+        };
+        for (const auto& pair : pairs) {
+            expect(std::memcmp(pair.expected.data(), pair.actual.data(), pair.expected.size() * sizeof(float)) == 0,
+                "%s %s differs from scalar by up to %g", name, pair.kernel, maxDifference(pair.expected, pair.actual));
+        }
+    }
+
+    // Scalar approximations against the C library, at the documented bounds
+    void checkApproximations(const KernelInputs& in, const KernelOutputs& scalar) {
+        for (int e = 0; e < 3; ++e) {
+            float worst = 0.0f;
+            for (int i = 0; i < COUNT; ++i) {
+                float expected = std::pow(in.unit[i], EXPONENTS[e]);
+                worst = std::max(worst, std::fabs(scalar.pow[e][i] - expected) / expected);
+            }
+            expect(worst <= 2e-6f, "fastPow exponent %g relative error %g > 2e-6", EXPONENTS[e], worst);
+        }
+        expect(fastPow(0.0f, 0.78f) == 0.0f && fastPow(-0.5f, 0.78f) == 0.0f, "fastPow of x <= 0 isn't 0");
+
+        float sinError = 0.0f;
+        float cosError = 0.0f;
+        for (int i = 0; i < COUNT; ++i) {
+            sinError = std::max(sinError, std::fabs(scalar.sin[i] - std::sin(in.angles[i])));
+            cosError = std::max(cosError, std::fabs(scalar.cos[i] - std::cos(in.angles[i])));
+        }
+        expect(sinError <= 1e-7f, "fastSin error %g > 1e-7 for |x| <= 1e4", sinError);
+        expect(cosError <= 1e-7f, "fastCos error %g > 1e-7 for |x| <= 1e4", cosError);
+
+        float farError = 0.0f;
+        for (float x = -1e5f; x <= 1e5f; x += 97.31f) {
+            farError = std::max(farError, std::fabs(fastSin(x) - std::sin(x)));
+            farError = std::max(farError, std::fabs(fastCos(x) - std::cos(x)));
+        }
+        expect(farError <= 1e-6f, "fastSin/fastCos error %g > 1e-6 for |x| <= 1e5", farError);
+
+        // The one-lane forms are the scalar row kernels
+        for (int i = 0; i < COUNT; ++i) {
+            if (!expect(fastPow(in.unit[i], 0.78f) == scalar.pow[1][i] && fastSin(in.angles[i]) == scalar.sin[i] &&
+                    fastCos(in.angles[i]) == scalar.cos[i], "fast* differ from the scalar row kernels at %d", i)) {
+                break;
+            }
+        }
+    }
+}
+
+int main() {
+    KernelInputs inputs;
+    setSimdLevel(SIMD_SCALAR);
+    KernelOutputs scalar = runKernels(inputs);
+    checkApproximations(inputs, scalar);
+
+    for (SimdLevel level : { SIMD_SSE41, SIMD_AVX2 }) {
+        setSimdLevel(level);
+        if (activeSimdLevel() != level) {
+            std::printf("%s not supported here, skipped\n", simdLevelName(level));
+            continue;
+        }
+        compareLevel(level, scalar, runKernels(inputs));
+    }
+    setSimdLevel(detectSimdLevel());
+    return testResult("SimdKernelTest");
+}
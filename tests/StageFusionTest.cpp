@@ -0,0 +1,50 @@
+// The fused post-erosion pass must produce exactly what the staged passes
+// do: heights, materials and display heights, over several seeds and chunk
+// sizes, with and without a pool splitting the pass into bands.
+
+#include <memory>
+
+#include "ChunkGenerator.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+
+namespace {
+    struct ChunkCase {
+        unsigned int seed;
+        int x;
+        int y;
+    };
+
+    const ChunkCase CASES[] = { { 12345, 0, 0 }, { 7, -3, 5 }, { 0xdeadbeefu, 11, -2 } };
+    const int SIZES[] = { 64, 128, 256 };
+}
+
+int main() {
+    ThreadPool pool(3);
+    for (ThreadPool* workers : { static_cast<ThreadPool*>(nullptr), &pool }) {
+        for (int size : SIZES) {
+            ChunkGenerator fused(size);
+            ChunkGenerator staged(size);
+            staged.setStageFusion(false);
+            for (ChunkGenerator* generator : { &fused, &staged }) {
+                generator->setThreadPool(workers);
+                generator->setMeshBuilding(false);
+            }
+            for (const ChunkCase& chunk : CASES) {
+                fused.generateChunk(chunk.seed, chunk.x, chunk.y);
+                staged.generateChunk(chunk.seed, chunk.x, chunk.y);
+                const char* threads = workers ? "pooled" : "serial";
+                expect(identical(fused.getHeights(), staged.getHeights()),
+                    "%s size %d seed %u (%d, %d): heights differ", threads, size, chunk.seed, chunk.x, chunk.y);
+                expect(identical(fused.getMaterials(), staged.getMaterials()),
+                    "%s size %d seed %u (%d, %d): materials differ", threads, size, chunk.seed, chunk.x, chunk.y);
+                expect(identical(fused.getDisplayHeights(), staged.getDisplayHeights()),
+                    "%s size %d seed %u (%d, %d): display heights differ", threads, size, chunk.seed, chunk.x,
+                    chunk.y);
+                expect(fused.getMaxHeight() == staged.getMaxHeight(),
+                    "%s size %d seed %u (%d, %d): max height differs", threads, size, chunk.seed, chunk.x, chunk.y);
+            }
+        }
+    }
+    return testResult("StageFusionTest");
+}
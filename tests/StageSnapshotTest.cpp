@@ -0,0 +1,138 @@
+// Stage snapshots let a parameter change rerun only the stages it affects.
+// Regenerating after each change must give exactly what a generator without
+// snapshots does. With a snapshot cache, the same must hold for a chunk that
+// was tuned, then loaded from the chunk cache by a fresh generator as after a
+// restart, and the stages before the change must be reused rather than rerun.
+
+#include <filesystem>
+
+#include "ChunkCache.h"
+#include "ChunkGenerator.h"
+#include "TestSupport.h"
+
+namespace {
+    const unsigned int WORLD_SEED = 7;
+    const int CHUNK_SIZE = 128;
+    const char* const CHUNK_DIRECTORY = "stage_snapshot_test_cache";
+    const char* const SNAPSHOT_DIRECTORY = "stage_snapshot_test_cache/stages";
+
+    struct Parameters {
+        float roughness = 0.82f;
+        int iterations = 10;
+        BiomeSettings biome;
+        ErosionMode mode = EROSION_THERMAL;
+
+        void applyTo(ChunkGenerator& generator) const {
+            ErosionSettings erosion;
+            erosion.iterations = iterations;
+            generator.setRoughness(roughness);
+            generator.setErosionSettings(erosion);
+            generator.setBiomeSettings(biome);
+            generator.setErosionMode(mode);
+        }
+    };
+
+    // Generate (x, y) with generator and compare it to a full regeneration
+    void checkAgainstFull(ChunkGenerator& generator, const Parameters& parameters, int x, int y, const char* step) {
+        parameters.applyTo(generator);
+        generator.generateChunk(WORLD_SEED, x, y);
+        ChunkGenerator full(CHUNK_SIZE);
+        full.setStageSnapshots(false);
+        full.setMeshBuilding(false);
+        parameters.applyTo(full);
+        full.generateChunk(WORLD_SEED, x, y);
+        expect(identical(generator.getHeights(), full.getHeights()), "%s: heights differ", step);
+        expect(identical(generator.getMaterials(), full.getMaterials()), "%s: materials differ", step);
+    }
+
+    void checkReuse(const ChunkGenerator& generator, bool base, bool erosion, const char* step) {
+        const ChunkTimings& timings = generator.getTimings();
+        expect(timings.baseReused == base && timings.erosionReused == erosion,
+            "%s: base %s and erosion %s, expected %s and %s", step, timings.baseReused ? "reused" : "ran",
+            timings.erosionReused ? "reused" : "ran", base ? "reused" : "ran", erosion ? "reused" : "ran");
+    }
+
+    void checkInMemory() {
+        ChunkGenerator generator(CHUNK_SIZE);
+        generator.setMeshBuilding(false);
+        Parameters parameters;
+        checkAgainstFull(generator, parameters, 0, 0, "first");
+        checkReuse(generator, false, false, "first");
+        checkAgainstFull(generator, parameters, 0, 0, "unchanged");
+        checkReuse(generator, true, true, "unchanged");
+        parameters.iterations = 14;
+        checkAgainstFull(generator, parameters, 0, 0, "erosion iterations");
+        checkReuse(generator, true, false, "erosion iterations");
+        parameters.biome.terrainOctaves = 3;
+        checkAgainstFull(generator, parameters, 0, 0, "biome octaves");
+        checkReuse(generator, true, true, "biome octaves");
+        parameters.roughness = 0.97f;
+        checkAgainstFull(generator, parameters, 0, 0, "roughness");
+        checkReuse(generator, false, false, "roughness");
+        checkAgainstFull(generator, parameters, 1, 0, "other chunk");
+        checkReuse(generator, false, false, "other chunk");
+        parameters.mode = EROSION_HYDRAULIC;
+        checkAgainstFull(generator, parameters, 1, 0, "hydraulic");
+        checkReuse(generator, true, false, "hydraulic");
+        parameters.mode = EROSION_THERMAL;
+        checkAgainstFull(generator, parameters, 1, 0, "back to thermal");
+        checkReuse(generator, true, false, "back to thermal");
+    }
+
+    // A chunk tuned on one run and loaded on the next. Streaming in a new
+    // chunk writes no snapshots; regenerating it with other parameters does.
+    void checkWarmStart() {
+        ChunkCacheSettings chunkSettings;
+        chunkSettings.directory = CHUNK_DIRECTORY;
+        ChunkCacheSettings snapshotSettings;
+        snapshotSettings.directory = SNAPSHOT_DIRECTORY;
+        Parameters parameters;
+        ScratchArena arena;
+        {
+            ChunkCache chunks(chunkSettings);
+            ChunkCache snapshots(snapshotSettings);
+            ChunkGenerator first(CHUNK_SIZE);
+            first.setMeshBuilding(false);
+            first.setSnapshotCache(&snapshots);
+            parameters.applyTo(first);
+            first.generateChunk(WORLD_SEED, 2, -1, arena);
+            expect(snapshots.sizeBytes() == 0, "a new chunk wrote stage snapshots");
+            parameters.iterations = 6;
+            parameters.applyTo(first);
+            first.generateChunk(WORLD_SEED, 2, -1, arena);
+            expect(snapshots.sizeBytes() > 0, "retuning wrote no stage snapshots");
+            parameters.iterations = 10;
+            parameters.applyTo(first);
+            first.generateChunk(WORLD_SEED, 2, -1, arena);
+            first.storeChunk(chunks, arena);
+        }
+
+        ChunkCache chunks(chunkSettings);
+        ChunkCache snapshots(snapshotSettings);
+        ChunkGenerator restarted(CHUNK_SIZE);
+        restarted.setMeshBuilding(false);
+        restarted.setSnapshotCache(&snapshots);
+        parameters.applyTo(restarted);
+        if (!expect(restarted.loadChunk(chunks, WORLD_SEED, 2, -1, arena), "warm start: chunk not in the cache")) {
+            return;
+        }
+        parameters.iterations = 6;
+        checkAgainstFull(restarted, parameters, 2, -1, "warm start, tuned erosion");
+        checkReuse(restarted, true, true, "warm start, tuned erosion");
+        parameters.iterations = 14;
+        checkAgainstFull(restarted, parameters, 2, -1, "warm start, new erosion");
+        checkReuse(restarted, true, false, "warm start, new erosion");
+        parameters.roughness = 0.9f;
+        checkAgainstFull(restarted, parameters, 2, -1, "warm start, new roughness");
+        checkReuse(restarted, false, false, "warm start, new roughness");
+        expect(snapshots.hits() == 2, "warm start: %lld snapshot loads, expected 2", snapshots.hits());
+    }
+}
+
+int main() {
+    checkInMemory();
+    std::filesystem::remove_all(CHUNK_DIRECTORY);
+    checkWarmStart();
+    std::filesystem::remove_all(CHUNK_DIRECTORY);
+    return testResult("StageSnapshotTest");
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "Heightfield.h"
+
+// Minimal checks for the ctest targets. Each test is an executable that
+// prints every failed check and exits nonzero if there was one.
+
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+// Report a printf-style message when condition is false
+inline bool expect(bool condition, const char* format, ...) {
+    if (condition) return true;
+    ++testFailures();
+    std::va_list args;
+    va_start(args, format);
+    std::fputs("FAILED: ", stderr);
+    std::vfprintf(stderr, format, args);
+    std::fputc('\n', stderr);
+    va_end(args);
+    return false;
+}
+
+// Same shape and the same bits in every cell
+template <typename T>
+bool identical(const Grid<T>& a, const Grid<T>& b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) return false;
+    for (int x = 0; x < a.rows(); ++x) {
+        if (std::memcmp(a.row(x), b.row(x), a.cols() * sizeof(T)) != 0) return false;
+    }
+    return true;
+}
+
+// Exit code for main
+inline int testResult(const char* name) {
+    int failures = testFailures();
+    if (failures) std::fprintf(stderr, "%s: %d check(s) failed\n", name, failures);
+    else std::printf("%s: passed\n", name);
+    return failures ? 1 : 0;
+}
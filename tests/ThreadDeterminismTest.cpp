@@ -0,0 +1,74 @@
+// Chunks generated on pools of 1, 2 and every hardware thread must be bit
+// for bit the ones generated serially: chunks spread across the pool, and
+// each generator also splits its own passes over it.
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ChunkGenerator.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+
+namespace {
+    const unsigned int WORLD_SEED = 4242;
+    const int CHUNK_SIZE = 128;
+    const int CHUNKS_PER_SIDE = 3;  // Chunks (-1..1, -1..1)
+    const int CHUNK_COUNT = CHUNKS_PER_SIDE * CHUNKS_PER_SIDE;
+    // Fewer than the default, to keep the test quick; still many rounds
+    const int HYDRAULIC_DROPLETS = 20000;
+
+    struct ChunkResult {
+        Heightfield heights;
+        MaterialLayer materials;
+    };
+
+    void chunkCoords(int index, int& x, int& y) {
+        x = index / CHUNKS_PER_SIDE - 1;
+        y = index % CHUNKS_PER_SIDE - 1;
+    }
+
+    // Every chunk, on pool (serially when null)
+    std::vector<ChunkResult> generateChunks(ThreadPool* pool, ErosionMode mode) {
+        std::vector<ChunkResult> results(CHUNK_COUNT);
+        std::vector<ScratchArena> arenas(pool ? pool->threadCount() : 1);
+        auto generate = [&](int index) {
+            int x, y;
+            chunkCoords(index, x, y);
+            ChunkGenerator generator(CHUNK_SIZE);
+            generator.setThreadPool(pool);
+            generator.setErosionMode(mode);
+            HydraulicErosionSettings hydraulic;
+            hydraulic.droplets = HYDRAULIC_DROPLETS;
+            generator.setHydraulicErosionSettings(hydraulic);
+            generator.setMeshBuilding(false);
+            generator.generateChunk(WORLD_SEED, x, y, arenas[pool ? pool->currentWorkerIndex() : 0]);
+            results[index].heights = generator.getHeights();
+            results[index].materials = generator.getMaterials();
+        };
+        if (pool) pool->parallelFor(CHUNK_COUNT, generate);
+        else for (int index = 0; index < CHUNK_COUNT; ++index) generate(index);
+        return results;
+    }
+}
+
+int main() {
+    int threadCounts[] = { 1, 2, static_cast<int>(std::thread::hardware_concurrency()) };
+    for (ErosionMode mode : { EROSION_THERMAL, EROSION_HYDRAULIC }) {
+        const char* modeName = mode == EROSION_HYDRAULIC ? "hydraulic" : "thermal";
+        std::vector<ChunkResult> reference = generateChunks(nullptr, mode);
+        for (int threads : threadCounts) {
+            ThreadPool pool(threads);
+            std::vector<ChunkResult> results = generateChunks(&pool, mode);
+            for (int index = 0; index < CHUNK_COUNT; ++index) {
+                int x, y;
+                chunkCoords(index, x, y);
+                expect(identical(results[index].heights, reference[index].heights),
+                    "%s chunk (%d, %d) heights differ with %d threads", modeName, x, y, pool.threadCount());
+                expect(identical(results[index].materials, reference[index].materials),
+                    "%s chunk (%d, %d) materials differ with %d threads", modeName, x, y, pool.threadCount());
+            }
+        }
+    }
+    return testResult("ThreadDeterminismTest");
+}